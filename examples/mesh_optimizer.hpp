@@ -0,0 +1,338 @@
+#pragma once
+
+// Standard libraries
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <numeric>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Index and vertex reordering for loaded meshes; the order of operations
+// in optimize() matters, since each stage builds on the previous one
+namespace mesh_optimizer {
+
+// Simulated post-transform cache size; close to current hardware
+constexpr uint32_t cache_size = 32;
+
+// Average cache misses per triangle with a FIFO cache (lower is better,
+// 0.5 is the ideal for large regular meshes); defaults to the cache size
+// the optimizer targets, so figures before and after are comparable
+inline float acmr(const std::vector <uint32_t> &indices, uint32_t vertex_count, uint32_t size = cache_size)
+{
+	if (indices.empty())
+		return 0.0f;
+
+	std::vector <uint32_t> timestamps(vertex_count, 0);
+	uint32_t timestamp = size + 1;
+	uint32_t misses = 0;
+
+	for (uint32_t index : indices) {
+		// Still in the cache if it was pushed within the last size misses
+		if (timestamp - timestamps[index] > size) {
+			timestamps[index] = timestamp++;
+			misses++;
+		}
+	}
+
+	return float(misses) / float(indices.size() / 3);
+}
+
+// Merges bitwise identical vertices
+template <typename V>
+void deduplicate(std::vector <V> &vertices, std::vector <uint32_t> &indices)
+{
+	std::unordered_map <std::string, uint32_t> unique;
+	std::vector <uint32_t> remap(vertices.size());
+	std::vector <V> result;
+
+	for (uint32_t i = 0; i < vertices.size(); i++) {
+		std::string key((const char *) &vertices[i], sizeof(V));
+
+		auto it = unique.find(key);
+		if (it == unique.end()) {
+			remap[i] = result.size();
+			unique[key] = result.size();
+			result.push_back(vertices[i]);
+		} else {
+			remap[i] = it->second;
+		}
+	}
+
+	for (uint32_t &index : indices)
+		index = remap[index];
+
+	vertices = std::move(result);
+}
+
+namespace detail {
+
+// Forsyth's scoring; favors recently used vertices and those with few
+// triangles left, so that vertices are finished while still cached
+inline float vertex_score(int32_t position, uint32_t remaining)
+{
+	if (remaining == 0)
+		return -1.0f;
+
+	float score = 0.0f;
+	if (position >= 0) {
+		if (position < 3)
+			score = 0.75f;
+		else
+			score = std::pow(1.0f - float(position - 3) / float(cache_size - 3), 1.5f);
+	}
+
+	return score + 2.0f * std::pow(float(remaining), -0.5f);
+}
+
+}
+
+// Reorders triangles to improve post-transform cache hits
+inline void optimize_vertex_cache(std::vector <uint32_t> &indices, uint32_t vertex_count)
+{
+	uint32_t triangle_count = indices.size() / 3;
+	if (triangle_count == 0)
+		return;
+
+	// Triangles adjacent to each vertex; the active ones are kept up front
+	std::vector <uint32_t> offsets(vertex_count + 1, 0);
+	for (uint32_t index : indices)
+		offsets[index + 1]++;
+
+	std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+	std::vector <uint32_t> remaining(vertex_count, 0);
+	std::vector <uint32_t> adjacency(indices.size());
+	for (uint32_t t = 0; t < triangle_count; t++) {
+		for (uint32_t k = 0; k < 3; k++) {
+			uint32_t v = indices[3 * t + k];
+			adjacency[offsets[v] + remaining[v]++] = t;
+		}
+	}
+
+	std::vector <int32_t> positions(vertex_count, -1);
+	std::vector <float> vertex_scores(vertex_count);
+	for (uint32_t v = 0; v < vertex_count; v++)
+		vertex_scores[v] = detail::vertex_score(-1, remaining[v]);
+
+	std::vector <bool> emitted(triangle_count, false);
+	std::vector <uint32_t> cache;
+	std::vector <uint32_t> result;
+	result.reserve(indices.size());
+
+	uint32_t cursor = 0;
+	int64_t best = 0;
+
+	while (result.size() < indices.size()) {
+		// Fall back to the first triangle not yet emitted
+		if (best < 0) {
+			while (emitted[cursor])
+				cursor++;
+
+			best = cursor;
+		}
+
+		uint32_t t = best;
+		emitted[t] = true;
+
+		// Emit and push the vertices to the front of the cache
+		std::vector <uint32_t> next;
+		for (uint32_t k = 0; k < 3; k++) {
+			uint32_t v = indices[3 * t + k];
+			result.push_back(v);
+			next.push_back(v);
+
+			// Deactivate the triangle for the vertex
+			uint32_t *begin = &adjacency[offsets[v]];
+			uint32_t *end = begin + remaining[v];
+			std::swap(*std::find(begin, end, t), *(end - 1));
+			remaining[v]--;
+		}
+
+		for (uint32_t v : cache) {
+			if (std::find(next.begin(), next.end(), v) == next.end())
+				next.push_back(v);
+		}
+
+		// Rescore everything which was cached before or after
+		for (uint32_t i = 0; i < next.size(); i++) {
+			uint32_t v = next[i];
+			positions[v] = (i < cache_size) ? int32_t(i) : -1;
+			vertex_scores[v] = detail::vertex_score(positions[v], remaining[v]);
+		}
+
+		best = -1;
+		float best_score = -1.0f;
+
+		for (uint32_t v : next) {
+			for (uint32_t i = 0; i < remaining[v]; i++) {
+				uint32_t u = adjacency[offsets[v] + i];
+				float score = vertex_scores[indices[3 * u]]
+					+ vertex_scores[indices[3 * u + 1]]
+					+ vertex_scores[indices[3 * u + 2]];
+
+				if (score > best_score) {
+					best_score = score;
+					best = u;
+				}
+			}
+		}
+
+		if (next.size() > cache_size)
+			next.resize(cache_size);
+
+		cache = std::move(next);
+	}
+
+	indices = std::move(result);
+}
+
+// Reorders clusters of cache optimized triangles so that outward facing
+// ones come first, reducing overdraw; the reordering is dropped if it costs
+// more than threshold times the current ACMR
+template <typename V, typename P>
+void optimize_overdraw(const std::vector <V> &vertices,
+		       std::vector <uint32_t> &indices,
+		       const P &position,
+		       float threshold = 1.05f)
+{
+	uint32_t triangle_count = indices.size() / 3;
+	if (triangle_count == 0)
+		return;
+
+	// Clusters start wherever the simulated cache was flushed, i.e. at
+	// triangles with three misses
+	std::vector <uint32_t> timestamps(vertices.size(), 0);
+	uint32_t timestamp = cache_size + 1;
+
+	std::vector <uint32_t> clusters;
+	for (uint32_t t = 0; t < triangle_count; t++) {
+		uint32_t misses = 0;
+		for (uint32_t k = 0; k < 3; k++) {
+			uint32_t v = indices[3 * t + k];
+			if (timestamp - timestamps[v] > cache_size) {
+				timestamps[v] = timestamp++;
+				misses++;
+			}
+		}
+
+		if (t == 0 || misses == 3)
+			clusters.push_back(t);
+	}
+
+	clusters.push_back(triangle_count);
+
+	// Mesh centroid
+	float center[3] = { 0.0f, 0.0f, 0.0f };
+	for (const V &v : vertices) {
+		auto p = position(v);
+		center[0] += p.x;
+		center[1] += p.y;
+		center[2] += p.z;
+	}
+
+	for (float &c : center)
+		c /= float(std::max(vertices.size(), size_t(1)));
+
+	// Sort key of each cluster; how much it faces away from the center
+	std::vector <float> keys(clusters.size() - 1);
+	for (uint32_t c = 0; c + 1 < clusters.size(); c++) {
+		float centroid[3] = { 0.0f, 0.0f, 0.0f };
+		float normal[3] = { 0.0f, 0.0f, 0.0f };
+		float area = 0.0f;
+
+		for (uint32_t t = clusters[c]; t < clusters[c + 1]; t++) {
+			auto a = position(vertices[indices[3 * t]]);
+			auto b = position(vertices[indices[3 * t + 1]]);
+			auto d = position(vertices[indices[3 * t + 2]]);
+
+			float e0[3] = { b.x - a.x, b.y - a.y, b.z - a.z };
+			float e1[3] = { d.x - a.x, d.y - a.y, d.z - a.z };
+			float n[3] = {
+				e0[1] * e1[2] - e0[2] * e1[1],
+				e0[2] * e1[0] - e0[0] * e1[2],
+				e0[0] * e1[1] - e0[1] * e1[0]
+			};
+
+			float w = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+			centroid[0] += w * (a.x + b.x + d.x) / 3.0f;
+			centroid[1] += w * (a.y + b.y + d.y) / 3.0f;
+			centroid[2] += w * (a.z + b.z + d.z) / 3.0f;
+
+			for (uint32_t i = 0; i < 3; i++)
+				normal[i] += n[i];
+
+			area += w;
+		}
+
+		float length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+		if (area <= 0.0f || length <= 0.0f) {
+			keys[c] = 0.0f;
+			continue;
+		}
+
+		float key = 0.0f;
+		for (uint32_t i = 0; i < 3; i++)
+			key += (centroid[i] / area - center[i]) * normal[i] / length;
+
+		keys[c] = key;
+	}
+
+	std::vector <uint32_t> order(keys.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(),
+		[&](uint32_t a, uint32_t b) { return keys[a] > keys[b]; });
+
+	std::vector <uint32_t> result;
+	result.reserve(indices.size());
+	for (uint32_t c : order) {
+		result.insert(result.end(),
+			indices.begin() + 3 * clusters[c],
+			indices.begin() + 3 * clusters[c + 1]);
+	}
+
+	if (acmr(result, vertices.size()) <= threshold * acmr(indices, vertices.size()))
+		indices = std::move(result);
+}
+
+// Reorders vertices by first use, so that fetches walk memory linearly;
+// unreferenced vertices are dropped
+template <typename V>
+void optimize_vertex_fetch(std::vector <V> &vertices, std::vector <uint32_t> &indices)
+{
+	std::vector <uint32_t> remap(vertices.size(), ~0u);
+	std::vector <V> result;
+	result.reserve(vertices.size());
+
+	for (uint32_t &index : indices) {
+		if (remap[index] == ~0u) {
+			remap[index] = result.size();
+			result.push_back(vertices[index]);
+		}
+
+		index = remap[index];
+	}
+
+	vertices = std::move(result);
+}
+
+// All stages, in order
+template <typename V, typename P>
+void optimize(std::vector <V> &vertices, std::vector <uint32_t> &indices, const P &position)
+{
+	deduplicate(vertices, indices);
+	optimize_vertex_cache(indices, vertices.size());
+	optimize_overdraw(vertices, indices, position);
+	optimize_vertex_fetch(vertices, indices);
+}
+
+template <typename V>
+void optimize(std::vector <V> &vertices, std::vector <uint32_t> &indices)
+{
+	optimize(vertices, indices, [](const V &v) { return v.position; });
+}
+
+} // namespace mesh_optimizer
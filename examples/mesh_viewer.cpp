@@ -14,6 +14,9 @@
 // Argument parsing
 #include "argparser.hpp"
 
+// Mesh optimization
+#include "mesh_optimizer.hpp"
+
 // Vertex data
 struct Vertex {
 	glm::vec3 position;
@@ -89,6 +92,7 @@ int main(int argc, char *argv[])
 	// Process the arguments
 	ArgParser argparser { "example-mesh-viewer", 1, {
 		ArgParser::Option { "filename", "Input mesh" },
+		ArgParser::Option { "--benchmark", "Compare GPU frame times with and without optimization" },
 	}};
 
 	argparser.parse(argc, argv);
@@ -97,9 +101,22 @@ int main(int argc, char *argv[])
 	path = argparser.get <std::string> (0);
 	path = std::filesystem::weakly_canonical(path);
 
-	// Load the mesh
+	bool benchmark = argparser.get_optn <bool> ("--benchmark");
+
+	// Load the mesh, keeping the original order around to compare against
 	Mesh mesh = load_mesh(path);
 
+	Mesh original;
+	if (benchmark)
+		original = mesh;
+
+	// Reorder for the vertex cache, overdraw and vertex fetches
+	float before = mesh_optimizer::acmr(mesh.indices, mesh.vertices.size());
+	mesh_optimizer::optimize(mesh.vertices, mesh.indices);
+	float after = mesh_optimizer::acmr(mesh.indices, mesh.vertices.size());
+
+	printf("Optimized mesh: ACMR %.3f -> %.3f\n", before, after);
+
 	// Precompute some data for rendering
 	glm::vec3 center = glm::vec3(0.0f);
 	glm::vec3 min = glm::vec3(FLT_MAX);
@@ -168,6 +185,62 @@ int main(int argc, char *argv[])
 		.buffer(mesh.vertices, vk::BufferUsageFlagBits::eVertexBuffer)
 		.buffer(mesh.indices, vk::BufferUsageFlagBits::eIndexBuffer);
 
+	littlevk::Buffer original_vertex_buffer;
+	littlevk::Buffer original_index_buffer;
+
+	if (benchmark) {
+		std::tie(original_vertex_buffer, original_index_buffer) = bind(app.device, memory_properties, deallocator)
+			.buffer(original.vertices, vk::BufferUsageFlagBits::eVertexBuffer)
+			.buffer(original.indices, vk::BufferUsageFlagBits::eIndexBuffer);
+	}
+
+	// Timestamps around each frame's commands when benchmarking; the
+	// original mesh is drawn first, then the optimized one
+	static constexpr uint32_t BENCHMARK_FRAMES = 500;
+
+	vk::QueryPool query_pool;
+	float timestamp_period = phdev.getProperties().limits.timestampPeriod;
+	uint64_t timestamp_mask = ~0ull;
+
+	if (benchmark) {
+		uint32_t family = littlevk::find_graphics_queue_family(phdev);
+		uint32_t bits = phdev.getQueueFamilyProperties()[family].timestampValidBits;
+		if (bits < 64)
+			timestamp_mask = (1ull << bits) - 1;
+
+		if (bits == 0) {
+			argparser.warning("graphics queue has no timestamp support, not benchmarking");
+			benchmark = false;
+		} else {
+			query_pool = app.device.createQueryPool({ {}, vk::QueryType::eTimestamp, 4 });
+			deallocator.device_deallocators.push([query_pool](vk::Device device) {
+				device.destroyQueryPool(query_pool);
+			});
+		}
+	}
+
+	// Per frame slot; whether its timestamps are pending and for which mesh
+	std::array <bool, 2> timed { false, false };
+	std::array <uint32_t, 2> timed_mesh { 0, 0 };
+
+	std::array <double, 2> gpu_time { 0, 0 };
+	std::array <uint32_t, 2> gpu_frames { 0, 0 };
+	uint32_t benchmarked = 0;
+
+	auto collect = [&](uint32_t slot) {
+		if (!timed[slot])
+			return;
+
+		std::array <uint64_t, 2> ticks;
+		(void) app.device.getQueryPoolResults(query_pool, 2 * slot, 2,
+			sizeof(ticks), ticks.data(), sizeof(uint64_t),
+			vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWait);
+
+		gpu_time[timed_mesh[slot]] += ((ticks[1] - ticks[0]) & timestamp_mask) * timestamp_period * 1e-6;
+		gpu_frames[timed_mesh[slot]]++;
+		timed[slot] = false;
+	};
+
 	// Compile shader modules
 	vk::ShaderModule vertex_module = littlevk::shader::compile(
 		app.device, vertex_shader_source,
@@ -254,6 +327,9 @@ int main(int argc, char *argv[])
                 if (glfwWindowShouldClose(app.window.handle))
                         break;
 
+		if (benchmark && benchmarked >= 2 * BENCHMARK_FRAMES)
+			break;
+
 		// Zoom in/out
 		if (glfwGetKey(app.window.handle, GLFW_KEY_EQUAL) == GLFW_PRESS) {
 			radius += 0.01f;
@@ -296,8 +372,18 @@ int main(int argc, char *argv[])
 		// Record command buffer
 		vk::CommandBuffer &cmd = command_buffers[frame];
 
+		// The previous submission of this slot has finished by now
+		collect(frame);
+
+		uint32_t drawn = (benchmark && benchmarked < BENCHMARK_FRAMES) ? 0 : 1;
+
 		cmd.begin(vk::CommandBufferBeginInfo());
 
+		if (benchmark) {
+			cmd.resetQueryPool(query_pool, 2 * frame, 2);
+			cmd.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, query_pool, 2 * frame);
+		}
+
 		// Set viewport and scissor
 		littlevk::viewport_and_scissor(cmd, littlevk::RenderArea(app.window));
 
@@ -332,23 +418,33 @@ int main(int argc, char *argv[])
 
 		cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, ppl.handle);
 		cmd.pushConstants <MVP> (ppl.layout, vk::ShaderStageFlagBits::eVertex, 0, push_constants);
-		cmd.bindVertexBuffers(0, vertex_buffer.buffer, { 0 });
-		cmd.bindIndexBuffer(index_buffer.buffer, 0, vk::IndexType::eUint32);
-		cmd.drawIndexed(mesh.indices.size(), 1, 0, 0, 0);
+
+		if (drawn == 0) {
+			cmd.bindVertexBuffers(0, original_vertex_buffer.buffer, { 0 });
+			cmd.bindIndexBuffer(original_index_buffer.buffer, 0, vk::IndexType::eUint32);
+			cmd.drawIndexed(original.indices.size(), 1, 0, 0, 0);
+		} else {
+			cmd.bindVertexBuffers(0, vertex_buffer.buffer, { 0 });
+			cmd.bindIndexBuffer(index_buffer.buffer, 0, vk::IndexType::eUint32);
+			cmd.drawIndexed(mesh.indices.size(), 1, 0, 0, 0);
+		}
 
 		cmd.endRenderPass();
-		cmd.end();
 
-		// Submit command buffer while signaling the semaphore
-		vk::PipelineStageFlags wait_stage = vk::PipelineStageFlagBits::eColorAttachmentOutput;
+		if (benchmark) {
+			cmd.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, query_pool, 2 * frame + 1);
+			timed[frame] = true;
+			timed_mesh[frame] = drawn;
+			benchmarked++;
+		}
 
-		vk::SubmitInfo submit_info {
-			sync.image_available[frame],
-			wait_stage, cmd,
-			sync.render_finished[frame]
-		};
+		cmd.end();
 
-		app.graphics_queue.submit(submit_info, sync.in_flight[frame]);
+		// Submit command buffer while signaling the semaphore
+		littlevk::submit(app.graphics_queue, cmd,
+			{ { sync.image_available[frame], vk::PipelineStageFlagBits2::eColorAttachmentOutput } },
+			{ { sync.render_finished[frame], vk::PipelineStageFlagBits2::eAllCommands } },
+			sync.in_flight[frame]);
 
                 op = littlevk::present_image(app.present_queue, app.swapchain.swapchain, sync[frame], op.index);
 		if (op.status == littlevk::SurfaceOperation::eResize)
@@ -360,6 +456,15 @@ int main(int argc, char *argv[])
 	// Finish all pending operations
 	app.device.waitIdle();
 
+	if (benchmark) {
+		collect(0);
+		collect(1);
+
+		printf("GPU frame time (%u frames each):\n", BENCHMARK_FRAMES);
+		printf("    original   %8.3f ms\n", gpu_time[0]/std::max(gpu_frames[0], 1u));
+		printf("    optimized  %8.3f ms\n", gpu_time[1]/std::max(gpu_frames[1], 1u));
+	}
+
 	// Free resources using automatic deallocator
 	deallocator.drop();
 
@@ -1,11 +1,17 @@
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <numeric>
 #include <stack>
+#include <thread>
 
-#include "littlevk.hpp"
-
-// GLM for vector math
+// GLM for vector math; also used for vertex formats
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#define LITTLEVK_GLM_TRANSLATOR
+#include "littlevk.hpp"
+
 // Assimp for mesh loading
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
@@ -30,6 +36,9 @@
 // TODO: remove this...
 #include "argparser.hpp"
 
+// Mesh optimization
+#include "mesh_optimizer.hpp"
+
 // Vertex data
 struct Vertex {
 	glm::vec3 position;
@@ -37,6 +46,17 @@ struct Vertex {
 	glm::vec2 uv;
 };
 
+// Compact vertex data for the GPU; 20 bytes instead of 32
+struct PackedVertex {
+	glm::vec3 position;
+	littlevk::oct16 normal;
+	littlevk::rg16f uv;
+};
+
+LITTLEVK_VERTEX(PackedVertex, position, normal, uv)
+
+static_assert(littlevk::ReflectedBinding <PackedVertex> ::packed());
+
 // Mesh and mesh loading
 struct Mesh {
 	std::vector <Vertex> vertices;
@@ -51,9 +71,7 @@ Model load_model(const std::filesystem::path &);
 
 // Translating CPU data to Vulkan resources
 struct VulkanMesh {
-	littlevk::Buffer vertex_buffer;
-	littlevk::Buffer index_buffer;
-	size_t index_count;
+	littlevk::MeshRegistry::Handle geometry;
 
 	littlevk::Image albedo_image;
 	vk::Sampler albedo_sampler;
@@ -86,6 +104,27 @@ void mouse_callback(GLFWwindow *, int, int, int);
 void cursor_callback(GLFWwindow *, double, double);
 void scroll_callback(GLFWwindow *, double, double);
 
+// Thread-safe texture cache, keyed by path
+struct TextureCache {
+	std::mutex lock;
+	std::map <std::string, littlevk::Image> images;
+
+	std::optional <littlevk::Image> find(const std::string &key) {
+		std::lock_guard guard(lock);
+
+		auto it = images.find(key);
+		if (it == images.end())
+			return std::nullopt;
+
+		return it->second;
+	}
+
+	void insert(const std::string &key, const littlevk::Image &image) {
+		std::lock_guard guard(lock);
+		images[key] = image;
+	}
+};
+
 struct App : littlevk::Skeleton {
 	vk::PhysicalDevice phdev;
 	vk::PhysicalDeviceMemoryProperties memory_properties;
@@ -93,7 +132,7 @@ struct App : littlevk::Skeleton {
 
 	littlevk::Deallocator deallocator;
 
-	std::map <std::string, littlevk::Image> image_cache;
+	TextureCache image_cache;
 
 	App();
 };
@@ -128,52 +167,347 @@ App::App()
 	).unwrap(deallocator);
 }
 
-std::optional <littlevk::Image> load_texture(App &app, const std::filesystem::path &path)
+// Texture decoded on a worker thread, waiting for upload
+struct DecodedTexture {
+	std::filesystem::path path;
+
+	// Either a pre-compressed container...
+	std::optional <littlevk::texture::TextureData> compressed;
+
+	// ...or pixels decoded by stb_image
+	uint8_t *pixels = nullptr;
+	int width = 0;
+	int height = 0;
+};
+
+DecodedTexture decode_texture(const vk::PhysicalDevice &phdev, const std::filesystem::path &path)
 {
-	if (app.image_cache.count(path.string()))
-		return app.image_cache.at(path.string());
+	DecodedTexture texture;
+	texture.path = path;
+
+	// Prefer pre-compressed containers (e.g. albedo.ktx2 next to albedo.png)
+	// which upload their mip chains directly, skipping the CPU decode
+	for (const char *extension : { ".ktx2", ".dds" }) {
+		std::filesystem::path compressed = path;
+		compressed.replace_extension(extension);
+		if (!std::filesystem::exists(compressed))
+			continue;
+
+		texture.compressed = littlevk::texture::load(compressed);
+		if (!texture.compressed)
+			continue;
 
-	littlevk::Image image;
+		// Fall back to the source image if the format cannot be sampled
+		if (littlevk::texture::supported(phdev, texture.compressed->format))
+			return texture;
+
+		microlog::warning("decode_texture", "%s uses %s, which cannot be sampled on this device\n",
+			compressed.c_str(), vk::to_string(texture.compressed->format).c_str());
+
+		texture.compressed.reset();
+	}
 
-	int width;
-	int height;
 	int channels;
+	texture.pixels = stbi_load(path.c_str(), &texture.width, &texture.height, &channels, 4);
+	return texture;
+}
+
+// Ring of staging buffers; textures are packed into the current slot and
+// every slot is uploaded with a single submission, so the GPU copies one
+// batch while the next one is being filled
+struct StagingRing {
+	static constexpr size_t SLOTS = 2;
+	static constexpr vk::DeviceSize BATCH_SIZE = 64ull << 20;
+
+	struct Upload {
+		std::string key;
+		littlevk::Image image;
+		std::vector <vk::BufferImageCopy> regions;
+		bool generate_mips;
+	};
+
+	struct Slot {
+		littlevk::Buffer buffer;
+		uint8_t *mapped = nullptr;
+		vk::DeviceSize offset = 0;
+
+		vk::CommandBuffer cmd;
+		vk::Fence fence;
+		bool pending = false;
 
-	uint8_t *pixels = stbi_load(path.c_str(), &width, &height, &channels, 4);
-	if (pixels) {
-		printf(CLEAR_LINE "Loaded albedo texture %s with resolution of %d x %d pixels",
-			path.c_str(), width, height);
-
-		// Prepare a staging buffder
-		littlevk::Buffer staging_buffer;
-
-		std::tie(image, staging_buffer) = bind(app.device, app.memory_properties, app.deallocator)
-			.image(width, height,
-				vk::Format::eR8G8B8A8Unorm,
-				vk::ImageUsageFlagBits::eSampled
-					| vk::ImageUsageFlagBits::eTransferDst,
-				vk::ImageAspectFlagBits::eColor)
-			.buffer(pixels, sizeof(uint32_t) * width * height, vk::BufferUsageFlagBits::eTransferSrc);
-
-		// TODO: bind function
-		littlevk::submit_now(app.device, app.command_pool, app.graphics_queue,
-			[&](const vk::CommandBuffer &cmd) {
-				littlevk::transition(cmd, image, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal);
-				littlevk::copy_buffer_to_image(cmd, image, staging_buffer, vk::ImageLayout::eTransferDstOptimal);
-				littlevk::transition(cmd, image, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eShaderReadOnlyOptimal);
+		std::vector <Upload> uploads;
+	};
+
+	App &app;
+	std::array <Slot, SLOTS> slots;
+	size_t current = 0;
+
+	StagingRing(App &app_) : app(app_) {
+		auto cmds = littlevk::command_buffers(app.device, app.command_pool,
+			vk::CommandBufferLevel::ePrimary, uint32_t(SLOTS));
+
+		for (size_t i = 0; i < SLOTS; i++) {
+			slots[i].cmd = cmds[i];
+			slots[i].fence = app.device.createFence({});
+		}
+	}
+
+	~StagingRing() {
+		for (Slot &slot : slots) {
+			wait(slot);
+			if (slot.mapped) {
+				app.device.unmapMemory(slot.buffer.memory);
+				littlevk::destroy_buffer(app.device, slot.buffer);
 			}
-		);
 
-		// Free interim data
-		littlevk::destroy_buffer(app.device, staging_buffer);
-		stbi_image_free(pixels);
+			app.device.freeCommandBuffers(app.command_pool, slot.cmd);
+			app.device.destroyFence(slot.fence);
+		}
+	}
 
-		app.image_cache[path.string()] = image;
-	} else {
-		return {};
+	void wait(Slot &slot) {
+		if (!slot.pending)
+			return;
+
+		(void) app.device.waitForFences(slot.fence, VK_TRUE, UINT64_MAX);
+		app.device.resetFences(slot.fence);
+		slot.pending = false;
 	}
 
-	return image;
+	// Make room for size bytes in the current slot
+	Slot &reserve(vk::DeviceSize size, vk::DeviceSize alignment) {
+		Slot *slot = &slots[current];
+
+		vk::DeviceSize offset = (slot->offset + alignment - 1)/alignment * alignment;
+		if (slot->mapped && offset + size > slot->buffer.device_size() && !slot->uploads.empty()) {
+			flush();
+			slot = &slots[current];
+			offset = 0;
+		}
+
+		// Oversized textures get a larger staging buffer
+		if (!slot->mapped || offset + size > slot->buffer.device_size()) {
+			if (slot->mapped) {
+				app.device.unmapMemory(slot->buffer.memory);
+				littlevk::destroy_buffer(app.device, slot->buffer);
+			}
+
+			slot->buffer = littlevk::buffer(app.device, app.memory_properties,
+				std::max(size, BATCH_SIZE), vk::BufferUsageFlagBits::eTransferSrc).value;
+			slot->mapped = (uint8_t *) app.device.mapMemory(slot->buffer.memory,
+				0, slot->buffer.device_size());
+			offset = 0;
+		}
+
+		slot->offset = offset;
+		return *slot;
+	}
+
+	void push(const DecodedTexture &texture) {
+		const std::string key = texture.path.string();
+
+		if (texture.compressed) {
+			const auto &data = *texture.compressed;
+
+			// Offsets must stay multiples of four and of the texel block size
+			littlevk::FormatBlock block = littlevk::format_block(data.format);
+			Slot &slot = reserve(data.data.size(), std::lcm <vk::DeviceSize> (4, std::max(block.size, 1u)));
+			std::memcpy(slot.mapped + slot.offset, data.data.data(), data.data.size());
+
+			littlevk::Image image = bind(app.device, app.memory_properties, app.deallocator)
+				.image(data.extent, data.format,
+					vk::ImageUsageFlagBits::eSampled
+						| vk::ImageUsageFlagBits::eTransferDst,
+					vk::ImageAspectFlagBits::eColor,
+					vk::ImageType::e2D,
+					data.view_type(),
+					false,
+					data.mip_levels,
+					data.array_layers);
+
+			std::vector <vk::BufferImageCopy> regions = data.regions;
+			for (auto &region : regions)
+				region.bufferOffset += slot.offset;
+
+			slot.uploads.push_back({ key, image, regions, false });
+			slot.offset += data.data.size();
+
+			printf(CLEAR_LINE "Loaded compressed albedo texture %s (%s) with %u mip levels",
+				key.c_str(), vk::to_string(data.format).c_str(), data.mip_levels);
+		} else if (texture.pixels) {
+			vk::Extent2D extent { uint32_t(texture.width), uint32_t(texture.height) };
+			vk::DeviceSize size = sizeof(uint32_t) * extent.width * extent.height;
+
+			Slot &slot = reserve(size, 4);
+			std::memcpy(slot.mapped + slot.offset, texture.pixels, size);
+			stbi_image_free(texture.pixels);
+
+			littlevk::Image image = bind(app.device, app.memory_properties, app.deallocator)
+				.image(extent,
+					vk::Format::eR8G8B8A8Unorm,
+					vk::ImageUsageFlagBits::eSampled
+						| vk::ImageUsageFlagBits::eTransferSrc
+						| vk::ImageUsageFlagBits::eTransferDst,
+					vk::ImageAspectFlagBits::eColor,
+					vk::ImageType::e2D,
+					vk::ImageViewType::e2D,
+					false,
+					littlevk::mip_level_count(extent));
+
+			vk::BufferImageCopy region {
+				slot.offset, 0, 0,
+				vk::ImageSubresourceLayers {
+					vk::ImageAspectFlagBits::eColor,
+					0, 0, 1
+				},
+				vk::Offset3D { 0, 0, 0 },
+				vk::Extent3D { extent.width, extent.height, 1 }
+			};
+
+			slot.uploads.push_back({ key, image, { region }, true });
+			slot.offset += size;
+
+			printf(CLEAR_LINE "Loaded albedo texture %s with resolution of %d x %d pixels",
+				key.c_str(), texture.width, texture.height);
+		} else {
+			printf(CLEAR_LINE "Failed to load albedo texture %s", key.c_str());
+		}
+	}
+
+	// Submit every upload in the current slot at once
+	void flush() {
+		Slot &slot = slots[current];
+		if (slot.uploads.empty())
+			return;
+
+		slot.cmd.begin({ vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
+
+		// One barrier for the whole batch
+		littlevk::TransitionBatch to_transfer;
+		for (Upload &upload : slot.uploads) {
+			to_transfer.add <vk::ImageLayout::eUndefined,
+				vk::ImageLayout::eTransferDstOptimal> (upload.image);
+		}
+
+		to_transfer.record(slot.cmd);
+
+		littlevk::TransitionBatch to_shader;
+		for (Upload &upload : slot.uploads) {
+			littlevk::copy_buffer_to_image(slot.cmd, upload.image, slot.buffer,
+				upload.regions, vk::ImageLayout::eTransferDstOptimal);
+
+			if (upload.generate_mips) {
+				littlevk::generate_mipmaps(app.phdev, slot.cmd, upload.image);
+			} else {
+				to_shader.add <vk::ImageLayout::eTransferDstOptimal,
+					vk::ImageLayout::eShaderReadOnlyOptimal> (upload.image);
+				upload.image.layout = vk::ImageLayout::eShaderReadOnlyOptimal;
+			}
+		}
+
+		to_shader.record(slot.cmd);
+
+		slot.cmd.end();
+
+		littlevk::submit(app.graphics_queue, slot.cmd, {}, {}, slot.fence);
+		slot.pending = true;
+
+		// Textures become visible to meshes once they are scheduled
+		for (Upload &upload : slot.uploads)
+			app.image_cache.insert(upload.key, upload.image);
+
+		slot.uploads.clear();
+		slot.offset = 0;
+
+		// Move on to the next slot, once the GPU is done with it
+		current = (current + 1) % SLOTS;
+		wait(slots[current]);
+	}
+};
+
+// Decode every texture of the model in parallel and upload them in batches
+void load_textures(App &app, const Model &model)
+{
+	// Unique textures which have not been loaded yet
+	std::vector <std::filesystem::path> paths;
+
+	std::set <std::string> seen;
+	for (const Mesh &mesh : model) {
+		std::string key = mesh.albedo_path.string();
+		if (key.empty() || seen.count(key) || app.image_cache.find(key))
+			continue;
+
+		seen.insert(key);
+		paths.push_back(mesh.albedo_path);
+	}
+
+	if (paths.empty())
+		return;
+
+	// Workers decode and hand the results back to this thread; the number
+	// of decoded textures not yet uploaded is capped to bound memory use
+	std::mutex lock;
+	std::condition_variable ready;
+	std::condition_variable space;
+	std::queue <DecodedTexture> decoded;
+	std::atomic <size_t> next = 0;
+	size_t in_flight = 0;
+
+	size_t worker_count = std::clamp <size_t> (std::thread::hardware_concurrency(), 1, paths.size());
+	size_t max_in_flight = 2 * worker_count;
+
+	std::vector <std::thread> workers;
+	for (size_t i = 0; i < worker_count; i++) {
+		workers.emplace_back([&]() {
+			size_t index;
+			while ((index = next++) < paths.size()) {
+				{
+					std::unique_lock guard(lock);
+					space.wait(guard, [&]() { return in_flight < max_in_flight; });
+					in_flight++;
+				}
+
+				DecodedTexture texture = decode_texture(app.phdev, paths[index]);
+
+				{
+					std::lock_guard guard(lock);
+					decoded.push(std::move(texture));
+				}
+
+				ready.notify_one();
+			}
+		});
+	}
+
+	// Only this thread touches Vulkan; uploads overlap with decoding
+	{
+		StagingRing ring(app);
+
+		for (size_t received = 0; received < paths.size(); received++) {
+			DecodedTexture texture;
+
+			{
+				std::unique_lock guard(lock);
+				ready.wait(guard, [&]() { return !decoded.empty(); });
+				texture = std::move(decoded.front());
+				decoded.pop();
+			}
+
+			ring.push(texture);
+
+			{
+				std::lock_guard guard(lock);
+				in_flight--;
+			}
+
+			space.notify_one();
+		}
+
+		ring.flush();
+	}
+
+	for (std::thread &worker : workers)
+		worker.join();
 }
 
 // TODO: destructor
@@ -190,22 +524,28 @@ void destroy_app(App &app)
 }
 
 // TODO: app method
-VulkanMesh vulkan_mesh(App &app, const Mesh &mesh)
+VulkanMesh vulkan_mesh(App &app, littlevk::MeshRegistry &registry, const Mesh &mesh)
 {
 	// Create the Vulkan mesh
 	VulkanMesh vk_mesh;
 
-	vk_mesh.index_count = mesh.indices.size();
 	vk_mesh.has_texture = false;
 
-	// Buffers
-	std::tie(vk_mesh.vertex_buffer, vk_mesh.index_buffer) = bind(app.device, app.memory_properties, app.deallocator)
-		.buffer(mesh.vertices, vk::BufferUsageFlagBits::eVertexBuffer)
-		.buffer(mesh.indices, vk::BufferUsageFlagBits::eIndexBuffer);
+	// Geometry goes into the shared buffers, quantized
+	std::vector <PackedVertex> packed;
+	for (const Vertex &v : mesh.vertices) {
+		packed.push_back(PackedVertex {
+			v.position,
+			littlevk::encode::octahedral16(v.normal.x, v.normal.y, v.normal.z),
+			littlevk::encode::half2(v.uv.x, v.uv.y)
+		});
+	}
+
+	vk_mesh.geometry = registry.add(packed, mesh.indices);
 
 	// Images
 	if (!mesh.albedo_path.empty()) {
-		auto image = load_texture(app, mesh.albedo_path);
+		auto image = app.image_cache.find(mesh.albedo_path.string());
 
 		if (image.has_value()) {
 			vk_mesh.albedo_image = image.value();
@@ -224,8 +564,6 @@ VulkanMesh vulkan_mesh(App &app, const Mesh &mesh)
 
 int main(int argc, char *argv[])
 {
-	using standalone::readfile;
-
 	// Process the arguments
 	ArgParser argparser { "example-model-viewer", 1, {
 		ArgParser::Option { "filename", "Input model" },
@@ -261,38 +599,38 @@ int main(int argc, char *argv[])
 	// Initialize the rendering backend
 	App app;
 
-	// Create a render pass
-	vk::RenderPass render_pass = littlevk::RenderPassAssembler(app.device, app.deallocator)
-		.add_attachment(littlevk::default_color_attachment(app.swapchain.format))
-		.add_attachment(littlevk::default_depth_attachment())
-		.add_subpass(vk::PipelineBindPoint::eGraphics)
-			.color_attachment(0, vk::ImageLayout::eColorAttachmentOptimal)
-			.depth_attachment(1, vk::ImageLayout::eDepthStencilAttachmentOptimal)
-			.done();
-
-	// Create a depth buffer
+	// Create a depth buffer; rendering is dynamic, so there is no render
+	// pass or framebuffers to go with it
 	littlevk::Image depth_buffer = bind(app.device, app.memory_properties, app.deallocator)
 		.image(app.window.extent,
 			vk::Format::eD32Sfloat,
 			vk::ImageUsageFlagBits::eDepthStencilAttachment,
 			vk::ImageAspectFlagBits::eDepth);
 
-	// Create framebuffers from the swapchain
-	littlevk::FramebufferGenerator generator(app.device, render_pass, app.window.extent, app.deallocator);
-	for (const auto &view : app.swapchain.image_views)
-		generator.add(view, depth_buffer.view);
+	// Layouts and barriers for the attachments
+	littlevk::ResourceTracker tracker;
 
-	std::vector <vk::Framebuffer> framebuffers = generator.unpack();
+	// Command buffers are recycled per frame
+	auto allocator = littlevk::command_allocator(app.device,
+		littlevk::find_graphics_queue_family(app.phdev), 2).unwrap(app.deallocator);
 
-	// Allocate command buffers
-	auto command_buffers = app.device.allocateCommandBuffers({
-		app.command_pool, vk::CommandBufferLevel::ePrimary, 2
-	});
+	// Load all textures up front
+	load_textures(app, model);
+
+	// Allocate mesh resources; all geometry shares one vertex and one index buffer
+	uint32_t vertex_total = 0;
+	uint32_t index_total = 0;
+	for (const auto &mesh : model) {
+		vertex_total += mesh.vertices.size();
+		index_total += mesh.indices.size();
+	}
+
+	auto registry = littlevk::mesh_registry(app.device, app.memory_properties,
+		sizeof(PackedVertex), vertex_total, index_total).unwrap(app.deallocator);
 
-	// Allocate mesh resources
 	std::vector <VulkanMesh> vk_meshes;
 	for (const auto &mesh : model) {
-		VulkanMesh vk_mesh = vulkan_mesh(app, mesh);
+		VulkanMesh vk_mesh = vulkan_mesh(app, registry, mesh);
 		vk_meshes.push_back(vk_mesh);
 	}
 
@@ -326,28 +664,36 @@ int main(int argc, char *argv[])
 			 1, vk::ShaderStageFlagBits::eFragment }}
 	};
 
-	auto vertex_layout = littlevk::VertexLayout <littlevk::rgb32f, littlevk::rgb32f, littlevk::rg32f> ();
+	auto vertex_layout = littlevk::ReflectedLayout <PackedVertex> ();
 
+	// Loaded from files so that edits are picked up while running
 	auto textured_bundle = littlevk::ShaderStageBundle(app.device, app.deallocator)
-		.source(readfile(SHADERS_DIRECTORY "/model_viewer.vert"), vk::ShaderStageFlagBits::eVertex)
-		.source(readfile(SHADERS_DIRECTORY "/model_viewer_textured.frag"), vk::ShaderStageFlagBits::eFragment);
+		.file(SHADERS_DIRECTORY "/model_viewer.vert", vk::ShaderStageFlagBits::eVertex)
+		.file(SHADERS_DIRECTORY "/model_viewer_textured.frag", vk::ShaderStageFlagBits::eFragment);
 
 	auto default_bundle = littlevk::ShaderStageBundle(app.device, app.deallocator)
-		.source(readfile(SHADERS_DIRECTORY "/model_viewer.vert"), vk::ShaderStageFlagBits::eVertex)
-		.source(readfile(SHADERS_DIRECTORY "/model_viewer_default.frag"), vk::ShaderStageFlagBits::eFragment);
-
-	littlevk::Pipeline textured_ppl = littlevk::PipelineAssembler <littlevk::eGraphics> (app.device, app.window, app.deallocator)
-		.with_render_pass(render_pass, 0)
-		.with_vertex_layout(vertex_layout)
-		.with_shader_bundle(textured_bundle)
-		.with_dsl_bindings(textured_dslbs)
-		.with_push_constant <MVP> (vk::ShaderStageFlagBits::eVertex);
-
-	littlevk::Pipeline default_ppl = littlevk::PipelineAssembler <littlevk::eGraphics> (app.device, app.window, app.deallocator)
-		.with_render_pass(render_pass, 0)
-		.with_vertex_layout(vertex_layout)
-		.with_shader_bundle(default_bundle)
-		.with_push_constant <MVP> (vk::ShaderStageFlagBits::eVertex);
+		.file(SHADERS_DIRECTORY "/model_viewer.vert", vk::ShaderStageFlagBits::eVertex)
+		.file(SHADERS_DIRECTORY "/model_viewer_default.frag", vk::ShaderStageFlagBits::eFragment);
+
+	auto textured_builder = [&](littlevk::Deallocator &dal, const littlevk::ShaderStageBundle &bundle) -> littlevk::Pipeline {
+		return littlevk::PipelineAssembler <littlevk::eGraphics> (app.device, app.window, dal)
+			.with_rendering({ app.swapchain.format }, vk::Format::eD32Sfloat)
+			.with_vertex_layout(vertex_layout)
+			.with_shader_bundle(bundle)
+			.with_dsl_bindings(textured_dslbs)
+			.with_push_constant <MVP> (vk::ShaderStageFlagBits::eVertex);
+	};
+
+	auto default_builder = [&](littlevk::Deallocator &dal, const littlevk::ShaderStageBundle &bundle) -> littlevk::Pipeline {
+		return littlevk::PipelineAssembler <littlevk::eGraphics> (app.device, app.window, dal)
+			.with_rendering({ app.swapchain.format }, vk::Format::eD32Sfloat)
+			.with_vertex_layout(vertex_layout)
+			.with_shader_bundle(bundle)
+			.with_push_constant <MVP> (vk::ShaderStageFlagBits::eVertex);
+	};
+
+	littlevk::Pipeline textured_ppl = textured_builder(app.deallocator, textured_bundle);
+	littlevk::Pipeline default_ppl = default_builder(app.deallocator, default_bundle);
 
 	// Link descriptor sets
 	// TODO: Needs a proper storage mechanism to offload without memory issues
@@ -376,6 +722,17 @@ int main(int argc, char *argv[])
 	// Syncronization primitives
 	auto sync = littlevk::present_syncronization(app.device, 2).unwrap(app.deallocator);
 
+	// Draw lists are recorded in parallel into secondary command buffers
+	littlevk::ParallelRecorder recorder;
+	recorder.start(app.device, littlevk::find_graphics_queue_family(app.phdev),
+		std::thread::hardware_concurrency(), 2);
+
+	// Pipelines are rebuilt in the background when their shaders change
+	littlevk::ShaderReloader reloader;
+	reloader.start(app.device, 2);
+	reloader.track(textured_ppl, textured_bundle, textured_builder);
+	reloader.track(default_ppl, default_bundle, default_builder);
+
 	// Prepare camera and model matrices
 	g_state.center = center;
 	g_state.radius = glm::length(max - min);
@@ -393,23 +750,16 @@ int main(int argc, char *argv[])
 	glfwSetCursorPosCallback(app.window.handle, cursor_callback);
 	glfwSetScrollCallback(app.window.handle, scroll_callback);
 
-	// Resize callback
+	// Resize callback; only the depth buffer depends on the extent
 	auto resize = [&]() {
 		app.resize();
 
-		// Recreate the depth buffer
-		littlevk::Image depth_buffer = bind(app.device, app.memory_properties, app.deallocator)
+		tracker.forget(depth_buffer);
+		depth_buffer = bind(app.device, app.memory_properties, app.deallocator)
 			.image(app.window.extent,
 				vk::Format::eD32Sfloat,
 				vk::ImageUsageFlagBits::eDepthStencilAttachment,
 				vk::ImageAspectFlagBits::eDepth);
-
-		// Rebuid the framebuffers
-		generator.extent = app.window.extent;
-		for (const auto &view : app.swapchain.image_views)
-			generator.add(view);
-
-		framebuffers = generator.unpack();
 	};
 
 	// Render loop
@@ -443,19 +793,33 @@ int main(int argc, char *argv[])
 			continue;
 		}
 
-		// Record command buffer
-		const auto &cmd = command_buffers[frame];
+		// Record command buffer; acquiring has already waited on the frame's fence
+		allocator.begin_frame(frame);
+		reloader.update();
+
+		const auto cmd = allocator.primary();
 		cmd.begin(vk::CommandBufferBeginInfo {});
 
 		// Set viewport and scissor
 		littlevk::viewport_and_scissor(cmd, littlevk::RenderArea(app.window));
 
-		littlevk::RenderPassBeginInfo(2)
-			.with_render_pass(render_pass)
-			.with_framebuffer(framebuffers[op.index])
+		// Prepare the attachments
+		littlevk::Image target;
+		target.image = app.swapchain.images[op.index];
+		target.aspect = vk::ImageAspectFlagBits::eColor;
+
+		tracker.assume(target, littlevk::usage::acquired);
+		tracker.image(target, littlevk::usage::color_attachment);
+		tracker.image(depth_buffer, littlevk::usage::depth_attachment);
+		tracker.flush(cmd);
+
+		auto rendering = littlevk::RenderingInfo()
 			.with_extent(app.window.extent)
+			.with_color(app.swapchain.image_views[op.index])
+			.with_depth(depth_buffer.view)
 			.clear_color(0, std::array <float, 4> { 0, 0, 0, 0 })
-			.clear_depth(1, 1)
+			.clear_depth(1.0f, 0u)
+			.with_flags(vk::RenderingFlagBits::eContentsSecondaryCommandBuffers)
 			.begin(cmd);
 
 		// Render the triangle
@@ -469,36 +833,47 @@ int main(int argc, char *argv[])
 
 		push_constants.light_direction = glm::normalize(glm::vec3 { 1.0f, 1.0f, 1.0f });
 
-		for (auto &vk_mesh : vk_meshes) {
-			push_constants.albedo_color = vk_mesh.albedo_color;
+		auto inheritance = littlevk::SecondaryInheritance::from_rendering({ app.swapchain.format }, vk::Format::eD32Sfloat)
+			.with_viewport(app.window.extent);
 
-			if (vk_mesh.has_texture) {
-				cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, textured_ppl.handle);
-				cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, textured_ppl.layout, 0, vk_mesh.descriptor_set, {});
-				cmd.pushConstants <MVP> (textured_ppl.layout, vk::ShaderStageFlagBits::eVertex, 0, push_constants);
-			} else {
-				cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, default_ppl.handle);
-				cmd.pushConstants <MVP> (default_ppl.layout, vk::ShaderStageFlagBits::eVertex, 0, push_constants);
-			}
+		auto draw = [&](const vk::CommandBuffer &cmd, uint32_t begin, uint32_t end) {
+			MVP constants = push_constants;
+			registry.bind(cmd);
 
-			cmd.bindVertexBuffers(0, vk_mesh.vertex_buffer.buffer, { 0 });
-			cmd.bindIndexBuffer(vk_mesh.index_buffer.buffer, 0, vk::IndexType::eUint32);
-			cmd.drawIndexed(vk_mesh.index_count, 1, 0, 0, 0);
-		}
+			// Consecutive meshes often share a pipeline
+			littlevk::DescriptorBinder binder(cmd);
 
-		cmd.endRenderPass();
-		cmd.end();
+			for (uint32_t i = begin; i < end; i++) {
+				const VulkanMesh &vk_mesh = vk_meshes[i];
+				constants.albedo_color = vk_mesh.albedo_color;
 
-		// Submit command buffer while signaling the semaphore
-		constexpr vk::PipelineStageFlags wait_stage = vk::PipelineStageFlagBits::eColorAttachmentOutput;
+				if (vk_mesh.has_texture) {
+					binder.use(textured_ppl)
+						.bind(0, vk_mesh.descriptor_set)
+						.push <MVP> (vk::ShaderStageFlagBits::eVertex, constants);
+				} else {
+					binder.use(default_ppl)
+						.push <MVP> (vk::ShaderStageFlagBits::eVertex, constants);
+				}
 
-		vk::SubmitInfo submit_info {
-			sync.image_available[frame],
-			wait_stage, cmd,
-			sync.render_finished[frame]
+				registry.draw(cmd, vk_mesh.geometry);
+			}
 		};
 
-		app.graphics_queue.submit(submit_info, sync.in_flight[frame]);
+		recorder.record(cmd, frame, inheritance, vk_meshes.size(), draw, 64);
+
+		rendering.end(cmd);
+
+		tracker.image(target, littlevk::usage::present);
+		tracker.flush(cmd);
+
+		cmd.end();
+
+		// Submit command buffer while signaling the semaphore
+		littlevk::submit(app.graphics_queue, cmd,
+			{ { sync.image_available[frame], vk::PipelineStageFlagBits2::eColorAttachmentOutput } },
+			{ { sync.render_finished[frame], vk::PipelineStageFlagBits2::eAllCommands } },
+			sync.in_flight[frame]);
 
                 op = littlevk::present_image(app.present_queue, app.swapchain.swapchain, sync[frame], op.index);
 		if (op.status == littlevk::SurfaceOperation::eResize)
@@ -507,6 +882,10 @@ int main(int argc, char *argv[])
 		frame = 1 - frame;
         }
 
+	app.device.waitIdle();
+	recorder.stop();
+	reloader.stop();
+
 	destroy_app(app);
 	return 0;
 }
@@ -587,7 +966,7 @@ Mesh process_mesh(aiMesh *mesh, const aiScene *scene, const std::filesystem::pat
 
 	// Process all the mesh's vertices
 	for (size_t i = 0; i < mesh->mNumVertices; i++) {
-		Vertex v;
+		Vertex v {};
 
 		v.position = {
 			mesh->mVertices[i].x,
@@ -631,6 +1010,9 @@ Mesh process_mesh(aiMesh *mesh, const aiScene *scene, const std::filesystem::pat
 		}
 	}
 
+	// Reorder for the vertex cache, overdraw and vertex fetches
+	mesh_optimizer::optimize(vertices, triangles);
+
 	Mesh new_mesh { vertices, triangles };
 
 	// Process materials
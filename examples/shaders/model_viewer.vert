@@ -1,7 +1,7 @@
 #version 450
 
 layout (location = 0) in vec3 position;
-layout (location = 1) in vec3 normal;
+layout (location = 1) in vec2 octahedral;
 layout (location = 2) in vec2 uv;
 
 layout (push_constant) uniform MVP {
@@ -18,8 +18,17 @@ layout (location = 1) out vec2 out_uv;
 layout (location = 2) out vec3 out_light_direction;
 layout (location = 3) out vec3 out_albedo_color;
 
+vec3 decode_normal(vec2 e)
+{
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	n.xy = (n.z < 0.0) ? (1.0 - abs(n.yx)) * sign(n.xy) : n.xy;
+	return normalize(n);
+}
+
 void main()
 {
+	vec3 normal = decode_normal(octahedral);
+
 	gl_Position = proj * view * model * vec4(position, 1.0);
 	gl_Position.y = -gl_Position.y;
 	gl_Position.z = (gl_Position.z + gl_Position.w) / 2.0;
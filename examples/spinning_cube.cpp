@@ -248,15 +248,10 @@ int main()
 		cmd.end();
 
 		// Submit command buffer while signaling the semaphore
-		constexpr vk::PipelineStageFlags wait_stage = vk::PipelineStageFlagBits::eColorAttachmentOutput;
-
-		vk::SubmitInfo submit_info {
-			sync.image_available[frame],
-			wait_stage, cmd,
-			sync.render_finished[frame]
-		};
-
-		app.graphics_queue.submit(submit_info, sync.in_flight[frame]);
+		littlevk::submit(app.graphics_queue, cmd,
+			{ { sync.image_available[frame], vk::PipelineStageFlagBits2::eColorAttachmentOutput } },
+			{ { sync.render_finished[frame], vk::PipelineStageFlagBits2::eAllCommands } },
+			sync.in_flight[frame]);
 
                 op = littlevk::present_image(app.present_queue, app.swapchain.swapchain, sync[frame], op.index);
 		if (op.status == littlevk::SurfaceOperation::eResize)
@@ -0,0 +1,597 @@
+#include <chrono>
+
+// Nothing here opens a window
+#define LITTLEVK_NO_GLFW
+#include "littlevk.hpp"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+// Timings for the CPU side of littlevk's frame helpers; runs headless, so it
+// needs neither a window nor a display. Pass section names to run a subset
+using Clock = std::chrono::steady_clock;
+
+template <typename F>
+double milliseconds(const F &function)
+{
+	auto start = Clock::now();
+	function();
+	return std::chrono::duration <double, std::milli> (Clock::now() - start).count();
+}
+
+// Stand-in for per-frame CPU work (simulation, culling, recording...)
+void busy_wait(double ms)
+{
+	auto end = Clock::now() + std::chrono::duration <double, std::milli> (ms);
+	while (Clock::now() < end);
+}
+
+struct Context {
+	littlevk::HeadlessSkeleton app;
+	littlevk::Deallocator *deallocator;
+	vk::PhysicalDeviceMemoryProperties memory_properties;
+	vk::CommandPool command_pool;
+};
+
+// Reading a frame's worth of data back, blocking on every copy versus
+// keeping several copies in flight through the readback ring
+void readback(Context &context)
+{
+	static constexpr vk::DeviceSize SIZE = 16ull << 20;
+	static constexpr uint32_t FRAMES = 64;
+	static constexpr uint32_t SLOTS = 3;
+	static constexpr double WORK = 4.0;
+
+	const auto &device = context.app.device;
+	const auto &queue = context.app.graphics_queue;
+
+	littlevk::Buffer source = littlevk::buffer(device, context.memory_properties,
+		SIZE, vk::BufferUsageFlagBits::eTransferSrc).unwrap(*context.deallocator);
+	littlevk::Buffer staging = littlevk::buffer(device, context.memory_properties,
+		SIZE, vk::BufferUsageFlagBits::eTransferDst).unwrap(*context.deallocator);
+
+	littlevk::ReadbackRing ring = littlevk::readback_ring(device, context.memory_properties,
+		context.app.graphics_family, SLOTS, SIZE).unwrap(*context.deallocator);
+
+	std::vector <uint8_t> data(SIZE);
+
+	double blocking = milliseconds([&]() {
+		for (uint32_t i = 0; i < FRAMES; i++) {
+			littlevk::submit_now(device, context.command_pool, queue,
+				[&](const vk::CommandBuffer &cmd) {
+					cmd.copyBuffer(*source, *staging, vk::BufferCopy { 0, 0, SIZE });
+				}
+			);
+
+			littlevk::download(device, staging, data.data());
+			busy_wait(WORK);
+		}
+	});
+
+	double pipelined = milliseconds([&]() {
+		std::queue <littlevk::ReadbackFuture> futures;
+		for (uint32_t i = 0; i < FRAMES; i++) {
+			futures.push(littlevk::download_async(device, queue, ring, source));
+			busy_wait(WORK);
+
+			// Retrieve the oldest download before its slot comes around again
+			if (futures.size() == SLOTS - 1) {
+				futures.front().get(data.data());
+				futures.pop();
+			}
+		}
+
+		for (; !futures.empty(); futures.pop())
+			futures.front().get(data.data());
+	});
+
+	printf("readback: %u frames of %llu MiB with %.1f ms of CPU work each\n",
+		FRAMES, (unsigned long long) (SIZE >> 20), WORK);
+	printf("    blocking   %8.3f ms/frame\n", blocking/FRAMES);
+	printf("    pipelined  %8.3f ms/frame (%u slots)\n", pipelined/FRAMES, SLOTS);
+}
+
+// Rendering into the headless skeleton's offscreen chain, resolving every
+// frame right after presenting versus letting the downloads trail behind
+void headless(Context &context)
+{
+	static constexpr uint32_t FRAMES = 120;
+
+	const auto &device = context.app.device;
+	const auto &queue = context.app.graphics_queue;
+	auto &chain = context.app.swapchain;
+
+	auto sync = littlevk::present_syncronization(device, 2).unwrap(*context.deallocator);
+	auto cmds = device.allocateCommandBuffers({
+		context.command_pool, vk::CommandBufferLevel::ePrimary, 2
+	});
+
+	uint64_t received = 0;
+	chain.sink = [&](const littlevk::OffscreenFrame &) { received++; };
+
+	auto render = [&](bool blocking) {
+		for (uint32_t frame = 0; frame < FRAMES; frame++) {
+			uint32_t slot = frame % 2;
+
+			littlevk::SurfaceOperation op;
+			op = littlevk::acquire_image(device, queue, chain, sync[slot]);
+
+			const littlevk::Image &image = chain.images[op.index];
+			const auto &cmd = cmds[slot];
+
+			cmd.begin(vk::CommandBufferBeginInfo {});
+			littlevk::transition(cmd, image, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal);
+			cmd.clearColorImage(*image, vk::ImageLayout::eTransferDstOptimal,
+				vk::ClearColorValue { std::array <float, 4> { frame/float(FRAMES), 0, 0, 1 } },
+				vk::ImageSubresourceRange { vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1 });
+			littlevk::transition(cmd, image, vk::ImageLayout::eTransferDstOptimal, chain.layout);
+			cmd.end();
+
+			littlevk::submit(queue, cmd,
+				{ { sync.image_available[slot], vk::PipelineStageFlagBits2::eTransfer } },
+				{ { sync.render_finished[slot], vk::PipelineStageFlagBits2::eAllCommands } },
+				sync.in_flight[slot]);
+
+			littlevk::present_image(queue, chain, sync[slot], op.index);
+			if (blocking)
+				chain.flush();
+		}
+
+		chain.flush();
+		device.waitIdle();
+	};
+
+	double blocking = milliseconds([&]() { render(true); });
+	double pipelined = milliseconds([&]() { render(false); });
+
+	printf("headless: %u frames of %ux%u, %llu received\n",
+		FRAMES, chain.extent.width, chain.extent.height,
+		(unsigned long long) received);
+	printf("    blocking   %8.3f ms/frame\n", blocking/FRAMES);
+	printf("    pipelined  %8.3f ms/frame (%zu images)\n", pipelined/FRAMES, chain.images.size());
+
+	chain.sink = {};
+}
+
+// Recording layout transitions for a set of textures; per-image barriers
+// with masks looked up at runtime, resolved at compile time, and batched
+// into a single barrier per step
+void transitions(Context &context)
+{
+	static constexpr uint32_t IMAGES = 64;
+	static constexpr uint32_t ITERATIONS = 1000;
+
+	using Layout = vk::ImageLayout;
+
+	const auto &device = context.app.device;
+
+	std::vector <littlevk::Image> images;
+	for (uint32_t i = 0; i < IMAGES; i++) {
+		littlevk::ImageCreateInfo info {
+			{ 64, 64 }, vk::Format::eR8G8B8A8Unorm,
+			vk::ImageUsageFlagBits::eSampled
+				| vk::ImageUsageFlagBits::eTransferDst,
+			vk::ImageAspectFlagBits::eColor
+		};
+
+		images.push_back(littlevk::image(device, info, context.memory_properties)
+			.unwrap(*context.deallocator));
+	}
+
+	vk::CommandBuffer cmd = device.allocateCommandBuffers({
+		context.command_pool, vk::CommandBufferLevel::ePrimary, 1
+	}).front();
+
+	auto record = [&](const auto &function) {
+		return milliseconds([&]() {
+			for (uint32_t i = 0; i < ITERATIONS; i++) {
+				cmd.begin(vk::CommandBufferBeginInfo {});
+				function();
+				cmd.end();
+			}
+		}) / ITERATIONS;
+	};
+
+	double runtime = record([&]() {
+		for (const auto &image : images)
+			littlevk::transition(cmd, image, Layout::eUndefined, Layout::eTransferDstOptimal);
+		for (const auto &image : images)
+			littlevk::transition(cmd, image, Layout::eTransferDstOptimal, Layout::eShaderReadOnlyOptimal);
+	});
+
+	double compiled = record([&]() {
+		for (const auto &image : images)
+			littlevk::transition <Layout::eUndefined, Layout::eTransferDstOptimal> (cmd, image);
+		for (const auto &image : images)
+			littlevk::transition <Layout::eTransferDstOptimal, Layout::eShaderReadOnlyOptimal> (cmd, image);
+	});
+
+	littlevk::TransitionBatch batch;
+	double batched = record([&]() {
+		for (const auto &image : images)
+			batch.add <Layout::eUndefined, Layout::eTransferDstOptimal> (image);
+		batch.record(cmd);
+
+		for (const auto &image : images)
+			batch.add <Layout::eTransferDstOptimal, Layout::eShaderReadOnlyOptimal> (image);
+		batch.record(cmd);
+	});
+
+	device.freeCommandBuffers(context.command_pool, cmd);
+
+	printf("transitions: %u images, two transitions each, recording only\n", IMAGES);
+	printf("    runtime    %8.3f ms/iteration\n", runtime);
+	printf("    compiled   %8.3f ms/iteration\n", compiled);
+	printf("    batched    %8.3f ms/iteration\n", batched);
+}
+
+// Recording a long draw list into secondary command buffers, on the calling
+// thread alone versus spread over every hardware thread
+const std::string draw_vertex_shader = R"(
+#version 450
+
+layout (push_constant) uniform PushConstants {
+	vec4 offset;
+};
+
+void main()
+{
+	vec2 corner = vec2(gl_VertexIndex & 1, gl_VertexIndex >> 1);
+	gl_Position = vec4(offset.xy + 0.01 * corner, 0.0, 1.0);
+}
+)";
+
+const std::string draw_fragment_shader = R"(
+#version 450
+
+layout (location = 0) out vec4 color;
+
+void main()
+{
+	color = vec4(1.0);
+}
+)";
+
+void recording(Context &context)
+{
+	static constexpr uint32_t DRAWS = 20000;
+	static constexpr uint32_t ITERATIONS = 50;
+
+	const auto &device = context.app.device;
+	const auto &chain = context.app.swapchain;
+	auto &deallocator = *context.deallocator;
+
+	vk::RenderPass render_pass = littlevk::RenderPassAssembler(device, deallocator)
+		.add_attachment(littlevk::default_color_attachment(chain.format))
+		.add_subpass(vk::PipelineBindPoint::eGraphics)
+			.color_attachment(0, vk::ImageLayout::eColorAttachmentOptimal)
+			.done();
+
+	vk::Framebuffer framebuffer = littlevk::framebuffer(device, render_pass, chain.images[0])
+		.unwrap(deallocator);
+
+	auto bundle = littlevk::ShaderStageBundle(device, deallocator)
+		.source(draw_vertex_shader, vk::ShaderStageFlagBits::eVertex)
+		.source(draw_fragment_shader, vk::ShaderStageFlagBits::eFragment);
+
+	littlevk::Window window { nullptr, "timing", chain.extent };
+	littlevk::Pipeline ppl = littlevk::PipelineAssembler <littlevk::eGraphics> (device, window, deallocator)
+		.with_render_pass(render_pass, 0)
+		.with_shader_bundle(bundle)
+		.with_push_constant <std::array <float, 4>> (vk::ShaderStageFlagBits::eVertex);
+
+	littlevk::DrawRange draw = [&](const vk::CommandBuffer &cmd, uint32_t begin, uint32_t end) {
+		cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, ppl.handle);
+		for (uint32_t i = begin; i < end; i++) {
+			std::array <float, 4> offset { (i % 200) * 0.01f - 1.0f, (i / 200) * 0.02f - 1.0f, 0, 0 };
+			cmd.pushConstants <std::array <float, 4>> (ppl.layout, vk::ShaderStageFlagBits::eVertex, 0, offset);
+			cmd.draw(4, 1, 0, 0);
+		}
+	};
+
+	auto inheritance = littlevk::SecondaryInheritance::from_render_pass(render_pass, 0, framebuffer)
+		.with_viewport(chain.extent);
+
+	vk::CommandBuffer cmd = device.allocateCommandBuffers({
+		context.command_pool, vk::CommandBufferLevel::ePrimary, 1
+	}).front();
+
+	auto time = [&](uint32_t threads) {
+		littlevk::ParallelRecorder recorder;
+		recorder.start(device, context.app.graphics_family, threads, 1);
+
+		double ms = milliseconds([&]() {
+			for (uint32_t i = 0; i < ITERATIONS; i++) {
+				cmd.begin(vk::CommandBufferBeginInfo {});
+
+				littlevk::RenderPassBeginInfo(1)
+					.with_render_pass(render_pass)
+					.with_framebuffer(framebuffer)
+					.with_extent(chain.extent)
+					.clear_color(0, std::array <float, 4> { 0, 0, 0, 1 })
+					.begin(cmd, vk::SubpassContents::eSecondaryCommandBuffers);
+
+				recorder.record(cmd, 0, inheritance, DRAWS, draw, 256);
+
+				cmd.endRenderPass();
+				cmd.end();
+			}
+		});
+
+		recorder.stop();
+		return ms / ITERATIONS;
+	};
+
+	uint32_t threads = std::max(std::thread::hardware_concurrency(), 1u);
+
+	double single = time(1);
+	double parallel = time(threads);
+
+	device.freeCommandBuffers(context.command_pool, cmd);
+
+	printf("recording: %u draws into secondaries, recording only\n", DRAWS);
+	printf("    1 thread   %8.3f ms/iteration\n", single);
+	printf("    %-2u threads %8.3f ms/iteration\n", threads, parallel);
+}
+
+// Drawing a field of meshes packed into a registry, one draw per mesh versus
+// frustum and depth pyramid culling into indirect draws; wall time per frame,
+// so it includes the GPU work
+const std::string culling_vertex_shader = R"(
+#version 450
+
+layout (location = 0) in vec3 position;
+
+layout (push_constant) uniform PushConstants {
+	mat4 viewproj;
+};
+
+void main()
+{
+	gl_Position = viewproj * vec4(position, 1.0);
+	gl_Position.y = -gl_Position.y;
+	gl_Position.z = (gl_Position.z + gl_Position.w) / 2.0;
+}
+)";
+
+void culling(Context &context)
+{
+	static constexpr uint32_t GRID = 64;
+	static constexpr uint32_t OBJECTS = GRID * GRID;
+	static constexpr uint32_t FRAMES = 100;
+	static constexpr float SPACING = 4.0f;
+	static constexpr float NEAR = 0.1f;
+	static constexpr float FAR = 200.0f;
+
+	const auto &device = context.app.device;
+	const auto &queue = context.app.graphics_queue;
+	const auto &chain = context.app.swapchain;
+	auto &deallocator = *context.deallocator;
+
+	// Each cube is placed in the registry already translated
+	static const std::array <glm::vec3, 8> corners {
+		glm::vec3 { -1, -1, -1 }, glm::vec3 { 1, -1, -1 },
+		glm::vec3 { 1, 1, -1 }, glm::vec3 { -1, 1, -1 },
+		glm::vec3 { -1, -1, 1 }, glm::vec3 { 1, -1, 1 },
+		glm::vec3 { 1, 1, 1 }, glm::vec3 { -1, 1, 1 }
+	};
+
+	static const std::vector <uint32_t> cube_indices {
+		0, 1, 2,	2, 3, 0,
+		4, 6, 5,	6, 4, 7,
+		0, 3, 7,	7, 4, 0,
+		1, 5, 6,	6, 2, 1,
+		0, 4, 5,	5, 1, 0,
+		3, 2, 6,	6, 7, 3
+	};
+
+	littlevk::MeshRegistry registry = littlevk::mesh_registry(device, context.memory_properties,
+		sizeof(glm::vec3), OBJECTS * corners.size(), OBJECTS * cube_indices.size())
+		.unwrap(deallocator);
+
+	std::vector <littlevk::MeshRegistry::Handle> handles;
+	std::vector <littlevk::IndirectObject> objects;
+	for (uint32_t i = 0; i < OBJECTS; i++) {
+		glm::vec3 center {
+			(float(i % GRID) - GRID/2.0f) * SPACING,
+			0.0f,
+			-float(i / GRID) * SPACING - 4.0f
+		};
+
+		std::vector <glm::vec3> vertices;
+		for (const glm::vec3 &corner : corners)
+			vertices.push_back(center + corner);
+
+		littlevk::MeshRegistry::Handle handle = registry.add(vertices, cube_indices);
+		handles.push_back(handle);
+		objects.push_back(registry.object(handle, { center.x, center.y, center.z, std::sqrt(3.0f) }, i));
+	}
+
+	// Depth is sampled by the pyramid after every frame
+	littlevk::Image depth = littlevk::image(device,
+		littlevk::ImageCreateInfo {
+			chain.extent,
+			vk::Format::eD32Sfloat,
+			vk::ImageUsageFlagBits::eDepthStencilAttachment
+				| vk::ImageUsageFlagBits::eSampled,
+			vk::ImageAspectFlagBits::eDepth
+		}, context.memory_properties).unwrap(deallocator);
+
+	vk::RenderPass render_pass = littlevk::RenderPassAssembler(device, deallocator)
+		.add_attachment(littlevk::default_color_attachment(chain.format))
+		.add_attachment(littlevk::default_depth_attachment()
+			.store_op(vk::AttachmentStoreOp::eStore))
+		.add_subpass(vk::PipelineBindPoint::eGraphics)
+			.color_attachment(0, vk::ImageLayout::eColorAttachmentOptimal)
+			.depth_attachment(1, vk::ImageLayout::eDepthStencilAttachmentOptimal)
+			.done();
+
+	littlevk::FramebufferGenerator generator(device, render_pass, chain.extent, deallocator);
+	generator.add(chain.images[0].view, depth.view);
+	vk::Framebuffer framebuffer = generator.unpack().front();
+
+	auto bundle = littlevk::ShaderStageBundle(device, deallocator)
+		.source(culling_vertex_shader, vk::ShaderStageFlagBits::eVertex)
+		.source(draw_fragment_shader, vk::ShaderStageFlagBits::eFragment);
+
+	littlevk::Window window { nullptr, "timing", chain.extent };
+	littlevk::Pipeline ppl = littlevk::PipelineAssembler <littlevk::eGraphics> (device, window, deallocator)
+		.with_render_pass(render_pass, 0)
+		.with_vertex_layout(littlevk::VertexLayout <littlevk::rgb32f> ())
+		.with_shader_bundle(bundle)
+		.with_push_constant <glm::mat4> (vk::ShaderStageFlagBits::eVertex)
+		.cull_mode(vk::CullModeFlagBits::eNone);
+
+	littlevk::DepthPyramid pyramid = littlevk::depth_pyramid(device,
+		context.memory_properties, deallocator, depth);
+
+	littlevk::IndirectCuller culler = littlevk::indirect_culler(device,
+		context.memory_properties, deallocator, OBJECTS, std::cref(pyramid));
+
+	culler.upload(device, objects);
+
+	// Looking down the rows from slightly above
+	glm::mat4 view = glm::lookAt(glm::vec3 { 0, 6, 0 }, glm::vec3 { 0, 0, -40 }, glm::vec3 { 0, 1, 0 });
+	glm::mat4 proj = glm::perspective(glm::radians(45.0f),
+		chain.extent.width/float(chain.extent.height), NEAR, FAR);
+	glm::mat4 viewproj = proj * view;
+
+	std::array <float, 16> vp;
+	std::memcpy(vp.data(), &viewproj[0][0], sizeof(vp));
+
+	littlevk::CullingParameters parameters {};
+	std::memcpy(parameters.view.data(), &view[0][0], sizeof(parameters.view));
+	parameters.planes = littlevk::frustum_planes(vp, false);
+
+	// The shader flips y, as does the sign of P11
+	parameters.projection = { proj[0][0], -proj[1][1], NEAR, FAR };
+
+	auto frame = [&](const vk::CommandBuffer &cmd, bool indirect) {
+		if (indirect)
+			culler.cull(cmd, parameters);
+
+		littlevk::RenderPassBeginInfo(2)
+			.with_render_pass(render_pass)
+			.with_framebuffer(framebuffer)
+			.with_extent(chain.extent)
+			.clear_color(0, std::array <float, 4> { 0, 0, 0, 1 })
+			.clear_depth(1, 1)
+			.begin(cmd);
+
+		littlevk::viewport_and_scissor(cmd, littlevk::RenderArea(chain.extent));
+
+		cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, ppl.handle);
+		cmd.pushConstants <glm::mat4> (ppl.layout, vk::ShaderStageFlagBits::eVertex, 0, viewproj);
+		registry.bind(cmd);
+
+		if (indirect) {
+			culler.draw(cmd);
+		} else {
+			for (littlevk::MeshRegistry::Handle handle : handles)
+				registry.draw(cmd, handle);
+		}
+
+		cmd.endRenderPass();
+
+		// Next frame culls against this one's depth
+		vk::ImageMemoryBarrier barrier {
+			vk::AccessFlagBits::eDepthStencilAttachmentWrite,
+			vk::AccessFlagBits::eShaderRead,
+			vk::ImageLayout::eDepthStencilAttachmentOptimal,
+			vk::ImageLayout::eShaderReadOnlyOptimal,
+			VK_QUEUE_FAMILY_IGNORED,
+			VK_QUEUE_FAMILY_IGNORED,
+			*depth,
+			{ vk::ImageAspectFlagBits::eDepth, 0, 1, 0, 1 }
+		};
+
+		cmd.pipelineBarrier(vk::PipelineStageFlagBits::eLateFragmentTests,
+			vk::PipelineStageFlagBits::eComputeShader,
+			{}, {}, {}, barrier);
+
+		pyramid.build(cmd);
+	};
+
+	auto time = [&](bool indirect) {
+		return milliseconds([&]() {
+			for (uint32_t i = 0; i < FRAMES; i++) {
+				littlevk::submit_now(device, context.command_pool, queue,
+					[&](const vk::CommandBuffer &cmd) { frame(cmd, indirect); });
+			}
+		}) / FRAMES;
+	};
+
+	// Fills the pyramid before the first cull reads it
+	time(false);
+
+	double direct = time(false);
+	double culled = time(true);
+
+	printf("culling: %u meshes from one registry, %ux%u\n",
+		OBJECTS, chain.extent.width, chain.extent.height);
+	printf("    direct     %8.3f ms/frame\n", direct);
+	printf("    culled     %8.3f ms/frame", culled);
+
+	if (culler.compact) {
+		std::vector <uint32_t> visible(1);
+		littlevk::download(device, culler.count, visible);
+		printf(" (%u visible)", visible[0]);
+	}
+
+	printf("\n");
+}
+
+int main(int argc, char *argv[])
+{
+	const std::map <std::string, void (*)(Context &)> sections {
+		{ "readback", readback },
+		{ "headless", headless },
+		{ "transitions", transitions },
+		{ "recording", recording },
+		{ "culling", culling },
+	};
+
+	std::vector <std::string> selected(argv + 1, argv + argc);
+	if (selected.empty()) {
+		for (const auto &[name, _] : sections)
+			selected.push_back(name);
+	}
+
+	littlevk::config().headless = true;
+
+	vk::PhysicalDevice phdev = littlevk::pick_physical_device(
+		[](const vk::PhysicalDevice &dev) {
+			return littlevk::physical_device_able(dev, {});
+		}
+	);
+
+	Context context;
+	context.app.skeletonize(phdev, { 1920, 1080 }, {});
+	context.memory_properties = phdev.getMemoryProperties();
+
+	littlevk::Deallocator deallocator { context.app.device };
+	context.deallocator = &deallocator;
+
+	context.command_pool = littlevk::command_pool(context.app.device,
+		vk::CommandPoolCreateInfo {
+			vk::CommandPoolCreateFlagBits::eResetCommandBuffer,
+			context.app.graphics_family
+		}
+	).unwrap(deallocator);
+
+	for (const std::string &name : selected) {
+		auto it = sections.find(name);
+		if (it == sections.end()) {
+			microlog::error("timing", "Unknown section %s\n", name.c_str());
+			continue;
+		}
+
+		it->second(context);
+	}
+
+	context.app.device.waitIdle();
+	deallocator.drop();
+	context.app.drop();
+
+	return 0;
+}
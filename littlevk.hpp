@@ -2,32 +2,65 @@
 
 // Standard library
 #include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <condition_variable>
+#include <cstddef>
 #include <filesystem>
 #include <fstream>
 #include <functional>
 #include <iostream>
 #include <limits>
+#include <list>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <numeric>
 #include <optional>
 #include <queue>
 #include <set>
+#include <thread>
+#include <type_traits>
 
 // Miscellaneous standard library
 #include <stdarg.h>
 
-// Vulkan and GLFW
+// File change notifications, for reloading shaders, and signal masks for
+// writing into pipes
+#ifdef __linux__
+#include <poll.h>
+#include <signal.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+// Vulkan and GLFW; defining LITTLEVK_NO_GLFW drops the window and surface
+// helpers (and the dependency on GLFW) for headless-only builds
 #include <vulkan/vulkan.hpp>
 #include <vulkan/vulkan_core.h>
 #include <vulkan/vulkan_enums.hpp>
 #include <vulkan/vulkan_handles.hpp>
 #include <vulkan/vulkan_structs.hpp>
+
+#ifndef LITTLEVK_NO_GLFW
 #include <GLFW/glfw3.h>
+#else
+struct GLFWwindow;
+#endif
 
 // Glslang and SPIRV-Tools
 #include <glslang/Public/ResourceLimits.h>
 #include <glslang/Public/ShaderLang.h>
 #include <glslang/SPIRV/GlslangToSpv.h>
 
+// Define ENABLE_OPT (and link SPIRV-Tools-opt) to optimize and validate
+// the compiled SPIR-V
+#if defined(ENABLE_OPT) && ENABLE_OPT
+#include <spirv-tools/libspirv.hpp>
+#include <spirv-tools/optimizer.hpp>
+#endif
+
 namespace littlevk {
 
 namespace detail {
@@ -38,6 +71,12 @@ struct Config {
 	bool enable_validation_layers = true;
 	bool abort_on_validation_error = true;
 	bool enable_logging = true;
+
+	// Skip GLFW and surface extensions entirely (offscreen rendering only)
+	bool headless = false;
+
+	// Enable synchronization2 on new devices when supported
+	bool enable_synchronization2 = true;
 };
 
 } // namespace detail
@@ -159,6 +198,9 @@ inline const std::string readfile(const std::filesystem::path &path)
 struct DirectoryIncluder : public glslang::TShader::Includer {
 	std::vector<std::string> directories;
 
+	// Every file successfully included, e.g. to watch for changes
+	std::set<std::string> included;
+
 	DirectoryIncluder() = default;
 
 	IncludeResult *includeLocal(const char *header,
@@ -196,6 +238,7 @@ struct DirectoryIncluder : public glslang::TShader::Includer {
 				char *content = new char[length];
 				file.seekg(0, file.beg);
 				file.read(content, length);
+				included.insert(path);
 				return new IncludeResult(path, content, length,
 							 content);
 			}
@@ -362,6 +405,7 @@ namespace detail {
 // Initialize GLFW statically
 inline void initialize_glfw()
 {
+#ifndef LITTLEVK_NO_GLFW
 	static bool initialized = false;
 
 	if (!initialized) {
@@ -369,6 +413,7 @@ inline void initialize_glfw()
 		glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
 		initialized = true;
 	}
+#endif
 }
 
 // Get (or generate) the required extensions
@@ -379,14 +424,18 @@ inline const std::vector <const char *> &get_required_extensions()
 
 	// Add if empty
 	if (extensions.empty()) {
-		// Add glfw extensions
-		uint32_t glfw_extension_count;
-		const char **glfw_extensions = glfwGetRequiredInstanceExtensions( &glfw_extension_count);
-		extensions.insert(extensions.end(), glfw_extensions,
-				  glfw_extensions + glfw_extension_count);
-
-		// Additional extensions
-		extensions.push_back(VK_KHR_SURFACE_EXTENSION_NAME);
+#ifndef LITTLEVK_NO_GLFW
+		if (!config().headless) {
+			// Add glfw extensions
+			uint32_t glfw_extension_count;
+			const char **glfw_extensions = glfwGetRequiredInstanceExtensions( &glfw_extension_count);
+			extensions.insert(extensions.end(), glfw_extensions,
+					  glfw_extensions + glfw_extension_count);
+
+			// Additional extensions
+			extensions.push_back(VK_KHR_SURFACE_EXTENSION_NAME);
+		}
+#endif
 		// TODO: add config extensions
 
 		if (config().enable_validation_layers) {
@@ -440,7 +489,8 @@ inline const vk::Instance &get_vulkan_instance()
 		return global_instance.instance;
 
 	// Make sure GLFW is initialized
-	initialize_glfw();
+	if (!config().headless)
+		initialize_glfw();
 
 	static const std::vector<const char *> validation_layers = {
 		"VK_LAYER_KHRONOS_validation"};
@@ -592,12 +642,16 @@ struct Window {
 	vk::Extent2D extent;
 
 	void drop() {
+#ifndef LITTLEVK_NO_GLFW
 		if (handle)
 			glfwDestroyWindow(handle);
+#endif
 		handle = nullptr;
 	}
 };
 
+#ifndef LITTLEVK_NO_GLFW
+
 // Creating windows and surfaces
 inline Window make_window(const vk::Extent2D &extent, const std::string &title)
 {
@@ -631,6 +685,8 @@ inline vk::SurfaceKHR make_surface(const Window &window)
 	return static_cast <vk::SurfaceKHR> (surface);
 }
 
+#endif
+
 // Coupling graphics and present queue families
 struct QueueFamilyIndices {
 	uint32_t graphics;
@@ -1212,6 +1268,95 @@ struct RenderPassBeginInfo {
 	}
 };
 
+namespace detail {
+
+inline bool dynamic_rendering();
+
+} // namespace detail
+
+// Wrapper for dynamic rendering; attachments are image views, so nothing
+// needs rebuilding when they are resized. Layouts are not transitioned
+struct RenderingInfo {
+	vk::Extent2D extent;
+	vk::RenderingFlags flags;
+	std::vector <vk::RenderingAttachmentInfo> colors;
+	std::optional <vk::RenderingAttachmentInfo> depth;
+
+	RenderingInfo &with_extent(vk::Extent2D extent_) {
+		extent = extent_;
+		return *this;
+	}
+
+	RenderingInfo &with_flags(vk::RenderingFlags flags_) {
+		flags = flags_;
+		return *this;
+	}
+
+	RenderingInfo &with_color(const vk::ImageView &view,
+				  vk::AttachmentLoadOp load = vk::AttachmentLoadOp::eClear,
+				  vk::AttachmentStoreOp store = vk::AttachmentStoreOp::eStore,
+				  vk::ImageLayout layout = vk::ImageLayout::eColorAttachmentOptimal) {
+		vk::RenderingAttachmentInfo attachment;
+		attachment.imageView = view;
+		attachment.imageLayout = layout;
+		attachment.loadOp = load;
+		attachment.storeOp = store;
+		colors.push_back(attachment);
+		return *this;
+	}
+
+	RenderingInfo &with_depth(const vk::ImageView &view,
+				  vk::AttachmentLoadOp load = vk::AttachmentLoadOp::eClear,
+				  vk::AttachmentStoreOp store = vk::AttachmentStoreOp::eDontCare,
+				  vk::ImageLayout layout = vk::ImageLayout::eDepthStencilAttachmentOptimal) {
+		vk::RenderingAttachmentInfo attachment;
+		attachment.imageView = view;
+		attachment.imageLayout = layout;
+		attachment.loadOp = load;
+		attachment.storeOp = store;
+		depth = attachment;
+		return *this;
+	}
+
+	template <typename... Args>
+	requires std::is_constructible_v <vk::ClearColorValue, Args...>
+	RenderingInfo &clear_color(size_t index, const Args &...args) {
+		colors[index].clearValue = vk::ClearColorValue(args...);
+		return *this;
+	}
+
+	template <typename... Args>
+	requires std::is_constructible_v <vk::ClearDepthStencilValue, Args...>
+	RenderingInfo &clear_depth(const Args &...args) {
+		depth->clearValue = vk::ClearDepthStencilValue(args...);
+		return *this;
+	}
+
+	RenderingInfo &begin(const vk::CommandBuffer &cmd) {
+		if (!detail::dynamic_rendering()) {
+			microlog::error("RenderingInfo::begin", "Dynamic rendering is not enabled on the device\n");
+			return *this;
+		}
+
+		vk::RenderingInfo info {
+			flags,
+			vk::Rect2D { { 0, 0 }, extent },
+			1, 0,
+			colors,
+			depth ? &depth.value() : nullptr,
+			nullptr
+		};
+
+		cmd.beginRendering(info);
+		return *this;
+	}
+
+	RenderingInfo &end(const vk::CommandBuffer &cmd) {
+		cmd.endRendering();
+		return *this;
+	}
+};
+
 // Configuring viewport and scissor
 struct RenderArea {
 	vk::Extent2D extent;
@@ -1421,6 +1566,181 @@ inline vk::PhysicalDevice pick_physical_device(
 	return nullptr;
 }
 
+// Optional features littlevk makes use of, as enabled on a device
+struct DeviceCapabilities {
+	bool synchronization2 = false;
+	bool dynamic_rendering = false;
+	bool draw_indirect_count = false;
+	bool multi_draw_indirect = false;
+	bool draw_indirect_first_instance = false;
+};
+
+namespace detail {
+
+// Capabilities of every device created through littlevk
+struct CapabilityRegistry {
+	std::mutex lock;
+	std::map <vk::Device, DeviceCapabilities> devices;
+
+	// Whether all of them have synchronization2 (or dynamic rendering) enabled
+	std::atomic <bool> synchronization2 = false;
+	std::atomic <bool> dynamic_rendering = false;
+
+	void update() {
+		bool all_synchronization2 = !devices.empty();
+		bool all_dynamic_rendering = !devices.empty();
+		for (const auto &[_, capabilities] : devices) {
+			all_synchronization2 = all_synchronization2 && capabilities.synchronization2;
+			all_dynamic_rendering = all_dynamic_rendering && capabilities.dynamic_rendering;
+		}
+
+		synchronization2 = all_synchronization2;
+		dynamic_rendering = all_dynamic_rendering;
+	}
+};
+
+inline CapabilityRegistry &capability_registry()
+{
+	static CapabilityRegistry singleton;
+	return singleton;
+}
+
+inline void register_device(const vk::Device &device, const DeviceCapabilities &capabilities)
+{
+	CapabilityRegistry &registry = capability_registry();
+	std::lock_guard <std::mutex> guard(registry.lock);
+	registry.devices[device] = capabilities;
+	registry.update();
+}
+
+// Drop a device from the registry, before destroying it
+inline void forget_device(const vk::Device &device)
+{
+	CapabilityRegistry &registry = capability_registry();
+	std::lock_guard <std::mutex> guard(registry.lock);
+	registry.devices.erase(device);
+	registry.update();
+}
+
+// Whether barriers and submissions go through synchronization2; command
+// buffers and queues do not know their device, so this only holds when every
+// registered device has the feature (the legacy path is valid on all of them)
+inline bool synchronization2()
+{
+	return capability_registry().synchronization2;
+}
+
+// Same for recording with dynamic rendering
+inline bool dynamic_rendering()
+{
+	return capability_registry().dynamic_rendering;
+}
+
+// Vulkan 1.2 features of a device (all off below 1.2)
+inline vk::PhysicalDeviceVulkan12Features vulkan12_features(const vk::PhysicalDevice &phdev)
+{
+	if (phdev.getProperties().apiVersion < VK_API_VERSION_1_2)
+		return {};
+
+	auto chain = phdev.getFeatures2 <vk::PhysicalDeviceFeatures2,
+					 vk::PhysicalDeviceVulkan12Features> ();
+
+	vk::PhysicalDeviceVulkan12Features features = chain.get <vk::PhysicalDeviceVulkan12Features> ();
+	features.pNext = nullptr;
+	return features;
+}
+
+// Vulkan 1.3 features of a device (all off below 1.3)
+inline vk::PhysicalDeviceVulkan13Features vulkan13_features(const vk::PhysicalDevice &phdev)
+{
+	if (phdev.getProperties().apiVersion < VK_API_VERSION_1_3)
+		return {};
+
+	auto chain = phdev.getFeatures2 <vk::PhysicalDeviceFeatures2,
+					 vk::PhysicalDeviceVulkan13Features> ();
+
+	vk::PhysicalDeviceVulkan13Features features = chain.get <vk::PhysicalDeviceVulkan13Features> ();
+	features.pNext = nullptr;
+	return features;
+}
+
+// Look for synchronization2 in a user provided feature chain; barriers and
+// submissions use the core entry points, so the extension structure only
+// counts on Vulkan 1.3 devices
+inline bool synchronization2_requested(const vk::PhysicalDeviceFeatures2KHR &features, bool core)
+{
+	auto next = (const vk::BaseInStructure *) features.pNext;
+	while (next) {
+		if (next->sType == vk::StructureType::ePhysicalDeviceVulkan13Features) {
+			auto f = (const vk::PhysicalDeviceVulkan13Features *) next;
+			if (f->synchronization2)
+				return true;
+		} else if (core && next->sType == vk::StructureType::ePhysicalDeviceSynchronization2Features) {
+			auto f = (const vk::PhysicalDeviceSynchronization2Features *) next;
+			if (f->synchronization2)
+				return true;
+		}
+
+		next = next->pNext;
+	}
+
+	return false;
+}
+
+// Look for dynamic rendering in a user provided feature chain; as with
+// synchronization2, the extension structure only counts on 1.3 devices
+inline bool dynamic_rendering_requested(const vk::PhysicalDeviceFeatures2KHR &features, bool core)
+{
+	auto next = (const vk::BaseInStructure *) features.pNext;
+	while (next) {
+		if (next->sType == vk::StructureType::ePhysicalDeviceVulkan13Features) {
+			auto f = (const vk::PhysicalDeviceVulkan13Features *) next;
+			if (f->dynamicRendering)
+				return true;
+		} else if (core && next->sType == vk::StructureType::ePhysicalDeviceDynamicRenderingFeatures) {
+			auto f = (const vk::PhysicalDeviceDynamicRenderingFeatures *) next;
+			if (f->dynamicRendering)
+				return true;
+		}
+
+		next = next->pNext;
+	}
+
+	return false;
+}
+
+// Look for indirect count draws in a user provided feature chain
+inline bool draw_indirect_count_requested(const vk::PhysicalDeviceFeatures2KHR &features)
+{
+	auto next = (const vk::BaseInStructure *) features.pNext;
+	while (next) {
+		if (next->sType == vk::StructureType::ePhysicalDeviceVulkan12Features) {
+			auto f = (const vk::PhysicalDeviceVulkan12Features *) next;
+			if (f->drawIndirectCount)
+				return true;
+		}
+
+		next = next->pNext;
+	}
+
+	return false;
+}
+
+} // namespace detail
+
+// Capabilities a device was created with (all off for unknown devices)
+inline DeviceCapabilities capabilities(const vk::Device &device)
+{
+	detail::CapabilityRegistry &registry = detail::capability_registry();
+	std::lock_guard <std::mutex> guard(registry.lock);
+
+	auto it = registry.devices.find(device);
+	if (it == registry.devices.end())
+		return {};
+
+	return it->second;
+}
+
 // Create logical device on an arbitrary queue
 inline vk::Device device(const vk::PhysicalDevice &phdev,
 		         const uint32_t queue_family,
@@ -1443,19 +1763,70 @@ inline vk::Device device(const vk::PhysicalDevice &phdev,
 	device_features.geometryShader = true;
 
 	vk::PhysicalDeviceFeatures2KHR secondary_features;
+	vk::PhysicalDeviceVulkan12Features vulkan12_features;
+	vk::PhysicalDeviceVulkan13Features vulkan13_features;
 
 	// TODO: use the C++ initializer
 	vk::DeviceCreateInfo device_info {
 		vk::DeviceCreateFlags(), queue_info, {}, extensions,
 		&device_features,	 nullptr};
 
+	// Core entry points of Vulkan 1.3 are only there on 1.3 devices
+	bool core13 = phdev.getProperties().apiVersion >= VK_API_VERSION_1_3;
+
+	DeviceCapabilities capabilities;
 	if (features) {
 		secondary_features = *features;
 		device_info.pNext = &secondary_features;
 		device_info.pEnabledFeatures = nullptr;
+
+		capabilities.synchronization2 = config().enable_synchronization2
+			&& detail::synchronization2_requested(*features, core13);
+		capabilities.dynamic_rendering = detail::dynamic_rendering_requested(*features, core13);
+		capabilities.draw_indirect_count = detail::draw_indirect_count_requested(*features);
+		capabilities.multi_draw_indirect = features->features.multiDrawIndirect;
+		capabilities.draw_indirect_first_instance = features->features.drawIndirectFirstInstance;
+	} else {
+		// Opt into synchronization2, dynamic rendering and
+		// indirect draws with counts when available
+		vk::PhysicalDeviceVulkan13Features supported = detail::vulkan13_features(phdev);
+		vulkan13_features.synchronization2 = config().enable_synchronization2
+			&& supported.synchronization2;
+		vulkan13_features.dynamicRendering = supported.dynamicRendering;
+
+		vulkan12_features.drawIndirectCount = detail::vulkan12_features(phdev).drawIndirectCount;
+		vk::PhysicalDeviceFeatures supported_features = phdev.getFeatures();
+		device_features.multiDrawIndirect = supported_features.multiDrawIndirect;
+		device_features.drawIndirectFirstInstance = supported_features.drawIndirectFirstInstance;
+
+		void *chain = nullptr;
+		if (vulkan13_features.synchronization2 || vulkan13_features.dynamicRendering) {
+			vulkan13_features.pNext = chain;
+			chain = &vulkan13_features;
+		}
+
+		if (vulkan12_features.drawIndirectCount) {
+			vulkan12_features.pNext = chain;
+			chain = &vulkan12_features;
+		}
+
+		if (chain) {
+			secondary_features.features = device_features;
+			secondary_features.pNext = chain;
+			device_info.pNext = &secondary_features;
+			device_info.pEnabledFeatures = nullptr;
+		}
+
+		capabilities.synchronization2 = vulkan13_features.synchronization2;
+		capabilities.dynamic_rendering = vulkan13_features.dynamicRendering;
+		capabilities.draw_indirect_count = vulkan12_features.drawIndirectCount;
+		capabilities.multi_draw_indirect = device_features.multiDrawIndirect;
+		capabilities.draw_indirect_first_instance = device_features.drawIndirectFirstInstance;
 	}
 
-	return phdev.createDevice(device_info);
+	vk::Device device = phdev.createDevice(device_info);
+	detail::register_device(device, capabilities);
+	return device;
 }
 
 // Create a logical device
@@ -1469,6 +1840,8 @@ inline vk::Device device(const vk::PhysicalDevice &phdev,
 	return device(phdev, indices.graphics, count, extensions, features);
 }
 
+#ifndef LITTLEVK_NO_GLFW
+
 // Imperative initialization approach
 [[gnu::always_inline]] inline std::tuple<vk::SurfaceKHR, Window>
 surface_handles(const vk::Extent2D &extent, const std::string &title)
@@ -1530,6 +1903,7 @@ inline bool Skeleton::drop()
 	device.waitIdle();
 	destroy_swapchain(device, swapchain);
 	detail::get_vulkan_instance().destroySurfaceKHR(surface);
+	detail::forget_device(device);
 	device.destroy();
 	return true;
 }
@@ -1574,6 +1948,8 @@ inline float Skeleton::aspect_ratio() const
 	return (float) window.extent.width / (float) window.extent.height;
 }
 
+#endif
+
 // Get memory file decriptor
 inline int find_memory_fd(const vk::Device &device,
 			  const vk::DeviceMemory &memory)
@@ -1801,11 +2177,19 @@ struct Image {
 	vk::MemoryRequirements requirements;
 	vk::Extent2D extent;
 	vk::ImageLayout layout;
+	vk::Format format;
+	vk::ImageAspectFlags aspect;
+	uint32_t mip_levels;
+	uint32_t array_layers;
 
 	Image() : image(VK_NULL_HANDLE),
 		  view(VK_NULL_HANDLE),
 		  memory(VK_NULL_HANDLE),
-		  extent(0, 0) {}
+		  extent(0, 0),
+		  layout(vk::ImageLayout::eUndefined),
+		  format(vk::Format::eUndefined),
+		  mip_levels(1),
+		  array_layers(1) {}
 
 	vk::Image operator*() const {
 		return image;
@@ -1842,6 +2226,8 @@ struct ImageCreateInfo {
 	vk::ImageType type;
 	vk::ImageViewType view;
 	bool external;
+	uint32_t mip_levels;
+	uint32_t array_layers;
 
 	constexpr ImageCreateInfo(uint32_t width_,
 				  uint32_t height_,
@@ -1849,32 +2235,221 @@ struct ImageCreateInfo {
 				  vk::ImageUsageFlags usage_, vk::ImageAspectFlags aspect_,
 				  vk::ImageType type_ = vk::ImageType::e2D,
 				  vk::ImageViewType view_ = vk::ImageViewType::e2D,
-				  bool external_ = false)
+				  bool external_ = false,
+				  uint32_t mip_levels_ = 1,
+				  uint32_t array_layers_ = 1)
 	    : width(width_), height(height_), format(format_), usage(usage_),
-	      aspect(aspect_), type(type_), view(view_), external(external_) {}
+	      aspect(aspect_), type(type_), view(view_), external(external_),
+	      mip_levels(mip_levels_), array_layers(array_layers_) {}
 
 	constexpr ImageCreateInfo(vk::Extent2D extent,
 				  vk::Format format_,
 				  vk::ImageUsageFlags usage_, vk::ImageAspectFlags aspect_,
 				  vk::ImageType type_ = vk::ImageType::e2D,
 				  vk::ImageViewType view_ = vk::ImageViewType::e2D,
-				  bool external_ = false)
+				  bool external_ = false,
+				  uint32_t mip_levels_ = 1,
+				  uint32_t array_layers_ = 1)
 	    : width(extent.width), height(extent.height), format(format_),
 	      usage(usage_), aspect(aspect_), type(type_), view(view_),
-	      external(external_) {}
+	      external(external_), mip_levels(mip_levels_),
+	      array_layers(array_layers_) {}
+};
+
+// Number of levels in a complete mip chain for an extent
+constexpr uint32_t mip_level_count(const vk::Extent2D &extent)
+{
+	uint32_t levels = 1;
+	for (uint32_t size = std::max(extent.width, extent.height); size > 1; size >>= 1)
+		levels++;
+
+	return levels;
+}
+
+// Texel block dimensions and size (in bytes) of a format
+struct FormatBlock {
+	uint32_t width;
+	uint32_t height;
+	uint32_t size;
+
+	constexpr bool compressed() const {
+		return width > 1 || height > 1;
+	}
+
+	// Bytes occupied by a tightly packed extent
+	constexpr vk::DeviceSize bytes(const vk::Extent2D &extent) const {
+		vk::DeviceSize columns = (extent.width + width - 1)/width;
+		vk::DeviceSize rows = (extent.height + height - 1)/height;
+		return columns * rows * size;
+	}
 };
 
+constexpr FormatBlock format_block(const vk::Format &format)
+{
+	switch (format) {
+	// 8-bit per texel
+	case vk::Format::eR8Unorm:
+	case vk::Format::eR8Snorm:
+	case vk::Format::eR8Uint:
+	case vk::Format::eR8Sint:
+	case vk::Format::eR8Srgb:
+	case vk::Format::eS8Uint:
+		return { 1, 1, 1 };
+
+	// 16-bit per texel
+	case vk::Format::eR8G8Unorm:
+	case vk::Format::eR8G8Snorm:
+	case vk::Format::eR8G8Uint:
+	case vk::Format::eR8G8Sint:
+	case vk::Format::eR8G8Srgb:
+	case vk::Format::eR16Unorm:
+	case vk::Format::eR16Snorm:
+	case vk::Format::eR16Uint:
+	case vk::Format::eR16Sint:
+	case vk::Format::eR16Sfloat:
+	case vk::Format::eD16Unorm:
+		return { 1, 1, 2 };
+
+	// 32-bit per texel
+	case vk::Format::eR8G8B8A8Unorm:
+	case vk::Format::eR8G8B8A8Snorm:
+	case vk::Format::eR8G8B8A8Uint:
+	case vk::Format::eR8G8B8A8Sint:
+	case vk::Format::eR8G8B8A8Srgb:
+	case vk::Format::eB8G8R8A8Unorm:
+	case vk::Format::eB8G8R8A8Srgb:
+	case vk::Format::eA2B10G10R10UnormPack32:
+	case vk::Format::eA2B10G10R10SnormPack32:
+	case vk::Format::eB10G11R11UfloatPack32:
+	case vk::Format::eE5B9G9R9UfloatPack32:
+	case vk::Format::eR16G16Unorm:
+	case vk::Format::eR16G16Snorm:
+	case vk::Format::eR16G16Sfloat:
+	case vk::Format::eR32Uint:
+	case vk::Format::eR32Sint:
+	case vk::Format::eR32Sfloat:
+	case vk::Format::eD32Sfloat:
+	case vk::Format::eD24UnormS8Uint:
+	case vk::Format::eX8D24UnormPack32:
+		return { 1, 1, 4 };
+
+	// 64-bit per texel
+	case vk::Format::eR16G16B16A16Unorm:
+	case vk::Format::eR16G16B16A16Snorm:
+	case vk::Format::eR16G16B16A16Sfloat:
+	case vk::Format::eR32G32Uint:
+	case vk::Format::eR32G32Sint:
+	case vk::Format::eR32G32Sfloat:
+		return { 1, 1, 8 };
+
+	case vk::Format::eR32G32B32Sfloat:
+		return { 1, 1, 12 };
+
+	case vk::Format::eR32G32B32A32Uint:
+	case vk::Format::eR32G32B32A32Sint:
+	case vk::Format::eR32G32B32A32Sfloat:
+		return { 1, 1, 16 };
+
+	// 64-bit blocks
+	case vk::Format::eBc1RgbUnormBlock:
+	case vk::Format::eBc1RgbSrgbBlock:
+	case vk::Format::eBc1RgbaUnormBlock:
+	case vk::Format::eBc1RgbaSrgbBlock:
+	case vk::Format::eBc4UnormBlock:
+	case vk::Format::eBc4SnormBlock:
+	case vk::Format::eEtc2R8G8B8UnormBlock:
+	case vk::Format::eEtc2R8G8B8SrgbBlock:
+	case vk::Format::eEtc2R8G8B8A1UnormBlock:
+	case vk::Format::eEtc2R8G8B8A1SrgbBlock:
+	case vk::Format::eEacR11UnormBlock:
+	case vk::Format::eEacR11SnormBlock:
+		return { 4, 4, 8 };
+
+	// 128-bit blocks
+	case vk::Format::eBc2UnormBlock:
+	case vk::Format::eBc2SrgbBlock:
+	case vk::Format::eBc3UnormBlock:
+	case vk::Format::eBc3SrgbBlock:
+	case vk::Format::eBc5UnormBlock:
+	case vk::Format::eBc5SnormBlock:
+	case vk::Format::eBc6HUfloatBlock:
+	case vk::Format::eBc6HSfloatBlock:
+	case vk::Format::eBc7UnormBlock:
+	case vk::Format::eBc7SrgbBlock:
+	case vk::Format::eEtc2R8G8B8A8UnormBlock:
+	case vk::Format::eEtc2R8G8B8A8SrgbBlock:
+	case vk::Format::eEacR11G11UnormBlock:
+	case vk::Format::eEacR11G11SnormBlock:
+	case vk::Format::eAstc4x4UnormBlock:
+	case vk::Format::eAstc4x4SrgbBlock:
+		return { 4, 4, 16 };
+
+	// ASTC blocks are always 128-bit
+	case vk::Format::eAstc5x4UnormBlock:
+	case vk::Format::eAstc5x4SrgbBlock:
+		return { 5, 4, 16 };
+	case vk::Format::eAstc5x5UnormBlock:
+	case vk::Format::eAstc5x5SrgbBlock:
+		return { 5, 5, 16 };
+	case vk::Format::eAstc6x5UnormBlock:
+	case vk::Format::eAstc6x5SrgbBlock:
+		return { 6, 5, 16 };
+	case vk::Format::eAstc6x6UnormBlock:
+	case vk::Format::eAstc6x6SrgbBlock:
+		return { 6, 6, 16 };
+	case vk::Format::eAstc8x5UnormBlock:
+	case vk::Format::eAstc8x5SrgbBlock:
+		return { 8, 5, 16 };
+	case vk::Format::eAstc8x6UnormBlock:
+	case vk::Format::eAstc8x6SrgbBlock:
+		return { 8, 6, 16 };
+	case vk::Format::eAstc8x8UnormBlock:
+	case vk::Format::eAstc8x8SrgbBlock:
+		return { 8, 8, 16 };
+	case vk::Format::eAstc10x5UnormBlock:
+	case vk::Format::eAstc10x5SrgbBlock:
+		return { 10, 5, 16 };
+	case vk::Format::eAstc10x6UnormBlock:
+	case vk::Format::eAstc10x6SrgbBlock:
+		return { 10, 6, 16 };
+	case vk::Format::eAstc10x8UnormBlock:
+	case vk::Format::eAstc10x8SrgbBlock:
+		return { 10, 8, 16 };
+	case vk::Format::eAstc10x10UnormBlock:
+	case vk::Format::eAstc10x10SrgbBlock:
+		return { 10, 10, 16 };
+	case vk::Format::eAstc12x10UnormBlock:
+	case vk::Format::eAstc12x10SrgbBlock:
+		return { 12, 10, 16 };
+	case vk::Format::eAstc12x12UnormBlock:
+	case vk::Format::eAstc12x12SrgbBlock:
+		return { 12, 12, 16 };
+
+	default:
+		break;
+	}
+
+	// Unknown or unsupported
+	return { 1, 1, 0 };
+}
+
 inline ImageReturnProxy image(const vk::Device &device,
 			      const ImageCreateInfo &info,
 			      const vk::PhysicalDeviceMemoryProperties &properties)
 {
 	Image image;
 
+	// Cube views require cube compatible images
+	vk::ImageCreateFlags flags;
+	if (info.view == vk::ImageViewType::eCube
+			|| info.view == vk::ImageViewType::eCubeArray)
+		flags |= vk::ImageCreateFlagBits::eCubeCompatible;
+
 	vk::ImageCreateInfo image_info {
-		{},
+		flags,
 		info.type, info.format,
 		vk::Extent3D { info.width, info.height, 1 },
-		1, 1,
+		info.mip_levels, info.array_layers,
 		vk::SampleCountFlagBits::e1,
 		vk::ImageTiling::eOptimal,
 		info.usage,
@@ -1918,1638 +2493,7397 @@ inline ImageReturnProxy image(const vk::Device &device,
 			vk::ComponentSwizzle::eIdentity
 		},
 		vk::ImageSubresourceRange {
-			info.aspect, 0, 1, 0, 1
+			info.aspect,
+			0, info.mip_levels,
+			0, info.array_layers
 		}
 	};
 
 	image.view = device.createImageView(view_info);
 	image.extent = vk::Extent2D { info.width, info.height };
 	image.layout = vk::ImageLayout::eUndefined;
+	image.format = info.format;
+	image.aspect = info.aspect;
+	image.mip_levels = info.mip_levels;
+	image.array_layers = info.array_layers;
 
 	return image;
 }
 
-// TODO: pure template version that skips switch statements
-template <typename ImageType>
-inline void transition(const vk::CommandBuffer &cmd,
-		       const ImageType &image,
-		       const vk::ImageLayout old_layout,
-		       const vk::ImageLayout new_layout)
+namespace detail {
+
+// Conversions between synchronization2 and legacy masks; stages and
+// accesses introduced with synchronization2 fold into their legacy parents
+constexpr vk::PipelineStageFlags legacy_stages(const vk::PipelineStageFlags2 &stages,
+					       const vk::PipelineStageFlags &none)
 {
-	static_assert(std::is_same_v <ImageType, Image>
-			|| std::is_same_v <ImageType, vk::Image>,
-			"littlevk::transition: ImageType must be either "
-			"littlevk::Image or vk::Image");
+	using S2 = vk::PipelineStageFlagBits2;
+
+	VkPipelineStageFlags2 bits = VkPipelineStageFlags2(stages);
+
+	if (stages & (S2::eCopy | S2::eResolve | S2::eBlit | S2::eClear))
+		bits |= VK_PIPELINE_STAGE_TRANSFER_BIT;
+
+	if (stages & (S2::eIndexInput | S2::eVertexAttributeInput))
+		bits |= VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
+
+	if (stages & S2::ePreRasterizationShaders) {
+		bits |= VK_PIPELINE_STAGE_VERTEX_SHADER_BIT
+			| VK_PIPELINE_STAGE_TESSELLATION_CONTROL_SHADER_BIT
+			| VK_PIPELINE_STAGE_TESSELLATION_EVALUATION_SHADER_BIT
+			| VK_PIPELINE_STAGE_GEOMETRY_SHADER_BIT;
+	}
+
+	bits &= 0xFFFFFFFFull;
+	if (!bits)
+		return none;
+
+	return vk::PipelineStageFlags(VkPipelineStageFlags(bits));
+}
+
+constexpr vk::AccessFlags legacy_access(const vk::AccessFlags2 &access)
+{
+	using A2 = vk::AccessFlagBits2;
+
+	VkAccessFlags2 bits = VkAccessFlags2(access);
+
+	if (access & (A2::eShaderSampledRead | A2::eShaderStorageRead))
+		bits |= VK_ACCESS_SHADER_READ_BIT;
+
+	if (access & A2::eShaderStorageWrite)
+		bits |= VK_ACCESS_SHADER_WRITE_BIT;
+
+	return vk::AccessFlags(VkAccessFlags(bits & 0xFFFFFFFFull));
+}
+
+// Legacy bits keep their values (and meaning) in synchronization2
+constexpr vk::PipelineStageFlags2 stages2(const vk::PipelineStageFlags &stages)
+{
+	return vk::PipelineStageFlags2(VkPipelineStageFlags2(VkPipelineStageFlags(stages)));
+}
+
+constexpr vk::AccessFlags2 access2(const vk::AccessFlags &access)
+{
+	return vk::AccessFlags2(VkAccessFlags2(VkAccessFlags(access)));
+}
+
+// Records barriers with vkCmdPipelineBarrier2 when synchronization2 is
+// enabled, falling back to a single legacy vkCmdPipelineBarrier otherwise
+inline void pipeline_barrier(const vk::CommandBuffer &cmd,
+			     const vk::ArrayProxy <const vk::ImageMemoryBarrier2> &images,
+			     const vk::ArrayProxy <const vk::BufferMemoryBarrier2> &buffers = {},
+			     const vk::ArrayProxy <const vk::MemoryBarrier2> &memory = {})
+{
+	if (synchronization2()) {
+		vk::DependencyInfo dependency_info {};
+		dependency_info.memoryBarrierCount = memory.size();
+		dependency_info.pMemoryBarriers = memory.data();
+		dependency_info.bufferMemoryBarrierCount = buffers.size();
+		dependency_info.pBufferMemoryBarriers = buffers.data();
+		dependency_info.imageMemoryBarrierCount = images.size();
+		dependency_info.pImageMemoryBarriers = images.data();
+
+		cmd.pipelineBarrier2(dependency_info);
+		return;
+	}
+
+	vk::PipelineStageFlags2 src_stage;
+	vk::PipelineStageFlags2 dst_stage;
+
+	std::vector <vk::ImageMemoryBarrier> image_barriers;
+	for (const auto &b : images) {
+		src_stage |= b.srcStageMask;
+		dst_stage |= b.dstStageMask;
+
+		image_barriers.push_back(vk::ImageMemoryBarrier {
+			legacy_access(b.srcAccessMask), legacy_access(b.dstAccessMask),
+			b.oldLayout, b.newLayout,
+			b.srcQueueFamilyIndex, b.dstQueueFamilyIndex,
+			b.image, b.subresourceRange
+		});
+	}
+
+	std::vector <vk::BufferMemoryBarrier> buffer_barriers;
+	for (const auto &b : buffers) {
+		src_stage |= b.srcStageMask;
+		dst_stage |= b.dstStageMask;
+
+		buffer_barriers.push_back(vk::BufferMemoryBarrier {
+			legacy_access(b.srcAccessMask), legacy_access(b.dstAccessMask),
+			b.srcQueueFamilyIndex, b.dstQueueFamilyIndex,
+			b.buffer, b.offset, b.size
+		});
+	}
+
+	std::vector <vk::MemoryBarrier> memory_barriers;
+	for (const auto &b : memory) {
+		src_stage |= b.srcStageMask;
+		dst_stage |= b.dstStageMask;
+
+		memory_barriers.push_back(vk::MemoryBarrier {
+			legacy_access(b.srcAccessMask), legacy_access(b.dstAccessMask)
+		});
+	}
+
+	cmd.pipelineBarrier(legacy_stages(src_stage, vk::PipelineStageFlagBits::eTopOfPipe),
+			    legacy_stages(dst_stage, vk::PipelineStageFlagBits::eBottomOfPipe),
+			    {}, memory_barriers, buffer_barriers, image_barriers);
+}
 
-	// Source stage
-	vk::AccessFlags src_access_mask = {};
+inline void pipeline_barrier(const vk::CommandBuffer &cmd, const vk::MemoryBarrier2 &memory)
+{
+	pipeline_barrier(cmd, {}, {}, memory);
+}
+
+// Access mask and pipeline stage on either side of a layout transition
+struct LayoutSync {
+	bool valid;
+	vk::AccessFlags access;
+	vk::PipelineStageFlags stage;
+};
 
-	switch (old_layout) {
+// Source side, i.e. what must finish before leaving the layout
+constexpr LayoutSync src_layout_sync(const vk::ImageLayout layout)
+{
+	switch (layout) {
 	case vk::ImageLayout::eColorAttachmentOptimal:
-		src_access_mask = vk::AccessFlagBits::eColorAttachmentWrite;
-		break;
+		return { true, vk::AccessFlagBits::eColorAttachmentWrite,
+			vk::PipelineStageFlagBits::eColorAttachmentOutput };
 	case vk::ImageLayout::ePresentSrcKHR:
-		src_access_mask = vk::AccessFlagBits::eMemoryRead;
-		break;
+		return { true, vk::AccessFlagBits::eMemoryRead,
+			vk::PipelineStageFlagBits::eBottomOfPipe };
 	case vk::ImageLayout::eTransferDstOptimal:
-		src_access_mask = vk::AccessFlagBits::eTransferWrite;
-		break;
+		return { true, vk::AccessFlagBits::eTransferWrite,
+			vk::PipelineStageFlagBits::eTransfer };
 	case vk::ImageLayout::eTransferSrcOptimal:
-		src_access_mask = vk::AccessFlagBits::eTransferRead;
-		break;
+		return { true, vk::AccessFlagBits::eTransferRead,
+			vk::PipelineStageFlagBits::eTransfer };
 	case vk::ImageLayout::ePreinitialized:
-		src_access_mask = vk::AccessFlagBits::eHostWrite;
-		break;
+		return { true, vk::AccessFlagBits::eHostWrite,
+			vk::PipelineStageFlagBits::eHost };
 	case vk::ImageLayout::eGeneral:
+		return { true, {}, vk::PipelineStageFlagBits::eHost };
 	case vk::ImageLayout::eUndefined:
-		break;
+		return { true, {}, vk::PipelineStageFlagBits::eTopOfPipe };
 	case vk::ImageLayout::eShaderReadOnlyOptimal:
-		src_access_mask = vk::AccessFlagBits::eShaderRead;
-		break;
+		return { true, vk::AccessFlagBits::eShaderRead,
+			vk::PipelineStageFlagBits::eFragmentShader };
 	default:
-		microlog::error("transition layout",
-				"Unsupported old layout %s",
-				vk::to_string(old_layout).c_str());
 		break;
 	}
 
-	// Pipeline stage
-	vk::PipelineStageFlags source_stage;
-	switch (old_layout) {
-	case vk::ImageLayout::eGeneral:
-	case vk::ImageLayout::ePreinitialized:
-		source_stage = vk::PipelineStageFlagBits::eHost;
-		break;
-	case vk::ImageLayout::eColorAttachmentOptimal:
-		source_stage =
-			vk::PipelineStageFlagBits::eColorAttachmentOutput;
-		break;
-	case vk::ImageLayout::ePresentSrcKHR:
-		source_stage = vk::PipelineStageFlagBits::eBottomOfPipe;
-		break;
-	case vk::ImageLayout::eTransferDstOptimal:
-	case vk::ImageLayout::eTransferSrcOptimal:
-		source_stage = vk::PipelineStageFlagBits::eTransfer;
-		break;
-	case vk::ImageLayout::eUndefined:
-		source_stage = vk::PipelineStageFlagBits::eTopOfPipe;
-		break;
-	case vk::ImageLayout::eShaderReadOnlyOptimal:
-		source_stage = vk::PipelineStageFlagBits::eFragmentShader;
-		break;
-	default:
-		microlog::error("transition layout",
-				"Unsupported old layout %s",
-				vk::to_string(old_layout).c_str());
-		break;
-	}
+	return { false, {}, {} };
+}
 
-	// Destination stage
-	vk::AccessFlags dst_access_mask = {};
-	switch (new_layout) {
+// Destination side, i.e. what must wait for the new layout
+constexpr LayoutSync dst_layout_sync(const vk::ImageLayout layout)
+{
+	switch (layout) {
 	case vk::ImageLayout::eColorAttachmentOptimal:
-		dst_access_mask = vk::AccessFlagBits::eColorAttachmentWrite;
-		break;
+		return { true, vk::AccessFlagBits::eColorAttachmentWrite,
+			vk::PipelineStageFlagBits::eColorAttachmentOutput };
 	case vk::ImageLayout::eDepthStencilAttachmentOptimal:
-		dst_access_mask =
-			vk::AccessFlagBits::eDepthStencilAttachmentRead |
-			vk::AccessFlagBits::eDepthStencilAttachmentWrite;
-		break;
+		return { true, vk::AccessFlagBits::eDepthStencilAttachmentRead
+				| vk::AccessFlagBits::eDepthStencilAttachmentWrite,
+			vk::PipelineStageFlagBits::eEarlyFragmentTests };
 	case vk::ImageLayout::eGeneral:
+		return { true, {}, vk::PipelineStageFlagBits::eHost };
 	case vk::ImageLayout::ePresentSrcKHR:
-		break;
+		return { true, {}, vk::PipelineStageFlagBits::eBottomOfPipe };
 	case vk::ImageLayout::eShaderReadOnlyOptimal:
-		dst_access_mask = vk::AccessFlagBits::eShaderRead;
-		break;
+		return { true, vk::AccessFlagBits::eShaderRead,
+			vk::PipelineStageFlagBits::eFragmentShader };
 	case vk::ImageLayout::eTransferSrcOptimal:
-		dst_access_mask = vk::AccessFlagBits::eTransferRead;
-		break;
+		return { true, vk::AccessFlagBits::eTransferRead,
+			vk::PipelineStageFlagBits::eTransfer };
 	case vk::ImageLayout::eTransferDstOptimal:
-		dst_access_mask = vk::AccessFlagBits::eTransferWrite;
-		break;
+		return { true, vk::AccessFlagBits::eTransferWrite,
+			vk::PipelineStageFlagBits::eTransfer };
 	default:
-		microlog::error("transition layout",
-				"Unsupported new layout %s",
-				vk::to_string(new_layout).c_str());
 		break;
 	}
 
-	// Destination stage
-	vk::PipelineStageFlags destination_stage;
-	switch (new_layout) {
-	case vk::ImageLayout::eColorAttachmentOptimal:
-		destination_stage =
-			vk::PipelineStageFlagBits::eColorAttachmentOutput;
-		break;
+	return { false, {}, {} };
+}
+
+// Guessed from the layout alone; prefer the aspect of the image if known
+constexpr vk::ImageAspectFlags layout_aspect(const vk::ImageLayout layout)
+{
+	switch (layout) {
 	case vk::ImageLayout::eDepthStencilAttachmentOptimal:
-		destination_stage =
-			vk::PipelineStageFlagBits::eEarlyFragmentTests;
-		break;
-	case vk::ImageLayout::eGeneral:
-		destination_stage = vk::PipelineStageFlagBits::eHost;
-		break;
-	case vk::ImageLayout::ePresentSrcKHR:
-		destination_stage = vk::PipelineStageFlagBits::eBottomOfPipe;
-		break;
-	case vk::ImageLayout::eShaderReadOnlyOptimal:
-		destination_stage = vk::PipelineStageFlagBits::eFragmentShader;
-		break;
-	case vk::ImageLayout::eTransferDstOptimal:
-	case vk::ImageLayout::eTransferSrcOptimal:
-		destination_stage = vk::PipelineStageFlagBits::eTransfer;
-		break;
+	case vk::ImageLayout::eDepthStencilReadOnlyOptimal:
+	case vk::ImageLayout::eDepthAttachmentOptimal:
+	case vk::ImageLayout::eDepthReadOnlyOptimal:
+		return vk::ImageAspectFlagBits::eDepth;
 	default:
-		microlog::error("transition layout",
-				"Unsupported new layout %s",
-				vk::to_string(new_layout).c_str());
 		break;
 	}
 
-	// Aspect mask
-	vk::ImageAspectFlags aspect_mask;
-	if (new_layout == vk::ImageLayout::eDepthStencilAttachmentOptimal)
-		aspect_mask = vk::ImageAspectFlagBits::eDepth;
-	else
-		aspect_mask = vk::ImageAspectFlagBits::eColor;
-
-	// Create the barrier
-	vk::ImageSubresourceRange image_subresource_range {
-		aspect_mask,
-		0, 1, 0, 1
-	};
-
-	vk::Image target_image;
-	if constexpr (std::is_same_v<ImageType, littlevk::Image>)
-		target_image = *image;
-	else
-		target_image = image;
+	return vk::ImageAspectFlagBits::eColor;
+}
 
-	vk::ImageMemoryBarrier barrier {
-		src_access_mask,
-		dst_access_mask,
-		old_layout,
-		new_layout,
+// Barrier covering every mip level and array layer
+constexpr vk::ImageMemoryBarrier2 layout_barrier(const vk::Image &image,
+						 const LayoutSync &src,
+						 const LayoutSync &dst,
+						 const vk::ImageLayout old_layout,
+						 const vk::ImageLayout new_layout)
+{
+	return vk::ImageMemoryBarrier2 {
+		stages2(src.stage), access2(src.access),
+		stages2(dst.stage), access2(dst.access),
+		old_layout, new_layout,
 		VK_QUEUE_FAMILY_IGNORED,
 		VK_QUEUE_FAMILY_IGNORED,
-		target_image,
-		image_subresource_range
+		image,
+		vk::ImageSubresourceRange {
+			layout_aspect(new_layout),
+			0, VK_REMAINING_MIP_LEVELS,
+			0, VK_REMAINING_ARRAY_LAYERS
+		}
 	};
-
-	// Add the barrier
-	return cmd.pipelineBarrier(source_stage, destination_stage, {}, {}, {}, barrier);
 }
 
-// Same for the methods
-inline void Image::transition(const vk::CommandBuffer &cmd, const vk::ImageLayout &layout_)
+template <typename ImageType>
+inline vk::Image image_handle(const ImageType &image)
 {
-	littlevk::transition(cmd, *this, layout, layout_);
-	layout = layout_;
+	static_assert(std::is_same_v <ImageType, Image>
+			|| std::is_same_v <ImageType, vk::Image>,
+			"littlevk::transition: ImageType must be either "
+			"littlevk::Image or vk::Image");
+
+	if constexpr (std::is_same_v <ImageType, Image>)
+		return *image;
+	else
+		return image;
 }
 
-// Copying buffer to image
-inline void copy_buffer_to_image(const vk::CommandBuffer &cmd,
-				 const vk::Image &image,
-				 const Buffer &buffer,
-				 const vk::Extent2D &extent,
-				 const vk::ImageLayout &layout)
+// Aspect for barriers on the image; raw handles fall back to the layout
+template <typename ImageType>
+inline vk::ImageAspectFlags image_aspect(const ImageType &image, const vk::ImageLayout layout)
 {
-	// TODO: ensure same sizes...,
-	// TODO: pass format as well...
-	vk::BufferImageCopy region {
-		0, 0, 0,
-		vk::ImageSubresourceLayers {
-			vk::ImageAspectFlagBits::eColor,
-			0, 0, 1
-		},
-		vk::Offset3D { 0, 0, 0 },
-		vk::Extent3D { extent.width, extent.height, 1 }
-	};
+	if constexpr (std::is_same_v <ImageType, Image>) {
+		if (image.aspect)
+			return image.aspect;
+	}
 
-	cmd.copyBufferToImage(*buffer, image, layout, region);
+	return layout_aspect(layout);
 }
 
-inline void copy_buffer_to_image(const vk::CommandBuffer &cmd,
-				 const Image &image,
-				 const Buffer &buffer,
-				 const vk::ImageLayout &layout)
-{
-	// TODO: ensure same sizes...,
-	vk::BufferImageCopy region {
-		0, 0, 0,
-		vk::ImageSubresourceLayers {
-			vk::ImageAspectFlagBits::eColor,
-			0, 0, 1
-		},
-		vk::Offset3D { 0, 0, 0 },
-		vk::Extent3D { image.extent.width, image.extent.height, 1 }
-	};
+// Masks and stages of a transition, resolved at compile time
+template <vk::ImageLayout Old, vk::ImageLayout New>
+struct LayoutTransition {
+	static constexpr LayoutSync src = src_layout_sync(Old);
+	static constexpr LayoutSync dst = dst_layout_sync(New);
 
-	cmd.copyBufferToImage(*buffer, *image, layout, region);
-}
+	static_assert(src.valid, "littlevk::transition: unsupported old layout");
+	static_assert(dst.valid, "littlevk::transition: unsupported new layout");
+};
 
-// Copying image to buffer
-inline void copy_image_to_buffer(const vk::CommandBuffer &cmd,
-				 const vk::Image &image,
-				 const Buffer &buffer,
-				 const vk::Extent2D &extent,
-				 const vk::ImageLayout &layout)
+} // namespace detail
+
+template <typename ImageType>
+inline void transition(const vk::CommandBuffer &cmd,
+		       const ImageType &image,
+		       const vk::ImageLayout old_layout,
+		       const vk::ImageLayout new_layout)
 {
-	vk::BufferImageCopy region {
-		0, 0, 0,
-		vk::ImageSubresourceLayers {
-			vk::ImageAspectFlagBits::eColor,
-			0, 0, 1
-		},
-		vk::Offset3D { 0, 0, 0 },
-		vk::Extent3D { extent.width, extent.height, 1 }
-	};
+	detail::LayoutSync src = detail::src_layout_sync(old_layout);
+	if (!src.valid) {
+		microlog::error("transition layout",
+				"Unsupported old layout %s",
+				vk::to_string(old_layout).c_str());
+	}
 
-	cmd.copyImageToBuffer(image, layout, *buffer, region);
-}
+	detail::LayoutSync dst = detail::dst_layout_sync(new_layout);
+	if (!dst.valid) {
+		microlog::error("transition layout",
+				"Unsupported new layout %s",
+				vk::to_string(new_layout).c_str());
+	}
 
-inline void copy_image_to_buffer(const vk::CommandBuffer &cmd,
-				 const Image &image,
-				 const Buffer &buffer,
-				 const vk::ImageLayout &layout)
-{
-	vk::BufferImageCopy region {
-		0,
-		0,
-		0,
-		vk::ImageSubresourceLayers {
-			vk::ImageAspectFlagBits::eColor,
-			0, 0, 1
-		},
-		vk::Offset3D { 0, 0, 0 },
-		vk::Extent3D { image.extent.width, image.extent.height, 1 }
-	};
+	vk::ImageMemoryBarrier2 barrier = detail::layout_barrier(detail::image_handle(image),
+		src, dst, old_layout, new_layout);
 
-	cmd.copyImageToBuffer(*image, layout, *buffer, region);
+	barrier.subresourceRange.aspectMask = detail::image_aspect(image, new_layout);
+
+	// Add the barrier
+	detail::pipeline_barrier(cmd, barrier);
 }
 
-// Binding resources to descriptor sets
-inline void bind_descriptor_set(const vk::Device &device,
-		                const vk::DescriptorSet &dset,
-				const Image &img,
-				const vk::Sampler &sampler)
+// Transition with every mask and stage known at compile time; unsupported
+// layouts fail to compile instead of logging an error
+template <vk::ImageLayout Old, vk::ImageLayout New, typename ImageType>
+inline void transition(const vk::CommandBuffer &cmd, const ImageType &image)
 {
-	vk::DescriptorImageInfo image_info {
-		sampler, img.view,
-		vk::ImageLayout::eShaderReadOnlyOptimal
-	};
+	using T = detail::LayoutTransition <Old, New>;
 
-	vk::WriteDescriptorSet write {
-		dset, 0, 0, 1,
-		vk::DescriptorType::eCombinedImageSampler,
-		&image_info
-	};
+	constexpr vk::ImageMemoryBarrier2 barrier = detail::layout_barrier(nullptr,
+		T::src, T::dst, Old, New);
 
-	device.updateDescriptorSets({write}, {});
+	vk::ImageMemoryBarrier2 target = barrier;
+	target.image = detail::image_handle(image);
+	target.subresourceRange.aspectMask = detail::image_aspect(image, New);
+
+	detail::pipeline_barrier(cmd, target);
 }
 
-inline void bind_descriptor_set(const vk::Device &device,
-		                const vk::DescriptorSet &dset,
-				const Buffer &buffer,
-				uint32_t binding)
-{
-	vk::DescriptorBufferInfo buffer_info {
-		*buffer, 0, vk::WholeSize
-	};
+// Several transitions recorded with a single barrier command
+struct TransitionBatch {
+	std::vector <vk::ImageMemoryBarrier2> barriers;
 
-	vk::WriteDescriptorSet write {
-		dset, binding,
-		0, 1, vk::DescriptorType::eStorageBuffer,
-		{}, &buffer_info
-	};
+	template <vk::ImageLayout Old, vk::ImageLayout New, typename ImageType>
+	TransitionBatch &add(const ImageType &image) {
+		using T = detail::LayoutTransition <Old, New>;
 
-	device.updateDescriptorSets({write}, {});
-}
+		barriers.push_back(detail::layout_barrier(detail::image_handle(image),
+			T::src, T::dst, Old, New));
 
-// Construct framebuffer from image
-inline FramebufferReturnProxy framebuffer(const vk::Device &device,
-					  const vk::RenderPass &rp,
-					  const littlevk::Image &image)
-{
-	std::array <vk::ImageView, 1> attachments = {image.view};
+		barriers.back().subresourceRange.aspectMask = detail::image_aspect(image, New);
 
-	vk::FramebufferCreateInfo framebuffer_info {
-		{}, rp,
-		(uint32_t) attachments.size(), attachments.data(),
-		image.extent.width, image.extent.height, 1
-	};
+		return *this;
+	}
 
-	return device.createFramebuffer(framebuffer_info);
-}
+	template <typename ImageType>
+	TransitionBatch &add(const ImageType &image,
+			     const vk::ImageLayout old_layout,
+			     const vk::ImageLayout new_layout) {
+		detail::LayoutSync src = detail::src_layout_sync(old_layout);
+		detail::LayoutSync dst = detail::dst_layout_sync(new_layout);
 
-// Single-time command buffer submission
-inline void submit_now(const vk::Device &device,
-		       const vk::CommandPool &pool,
-		       const vk::Queue &queue,
-		       const std::function <void (const vk::CommandBuffer &)> &function)
-{
-	vk::CommandBuffer cmd = device
-		.allocateCommandBuffers(vk::CommandBufferAllocateInfo {
-			pool, vk::CommandBufferLevel::ePrimary, 1
-		}).front();
+		if (!src.valid || !dst.valid) {
+			microlog::error("TransitionBatch::add",
+					"Unsupported transition %s -> %s\n",
+					vk::to_string(old_layout).c_str(),
+					vk::to_string(new_layout).c_str());
+			return *this;
+		}
 
-	cmd.begin({ vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
-		function(cmd);
-	cmd.end();
+		barriers.push_back(detail::layout_barrier(detail::image_handle(image),
+			src, dst, old_layout, new_layout));
 
-	vk::SubmitInfo submit_info {
-		0, nullptr, nullptr,
-		1, &cmd, 0, nullptr
-	};
+		barriers.back().subresourceRange.aspectMask = detail::image_aspect(image, new_layout);
 
-	// TODO: check
-	(void) queue.submit(1, &submit_info, nullptr);
-	queue.waitIdle();
+		return *this;
+	}
 
-	device.freeCommandBuffers(pool, 1, &cmd);
-}
+	void record(const vk::CommandBuffer &cmd) {
+		if (barriers.empty())
+			return;
 
-// Other companion functions with automatic memory management
-static void destroy_command_pool(const vk::Device &device,
-				 const vk::CommandPool &pool)
+		detail::pipeline_barrier(cmd, barriers);
+		barriers.clear();
+	}
+};
+
+// Same for the methods
+inline void Image::transition(const vk::CommandBuffer &cmd, const vk::ImageLayout &layout_)
 {
-	device.destroyCommandPool(pool);
+	littlevk::transition(cmd, *this, layout, layout_);
+	layout = layout_;
 }
 
-using CommandPoolReturnProxy = DeviceReturnProxy <vk::CommandPool, destroy_command_pool>;
+// Intended use of a resource, as tracked for barriers
+struct ResourceUsage {
+	vk::ImageLayout layout;
+	vk::PipelineStageFlags2 stage;
+	vk::AccessFlags2 access;
+};
 
-inline CommandPoolReturnProxy command_pool(const vk::Device &device,
-		                           const vk::CommandPoolCreateInfo &info)
-{
-	vk::CommandPool pool;
-	if (device.createCommandPool(&info, nullptr, &pool) != vk::Result::eSuccess)
-		return true;
+// Common usages
+namespace usage {
 
-	return std::move(pool);
-}
+constexpr ResourceUsage color_attachment {
+	vk::ImageLayout::eColorAttachmentOptimal,
+	vk::PipelineStageFlagBits2::eColorAttachmentOutput,
+	vk::AccessFlagBits2::eColorAttachmentRead | vk::AccessFlagBits2::eColorAttachmentWrite
+};
 
-template <typename ... Args>
-inline CommandPoolReturnProxy command_pool(const vk::Device &device, const Args &... args)
-{
-	vk::CommandPoolCreateInfo info { args... };
+constexpr ResourceUsage depth_attachment {
+	vk::ImageLayout::eDepthStencilAttachmentOptimal,
+	vk::PipelineStageFlagBits2::eEarlyFragmentTests | vk::PipelineStageFlagBits2::eLateFragmentTests,
+	vk::AccessFlagBits2::eDepthStencilAttachmentRead | vk::AccessFlagBits2::eDepthStencilAttachmentWrite
+};
 
-	vk::CommandPool pool;
-	if (device.createCommandPool(&info, nullptr, &pool) != vk::Result::eSuccess)
-		return true;
+constexpr ResourceUsage fragment_sampled {
+	vk::ImageLayout::eShaderReadOnlyOptimal,
+	vk::PipelineStageFlagBits2::eFragmentShader,
+	vk::AccessFlagBits2::eShaderSampledRead
+};
 
-	return std::move(pool);
-}
+constexpr ResourceUsage compute_sampled {
+	vk::ImageLayout::eShaderReadOnlyOptimal,
+	vk::PipelineStageFlagBits2::eComputeShader,
+	vk::AccessFlagBits2::eShaderSampledRead
+};
 
-template <typename ... Args>
-inline auto command_buffers(const vk::Device &device, const vk::CommandPool &pool, const Args &... args)
-{
-	return device.allocateCommandBuffers({ pool, args... });
-}
+constexpr ResourceUsage compute_storage {
+	vk::ImageLayout::eGeneral,
+	vk::PipelineStageFlagBits2::eComputeShader,
+	vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite
+};
 
-static void destroy_descriptor_pool(const vk::Device &device,
-				    const vk::DescriptorPool &pool)
-{
-	device.destroyDescriptorPool(pool);
-}
+constexpr ResourceUsage transfer_src {
+	vk::ImageLayout::eTransferSrcOptimal,
+	vk::PipelineStageFlagBits2::eTransfer,
+	vk::AccessFlagBits2::eTransferRead
+};
 
-using DescriptorPoolReturnProxy = DeviceReturnProxy <vk::DescriptorPool, destroy_descriptor_pool>;
+constexpr ResourceUsage transfer_dst {
+	vk::ImageLayout::eTransferDstOptimal,
+	vk::PipelineStageFlagBits2::eTransfer,
+	vk::AccessFlagBits2::eTransferWrite
+};
 
-inline DescriptorPoolReturnProxy descriptor_pool(const vk::Device &device,
-		                                 const vk::DescriptorPoolCreateInfo &info)
-{
-	vk::DescriptorPool pool;
-	if (device.createDescriptorPool(&info, nullptr, &pool) !=
-	    vk::Result::eSuccess)
-		return true;
+// Freshly acquired swapchain image, for ResourceTracker::assume; matches
+// waiting on the acquisition semaphore at color attachment output
+constexpr ResourceUsage acquired {
+	vk::ImageLayout::eUndefined,
+	vk::PipelineStageFlagBits2::eColorAttachmentOutput,
+	vk::AccessFlagBits2::eNone
+};
 
-	return std::move(pool);
-}
+// Ordering against the presentation engine comes from semaphores
+constexpr ResourceUsage present {
+	vk::ImageLayout::ePresentSrcKHR,
+	vk::PipelineStageFlagBits2::eNone,
+	vk::AccessFlagBits2::eNone
+};
 
-static void destroy_descriptor_set_layout(const vk::Device &device,
-					  const vk::DescriptorSetLayout &layout)
-{
-	device.destroyDescriptorSetLayout(layout);
-}
+} // namespace usage
 
-using DescriptorSetLayoutReturnProxy = DeviceReturnProxy<vk::DescriptorSetLayout, destroy_descriptor_set_layout>;
+namespace detail {
 
-inline DescriptorSetLayoutReturnProxy
-descriptor_set_layout(const vk::Device &device,
-		      const vk::DescriptorSetLayoutCreateInfo &info)
-{
-	vk::DescriptorSetLayout layout;
-	if (device.createDescriptorSetLayout(&info, nullptr, &layout) !=
-	    vk::Result::eSuccess)
-		return true;
+constexpr vk::AccessFlags2 write_access_mask =
+	vk::AccessFlagBits2::eShaderWrite
+	| vk::AccessFlagBits2::eShaderStorageWrite
+	| vk::AccessFlagBits2::eColorAttachmentWrite
+	| vk::AccessFlagBits2::eDepthStencilAttachmentWrite
+	| vk::AccessFlagBits2::eTransferWrite
+	| vk::AccessFlagBits2::eHostWrite
+	| vk::AccessFlagBits2::eMemoryWrite;
 
-	return std::move(layout);
-}
+} // namespace detail
 
-static void destroy_pipeline_layout(const vk::Device &device,
-				    const vk::PipelineLayout &layout)
-{
-	device.destroyPipelineLayout(layout);
-}
+// Records the last known layout, stages and accesses of images (per mip
+// level and array layer) and buffers, and turns requested usages into the
+// minimal set of barriers; flush() emits everything queued in one call.
+// Reads need no barrier once the last write is visible to their stage and
+// access; other readers in the same layout get one from the last writer
+struct ResourceTracker {
+	// Source and destination scopes of a barrier
+	struct Scopes {
+		vk::PipelineStageFlags2 src_stage;
+		vk::AccessFlags2 src_access;
+		vk::PipelineStageFlags2 dst_stage;
+		vk::AccessFlags2 dst_access;
+	};
 
-using PipelineLayoutReturnProxy =
-	DeviceReturnProxy<vk::PipelineLayout, destroy_pipeline_layout>;
+	struct State {
+		vk::ImageLayout layout = vk::ImageLayout::eUndefined;
 
-inline PipelineLayoutReturnProxy
-pipeline_layout(const vk::Device &device,
-		const vk::PipelineLayoutCreateInfo &info)
-{
-	vk::PipelineLayout layout;
-	if (device.createPipelineLayout(&info, nullptr, &layout) !=
-	    vk::Result::eSuccess)
-		return true;
+		// Last write (or layout transition), and the stages and accesses
+		// it has been made visible to since
+		vk::PipelineStageFlags2 write_stage = vk::PipelineStageFlagBits2::eNone;
+		vk::AccessFlags2 write_access = vk::AccessFlagBits2::eNone;
+		vk::PipelineStageFlags2 visible_stage = vk::PipelineStageFlagBits2::eNone;
+		vk::AccessFlags2 visible_access = vk::AccessFlagBits2::eNone;
 
-	return std::move(layout);
-}
+		// Stages reading since the last write
+		vk::PipelineStageFlags2 read_stage = vk::PipelineStageFlagBits2::eNone;
 
-static void destroy_sampler(const vk::Device &device,
-			    const vk::Sampler &sampler)
-{
-	device.destroySampler(sampler);
-}
+		// Barrier in the current batch touching this state
+		uint64_t batch = 0;
+		size_t barrier = 0;
 
-using SamplerReturnProxy = DeviceReturnProxy<vk::Sampler, destroy_sampler>;
+		// Reading without a barrier is fine if nothing was written
+		// or the write is already visible to the stage and access
+		bool covers(const vk::PipelineStageFlags2 &stage, const vk::AccessFlags2 &access) const {
+			return !write_stage || (!(stage & ~visible_stage) && !(access & ~visible_access));
+		}
 
-inline SamplerReturnProxy sampler(const vk::Device &device,
-				  const vk::SamplerCreateInfo &info)
-{
-	vk::Sampler sampler;
-	if (device.createSampler(&info, nullptr, &sampler) !=
-	    vk::Result::eSuccess)
-		return true;
+		// Scopes of the barrier ahead of a use; extra readers in the same
+		// layout wait on the last write only, and are added to the readers
+		// it is visible to so the visible set stays exact
+		Scopes scopes(const ResourceUsage &, bool, bool) const;
 
-	return std::move(sampler);
-}
+		// State after the barrier (with the given scopes) and the use
+		void advance(const ResourceUsage &, bool, bool, const Scopes &);
+	};
 
-// Default sampler builder
-struct SamplerAssembler {
-	const vk::Device &device;
-	Deallocator &dal;
+	struct ImageStates {
+		uint32_t mip_levels;
+		uint32_t array_layers;
+		std::vector <State> states;
+	};
 
-	vk::Filter mag = vk::Filter::eLinear;
-	vk::Filter min = vk::Filter::eLinear;
-	vk::SamplerMipmapMode mip = vk::SamplerMipmapMode::eLinear;
+	std::map <vk::Image, ImageStates> images;
+	std::map <vk::Buffer, State> buffers;
 
-	SamplerAssembler(const vk::Device &device, Deallocator &dal)
-		: device(device), dal(dal) {}
+	std::vector <vk::ImageMemoryBarrier2> image_barriers;
+	std::vector <vk::BufferMemoryBarrier2> buffer_barriers;
 
-	SamplerAssembler &filtering(vk::Filter mode) {
-		mag = mode;
-		min = mode;
-		return *this;
-	}
+	// Starts at one, so default states never alias a pending barrier
+	uint64_t batch = 1;
 
-	SamplerAssembler &mipping(vk::SamplerMipmapMode mode) {
-		mip = mode;
-		return *this;
-	}
+	// Queue barriers for using (part of) an image
+	void image(const Image &, const ResourceUsage &,
+		   const std::optional <vk::ImageSubresourceRange> & = std::nullopt);
 
-	operator vk::Sampler() const {
-		vk::SamplerCreateInfo info {
-			vk::SamplerCreateFlags {},
-			mag,
-			min,
-			mip,
-			vk::SamplerAddressMode::eRepeat,
-			vk::SamplerAddressMode::eRepeat,
-			vk::SamplerAddressMode::eRepeat,
-			0.0f,
-			vk::False,
-			1.0f,
-			vk::False,
-			vk::CompareOp::eAlways,
-			0.0f,
-			0.0f,
-			vk::BorderColor::eIntOpaqueBlack,
-			vk::False
-		};
+	// Queue a barrier for using a buffer
+	void buffer(const Buffer &, const vk::PipelineStageFlags2 &, const vk::AccessFlags2 &);
 
-		return sampler(device, info).unwrap(dal);
-	}
+	// Emit all queued barriers
+	void flush(const vk::CommandBuffer &);
+
+	// Hand over the queued barriers instead of recording them
+	void take(std::vector <vk::ImageMemoryBarrier2> &, std::vector <vk::BufferMemoryBarrier2> &);
+
+	// Contents are no longer needed; the next use transitions from the
+	// undefined layout, still after any earlier accesses
+	void discard(const Image &);
+
+	// Declare the current state of a whole image without a barrier
+	void assume(const Image &, const ResourceUsage &);
+
+	// Currently tracked layout of a subresource
+	vk::ImageLayout layout(const Image &, uint32_t = 0, uint32_t = 0) const;
+
+	// Stop tracking, e.g. once the resource is destroyed
+	void forget(const Image &image) { images.erase(*image); }
+	void forget(const Buffer &buffer) { buffers.erase(*buffer); }
 };
 
-// Bind pattern for all physical-logical device operations
-struct LinkedDevices {
-	const vk::PhysicalDevice &phdev;
-	const vk::Device &device;
+inline ResourceTracker::Scopes ResourceTracker::State::scopes(const ResourceUsage &usage,
+							     bool transition, bool write) const
+{
+	if (!transition && !write) {
+		return Scopes {
+			write_stage, write_access,
+			visible_stage | usage.stage,
+			visible_access | usage.access
+		};
+	}
 
-	constexpr LinkedDevices(const vk::PhysicalDevice &phdev_,
-				const vk::Device &device_)
-		: phdev(phdev_), device(device_) {}
+	// Wait for the last write and every read since
+	return Scopes {
+		write_stage | read_stage, write_access,
+		usage.stage, usage.access
+	};
+}
 
-	LinkedDevices &resize(const vk::SurfaceKHR &surface,
-			      Window &window,
-			      Swapchain &swapchain) {
-		int new_width = 0;
-		int new_height = 0;
+inline void ResourceTracker::State::advance(const ResourceUsage &usage,
+					    bool transition, bool write,
+					    const Scopes &scopes)
+{
+	layout = usage.layout;
+
+	if (write) {
+		// Not visible to anything until the next barrier
+		write_stage = usage.stage;
+		write_access = usage.access & detail::write_access_mask;
+		visible_stage = vk::PipelineStageFlagBits2::eNone;
+		visible_access = vk::AccessFlagBits2::eNone;
+		read_stage = vk::PipelineStageFlagBits2::eNone;
+	} else if (transition) {
+		// The transition completes before the reading stages start,
+		// so later barriers chain from those
+		write_stage = usage.stage;
+		write_access = vk::AccessFlagBits2::eNone;
+		visible_stage = usage.stage;
+		visible_access = usage.access;
+		read_stage = usage.stage;
+	} else {
+		visible_stage = scopes.dst_stage;
+		visible_access = scopes.dst_access;
+		read_stage |= usage.stage;
+	}
+}
 
-		int current_width = 0;
-		int current_height = 0;
+inline void ResourceTracker::image(const Image &image,
+				   const ResourceUsage &usage,
+				   const std::optional <vk::ImageSubresourceRange> &subresource)
+{
+	// Start from the layout the image claims to be in
+	auto it = images.find(*image);
+	if (it == images.end()) {
+		ImageStates entry { image.mip_levels, image.array_layers, {} };
+		entry.states.resize(image.mip_levels * image.array_layers);
+		for (State &state : entry.states)
+			state.layout = image.layout;
+
+		it = images.emplace(*image, entry).first;
+	}
+
+	ImageStates &entry = it->second;
+
+	vk::ImageAspectFlags aspect = image.aspect;
+	if (!aspect)
+		aspect = vk::ImageAspectFlagBits::eColor;
+
+	vk::ImageSubresourceRange range = subresource.value_or(vk::ImageSubresourceRange {
+		aspect, 0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS
+	});
+
+	if (range.levelCount == VK_REMAINING_MIP_LEVELS)
+		range.levelCount = entry.mip_levels - range.baseMipLevel;
+	if (range.layerCount == VK_REMAINING_ARRAY_LAYERS)
+		range.layerCount = entry.array_layers - range.baseArrayLayer;
+
+	bool write = bool(usage.access & detail::write_access_mask);
+
+	size_t first = image_barriers.size();
+	for (uint32_t mip = range.baseMipLevel; mip < range.baseMipLevel + range.levelCount; mip++) {
+		for (uint32_t layer = range.baseArrayLayer; layer < range.baseArrayLayer + range.layerCount; layer++) {
+			State &state = entry.states[mip * entry.array_layers + layer];
+
+			bool pending = (state.batch == batch);
+			bool transition = (state.layout != usage.layout);
+
+			if (!transition && !write) {
+				if (state.covers(usage.stage, usage.access)) {
+					state.read_stage |= usage.stage;
+					continue;
+				}
+
+				// A read barrier is already queued; widen its scope
+				if (pending && state.read_stage) {
+					vk::ImageMemoryBarrier2 &barrier = image_barriers[state.barrier];
+					barrier.dstStageMask |= usage.stage;
+					barrier.dstAccessMask |= usage.access;
+
+					state.advance(usage, false, false, Scopes {
+						barrier.srcStageMask, barrier.srcAccessMask,
+						barrier.dstStageMask, barrier.dstAccessMask
+					});
+					continue;
+				}
+			}
 
-		do {
-			glfwGetFramebufferSize(window.handle, &current_width, &current_height);
-			while (current_width == 0 || current_height == 0) {
-				glfwWaitEvents();
-				glfwGetFramebufferSize(window.handle,
-						       &current_width,
-						       &current_height);
+			if (pending) {
+				microlog::warning("ResourceTracker::image",
+					"Dependent uses of image %p without a flush in between\n",
+					(void *) static_cast <VkImage> (*image));
 			}
 
-			glfwGetFramebufferSize(window.handle, &new_width, &new_height);
-		} while (new_width != current_width || new_height != current_height);
+			Scopes scopes = state.scopes(usage, transition, write);
+
+			// Extend the last barrier for contiguous layers of the same state
+			bool merged = false;
+			if (image_barriers.size() > first) {
+				vk::ImageMemoryBarrier2 &last = image_barriers.back();
+				auto &r = last.subresourceRange;
+				if (last.oldLayout == state.layout
+						&& last.srcStageMask == scopes.src_stage
+						&& last.srcAccessMask == scopes.src_access
+						&& last.dstStageMask == scopes.dst_stage
+						&& last.dstAccessMask == scopes.dst_access
+						&& r.baseMipLevel == mip
+						&& r.baseArrayLayer + r.layerCount == layer) {
+					r.layerCount++;
+					merged = true;
+				}
+			}
 
-		// Resize only after stable sizes
-		vk::SurfaceCapabilitiesKHR caps = phdev.getSurfaceCapabilitiesKHR(surface);
-		new_width = std::clamp(new_width, int(caps.minImageExtent.width), int(caps.maxImageExtent.width));
-		new_height = std::clamp(new_height, int(caps.minImageExtent.height), int(caps.maxImageExtent.height));
+			if (!merged) {
+				image_barriers.push_back(vk::ImageMemoryBarrier2 {
+					scopes.src_stage, scopes.src_access,
+					scopes.dst_stage, scopes.dst_access,
+					state.layout, usage.layout,
+					VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED,
+					*image,
+					vk::ImageSubresourceRange { range.aspectMask, mip, 1, layer, 1 }
+				});
+			}
 
-		device.waitIdle();
+			state.advance(usage, transition, write, scopes);
+			state.batch = batch;
+			state.barrier = image_barriers.size() - 1;
+		}
+	}
 
-		vk::Extent2D new_extent = {uint32_t(new_width),
-					   uint32_t(new_height)};
-		littlevk::resize(device, swapchain, new_extent);
-		window.extent = new_extent;
+	// Fold identical barriers of consecutive mip levels together
+	size_t write_index = first;
+	for (size_t i = first; i < image_barriers.size(); i++) {
+		if (write_index > first) {
+			vk::ImageMemoryBarrier2 &prev = image_barriers[write_index - 1];
+			const vk::ImageMemoryBarrier2 &next = image_barriers[i];
+
+			auto &pr = prev.subresourceRange;
+			const auto &nr = next.subresourceRange;
+			if (prev.oldLayout == next.oldLayout
+					&& prev.srcStageMask == next.srcStageMask
+					&& prev.srcAccessMask == next.srcAccessMask
+					&& prev.dstStageMask == next.dstStageMask
+					&& prev.dstAccessMask == next.dstAccessMask
+					&& pr.baseArrayLayer == nr.baseArrayLayer
+					&& pr.layerCount == nr.layerCount
+					&& pr.baseMipLevel + pr.levelCount == nr.baseMipLevel) {
+				pr.levelCount += nr.levelCount;
+				continue;
+			}
+		}
 
-		return *this;
+		image_barriers[write_index++] = image_barriers[i];
 	}
 
-	// TODO: replace?
-	Swapchain swapchain(const vk::SurfaceKHR &surface, const vk::Extent2D &extent, const QueueFamilyIndices &indices) {
-		return littlevk::swapchain(phdev, device, surface, extent, indices);
-	}
+	if (write_index != image_barriers.size()) {
+		image_barriers.resize(write_index);
 
-	Swapchain swapchain(const vk::SurfaceKHR &surface, const QueueFamilyIndices &indices) {
-		vk::SurfaceCapabilitiesKHR capabilities = phdev.getSurfaceCapabilitiesKHR(surface);
-		return littlevk::swapchain(phdev, device, surface, capabilities.currentExtent, indices);
+		// Re-point the states at the folded barriers
+		for (uint32_t mip = range.baseMipLevel; mip < range.baseMipLevel + range.levelCount; mip++) {
+			for (uint32_t layer = range.baseArrayLayer; layer < range.baseArrayLayer + range.layerCount; layer++) {
+				State &state = entry.states[mip * entry.array_layers + layer];
+				if (state.batch != batch || state.barrier < first)
+					continue;
+
+				for (size_t i = first; i < image_barriers.size(); i++) {
+					const auto &r = image_barriers[i].subresourceRange;
+					if (mip >= r.baseMipLevel && mip < r.baseMipLevel + r.levelCount
+							&& layer >= r.baseArrayLayer && layer < r.baseArrayLayer + r.layerCount) {
+						state.barrier = i;
+						break;
+					}
+				}
+			}
+		}
 	}
-};
+}
 
-constexpr inline LinkedDevices bind(const vk::PhysicalDevice &phdev,
-				    const vk::Device &device)
+inline void ResourceTracker::buffer(const Buffer &buffer,
+				    const vk::PipelineStageFlags2 &stage,
+				    const vk::AccessFlags2 &access)
 {
-	return LinkedDevices(phdev, device);
-}
+	State &state = buffers[*buffer];
 
-// Bind pattern for command submission
-struct LinkedCommandQueue {
-	const vk::Device &device;
-	const vk::CommandPool &pool;
-	const vk::Queue &queue;
+	ResourceUsage usage { vk::ImageLayout::eUndefined, stage, access };
 
-	template <typename F>
-	requires std::is_invocable_r_v <void, F, vk::CommandBuffer>
-	LinkedCommandQueue &submit(const F &ftn) {
-		vk::CommandBuffer cmd = device.allocateCommandBuffers(
-			vk::CommandBufferAllocateInfo {
-				pool, vk::CommandBufferLevel::ePrimary, 1
-			}
-		).front();
+	bool write = bool(access & detail::write_access_mask);
+	bool pending = (state.batch == batch);
 
-		cmd.begin({ vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
-			ftn(cmd);
-		cmd.end();
+	if (!write) {
+		if (state.covers(stage, access)) {
+			state.read_stage |= stage;
+			return;
+		}
 
-		vk::SubmitInfo submit_info {
-			0, nullptr, nullptr,
-			1, &cmd, 0, nullptr
-		};
+		// A read barrier is already queued; widen its scope
+		if (pending && state.read_stage) {
+			vk::BufferMemoryBarrier2 &barrier = buffer_barriers[state.barrier];
+			barrier.dstStageMask |= stage;
+			barrier.dstAccessMask |= access;
 
-		// TODO: check
-		(void) queue.submit(1, &submit_info, nullptr);
+			state.advance(usage, false, false, Scopes {
+				barrier.srcStageMask, barrier.srcAccessMask,
+				barrier.dstStageMask, barrier.dstAccessMask
+			});
+			return;
+		}
+	}
 
-		return *this;
+	if (pending) {
+		microlog::warning("ResourceTracker::buffer",
+			"Dependent uses of buffer %p without a flush in between\n",
+			(void *) static_cast <VkBuffer> (*buffer));
 	}
 
-	template <typename F>
-	requires std::is_invocable_r_v <void, F, vk::CommandBuffer>
-	LinkedCommandQueue &submit_and_wait(const F &ftn) {
-		vk::CommandBuffer cmd = device.allocateCommandBuffers(
-			vk::CommandBufferAllocateInfo {
-				pool, vk::CommandBufferLevel::ePrimary, 1
-			}
-		).front();
+	Scopes scopes = state.scopes(usage, false, write);
 
-		cmd.begin({ vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
-			ftn(cmd);
-		cmd.end();
+	buffer_barriers.push_back(vk::BufferMemoryBarrier2 {
+		scopes.src_stage, scopes.src_access,
+		scopes.dst_stage, scopes.dst_access,
+		VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED,
+		*buffer, 0, VK_WHOLE_SIZE
+	});
 
-		vk::SubmitInfo submit_info {
-			0, nullptr, nullptr,
-			1, &cmd, 0, nullptr
-		};
+	state.advance(usage, false, write, scopes);
+	state.batch = batch;
+	state.barrier = buffer_barriers.size() - 1;
+}
 
-		// TODO: check
-		(void) queue.submit(1, &submit_info, nullptr);
+inline void ResourceTracker::flush(const vk::CommandBuffer &cmd)
+{
+	if (image_barriers.empty() && buffer_barriers.empty())
+		return;
 
-		device.waitIdle();
+	detail::pipeline_barrier(cmd, image_barriers, buffer_barriers);
 
-		return *this;
-	}
-};
+	image_barriers.clear();
+	buffer_barriers.clear();
+	batch++;
+}
 
-constexpr inline LinkedCommandQueue bind(const vk::Device &device,
-		                         const vk::CommandPool &pool,
-					 const vk::Queue &queue)
+inline void ResourceTracker::take(std::vector <vk::ImageMemoryBarrier2> &images_out,
+				  std::vector <vk::BufferMemoryBarrier2> &buffers_out)
 {
-	return LinkedCommandQueue(device, pool, queue);
-}
+	images_out = std::move(image_barriers);
+	buffers_out = std::move(buffer_barriers);
 
-// Bind pattern to do all allocations at once, then unpack
-template <typename... Args>
-struct LinkedDeviceAllocator : std::tuple <Args...> {
-	const vk::Device &device;
-	const vk::PhysicalDeviceMemoryProperties &properties;
-	littlevk::Deallocator &dal;
+	image_barriers.clear();
+	buffer_barriers.clear();
+	batch++;
+}
 
-	constexpr LinkedDeviceAllocator(const vk::Device &device_,
-			                const vk::PhysicalDeviceMemoryProperties &properties_,
-					littlevk::Deallocator &dal_, const Args &...args)
-		: std::tuple <Args...> (args...), device(device_), properties(properties_), dal(dal_) {}
+inline void ResourceTracker::discard(const Image &image)
+{
+	auto it = images.find(*image);
+	if (it == images.end())
+		return;
 
-	constexpr LinkedDeviceAllocator(const vk::Device &device_,
-			                const vk::PhysicalDeviceMemoryProperties &properties_,
-					littlevk::Deallocator &dal_, const std::tuple <Args...> &args)
-		: std::tuple <Args...> (args), device(device_), properties(properties_), dal(dal_) {}
+	for (State &state : it->second.states)
+		state.layout = vk::ImageLayout::eUndefined;
+}
 
-	operator const auto &() const {
-		if constexpr (sizeof...(Args) == 1)
-			return std::get <0> (*this);
-		else
-			return *this;
-	}
+inline void ResourceTracker::assume(const Image &image, const ResourceUsage &usage)
+{
+	// As if the usage had just been transitioned to
+	State state;
+	state.advance(usage, true, bool(usage.access & detail::write_access_mask), {});
 
-	template <typename... InfoArgs>
-	requires std::is_constructible_v <ImageCreateInfo, InfoArgs...>
-	[[nodiscard]] LinkedDeviceAllocator <Args..., littlevk::Image>
-	image(const InfoArgs &...args) {
-		ImageCreateInfo info(args...);
-		auto image = littlevk::image(device, info, properties).unwrap(dal);
-		auto new_values = std::tuple_cat((std::tuple <Args...>) *this, std::make_tuple(image));
-		return {device, properties, dal, new_values};
-	}
+	ImageStates entry { image.mip_levels, image.array_layers, {} };
+	entry.states.resize(image.mip_levels * image.array_layers, state);
 
-	template <typename... BufferArgs>
-	[[nodiscard]] LinkedDeviceAllocator <Args..., littlevk::Buffer>
-	buffer(const BufferArgs &...args) {
-		auto buffer = littlevk::buffer(device, properties, args...).unwrap(dal);
-		auto new_values = std::tuple_cat((std::tuple <Args...>) *this, std::make_tuple(buffer));
-		return {device, properties, dal, new_values};
-	}
-};
+	images[*image] = entry;
+}
 
-// Starts with nothing
-constexpr LinkedDeviceAllocator <> bind(const vk::Device &device,
-		                        const vk::PhysicalDeviceMemoryProperties &properties,
-					littlevk::Deallocator &dal)
+inline vk::ImageLayout ResourceTracker::layout(const Image &image, uint32_t mip, uint32_t layer) const
 {
-	return {device, properties, dal};
+	auto it = images.find(*image);
+	if (it == images.end())
+		return image.layout;
+
+	return it->second.states[mip * it->second.array_layers + layer].layout;
 }
 
-struct LinkedDeviceDescriptorPool {
-	const vk::Device &device;
-	const vk::DescriptorPool &pool;
+// Render graph over littlevk images and buffers; passes declare what they
+// read and write, and the graph culls passes that contribute nothing to the
+// outputs, allocates (and shares) transient images and inserts barriers
+struct RenderGraph {
+	using Handle = uint32_t;
 
-	[[nodiscard]] std::vector <vk::DescriptorSet>
-	allocate_descriptor_sets(const vk::DescriptorSetLayout &dsl) const
-	{
-		return device.allocateDescriptorSets(
-			vk::DescriptorSetAllocateInfo {pool, dsl});
-	}
+	struct Resource {
+		std::string name;
+		bool is_buffer = false;
+		bool transient = false;
+		bool output = false;
 
-	[[nodiscard]] std::vector <vk::DescriptorSet>
-	allocate_descriptor_sets(const std::vector <vk::DescriptorSetLayout> &dsls) const
-	{
-		return device.allocateDescriptorSets(vk::DescriptorSetAllocateInfo { pool, dsls });
-	}
-};
+		Image image;
+		Buffer buffer;
 
-constexpr LinkedDeviceDescriptorPool bind(const vk::Device &device, const vk::DescriptorPool &pool)
-{
-	return { device, pool };
-}
+		// Transient images only
+		std::optional <ImageCreateInfo> info;
+		uint32_t physical = 0;
+	};
 
-// Descriptor set update structure
-struct DescriptorUpdateQueue {
-	vk::DescriptorSet descriptor;
-	std::vector <vk::DescriptorSetLayoutBinding> bindings;
+	struct Access {
+		Handle resource;
+		ResourceUsage usage;
+		bool write;
+	};
 
-	DescriptorUpdateQueue(const vk::DescriptorSet &descriptor_,
-			      const std::vector <vk::DescriptorSetLayoutBinding> &bindings_)
-			: descriptor(descriptor_), bindings(bindings_) {}
+	using Recorder = std::function <void (const vk::CommandBuffer &)>;
 
-	DescriptorUpdateQueue(const vk::DescriptorSet &descriptor_,
-			      const std::map <uint32_t, vk::DescriptorSetLayoutBinding> &bindings_)
-			: descriptor(descriptor_) {
-		for (auto &[k, v] : bindings_) {
-			if (k >= bindings.size())
-				bindings.resize(k + 1);
+	struct Pass {
+		std::string name;
+		std::vector <Access> accesses;
+		Recorder recorder;
+		bool side_effect = false;
 
-			bindings[k] = v;
+		// Filled in at execution
+		std::vector <vk::ImageMemoryBarrier2> image_barriers;
+		std::vector <vk::BufferMemoryBarrier2> buffer_barriers;
+	};
+
+	struct PassBuilder {
+		RenderGraph &graph;
+		uint32_t index;
+
+		PassBuilder &read(Handle resource, const ResourceUsage &usage) {
+			graph.passes[index].accesses.push_back({ resource, usage, false });
+			return *this;
 		}
-	}
 
-	// Allow for arbitrarily many updates; enable partial/full updates
-	std::list <vk::DescriptorImageInfo> image_infos;
-	std::list <vk::DescriptorBufferInfo> buffer_infos;
-	std::vector <vk::WriteDescriptorSet> writes;
+		PassBuilder &write(Handle resource, const ResourceUsage &usage) {
+			graph.passes[index].accesses.push_back({ resource, usage, true });
+			return *this;
+		}
 
-	DescriptorUpdateQueue &queue_update(uint32_t binding,
-					    uint32_t element,
-					    const vk::Sampler &sampler,
-					    const vk::ImageView &view,
-					    const vk::ImageLayout &layout) {
-		image_infos.emplace_back(sampler, view, layout);
+		// Kept even if nothing reads its results (e.g. presentation)
+		PassBuilder &side_effect() {
+			graph.passes[index].side_effect = true;
+			return *this;
+		}
 
-		auto &info = image_infos.back();
-		writes.emplace_back(descriptor, binding, element,
-			bindings[binding].descriptorCount,
-			bindings[binding].descriptorType,
-			&info, nullptr, nullptr);
+		PassBuilder &record(const Recorder &recorder) {
+			graph.passes[index].recorder = recorder;
+			return *this;
+		}
+	};
 
-		return *this;
-	}
+	std::vector <Resource> resources;
+	std::vector <Pass> passes;
 
-	DescriptorUpdateQueue &queue_update(uint32_t binding,
-					    uint32_t element,
-					    const vk::Buffer &buffer,
-					    uint32_t offset,
-					    uint32_t range) {
-		buffer_infos.emplace_back(buffer, offset, range);
+	// Live passes, in execution order
+	std::vector <uint32_t> order;
 
-		auto &info = buffer_infos.back();
-		writes.emplace_back(descriptor, binding, element,
-			bindings[binding].descriptorCount,
-			bindings[binding].descriptorType,
-			nullptr, &info, nullptr);
+	// Shared backing images of the transient resources
+	std::vector <Image> physical;
+	vk::Device device;
 
-		return *this;
+	// Per-thread pools for parallel recording
+	std::vector <vk::CommandPool> pools;
+	std::vector <vk::CommandBuffer> cmds;
+
+	ResourceTracker tracker;
+
+	Handle import(const std::string &name, const Image &image) {
+		Resource resource;
+		resource.name = name;
+		resource.image = image;
+		resources.push_back(resource);
+		return resources.size() - 1;
 	}
 
-	void apply(const vk::Device &device) const {
-		device.updateDescriptorSets(writes, nullptr);
+	Handle import(const std::string &name, const Buffer &buffer) {
+		Resource resource;
+		resource.name = name;
+		resource.is_buffer = true;
+		resource.buffer = buffer;
+		resources.push_back(resource);
+		return resources.size() - 1;
 	}
-};
 
-// Descriptor set update structures
-// TODO: deprecate
-struct LinkedDescriptorUpdater {
-	const vk::Device &device;
-	const vk::DescriptorSet &dset;
-	const std::vector <vk::DescriptorSetLayoutBinding> &bindings;
+	Handle transient(const std::string &name, const ImageCreateInfo &info) {
+		Resource resource;
+		resource.name = name;
+		resource.transient = true;
+		resource.info = info;
+		resources.push_back(resource);
+		return resources.size() - 1;
+	}
 
-	// Allow for arbitrarily many updates; enable partial/full updates
-	std::vector <vk::DescriptorImageInfo> image_infos;
-	std::vector <vk::DescriptorBufferInfo> buffer_infos;
-	std::vector <size_t> image_indices;
-	std::vector <size_t> buffer_indices;
-	std::vector <vk::WriteDescriptorSet> writes;
+	// Swap in a different imported resource, e.g. the next swapchain image
+	void rebind(Handle handle, const Image &image) {
+		resources[handle].image = image;
+	}
 
-	LinkedDescriptorUpdater(const vk::Device &device_,
-			        const vk::DescriptorSet &dset_,
-				const std::vector <vk::DescriptorSetLayoutBinding> &bindings_)
-		: device(device_), dset(dset_), bindings(bindings_) {}
+	void rebind(Handle handle, const Buffer &buffer) {
+		resources[handle].buffer = buffer;
+	}
 
-	~LinkedDescriptorUpdater() {
-		if (writes.empty())
-			return;
+	// Results that must be produced
+	void output(Handle handle) {
+		resources[handle].output = true;
+	}
 
-		microlog::warning("linked_descriptor_updator",
-			"Updates to descriptor set (handle = %p) where invoked, "
-			"but never finalized.\n", (void *) dset);
+	PassBuilder pass(const std::string &name) {
+		Pass pass;
+		pass.name = name;
+		passes.push_back(pass);
+		return PassBuilder { *this, uint32_t(passes.size() - 1) };
 	}
 
-	LinkedDescriptorUpdater &queue_update(uint32_t binding,
-					      uint32_t element,
-					      const vk::Sampler &sampler,
-					      const vk::ImageView &view,
-					      const vk::ImageLayout &layout) {
-		image_infos.emplace_back(sampler, view, layout);
-		image_indices.push_back(writes.size());
-		writes.emplace_back(dset, binding, element,
-				    bindings[binding].descriptorCount,
-				    bindings[binding].descriptorType);
-		return *this;
+	const Image &image(Handle handle) const {
+		const Resource &resource = resources[handle];
+		if (resource.transient)
+			return physical[resource.physical];
+
+		return resource.image;
 	}
 
-	LinkedDescriptorUpdater &queue_update(uint32_t binding,
-			                      uint32_t element,
-					      const vk::Buffer &buffer,
-					      uint32_t offset,
-					      uint32_t range) {
-		buffer_infos.emplace_back(buffer, offset, range);
-		buffer_indices.push_back(writes.size());
-		writes.emplace_back(dset, binding, element,
-				    bindings[binding].descriptorCount,
-				    bindings[binding].descriptorType);
-		return *this;
+	const Buffer &buffer(Handle handle) const {
+		return resources[handle].buffer;
 	}
 
-	void finalize() {
-		// Assign the addresses
-		for (size_t i = 0; i < image_infos.size(); i++) {
-			size_t index = image_indices[i];
-			writes[index].pImageInfo = &image_infos[i];
-		}
+	// Cull, order and allocate transient images
+	void compile(const vk::Device &, const vk::PhysicalDeviceMemoryProperties &);
 
-		for (size_t i = 0; i < buffer_infos.size(); i++) {
-			size_t index = buffer_indices[i];
-			writes[index].pBufferInfo = &buffer_infos[i];
-		}
+	// Record every live pass into a single command buffer
+	void record(const vk::CommandBuffer &);
 
-		// Execute the update
-		device.updateDescriptorSets(writes, nullptr);
+	// Record every live pass into its own command buffer, spread over
+	// threads; submit the result in order (one submission is enough). The
+	// previous submission must have completed
+	const std::vector <vk::CommandBuffer> &record_parallel(uint32_t, uint32_t);
 
-		// Clear to indicate finished business
-		image_infos.clear();
-		buffer_infos.clear();
-		image_indices.clear();
-		buffer_indices.clear();
-		writes.clear();
-	}
+	// Compute the barriers of every live pass into the passes; the record
+	// functions do this themselves
+	void prepare();
 
-	void offload(std::vector <vk::WriteDescriptorSet> &other) {
-		other.insert(other.end(), writes.begin(), writes.end());
-	}
+	void drop();
 };
 
-inline LinkedDescriptorUpdater bind(const vk::Device &device,
-		        	    const vk::DescriptorSet &dset,
-				    const std::vector <vk::DescriptorSetLayoutBinding> &bindings)
+namespace detail {
+
+inline bool same_image_info(const ImageCreateInfo &a, const ImageCreateInfo &b)
 {
-	return { device, dset, bindings };
+	return a.width == b.width && a.height == b.height
+		&& a.format == b.format && a.usage == b.usage
+		&& a.aspect == b.aspect && a.type == b.type
+		&& a.view == b.view && a.external == b.external
+		&& a.mip_levels == b.mip_levels
+		&& a.array_layers == b.array_layers;
 }
 
-namespace shader {
+} // namespace detail
 
-// TODO: detail here as well...
-using Defines = std::map<std::string, std::string>;
-using Includes = std::set<std::string>;
+inline void RenderGraph::compile(const vk::Device &device_, const vk::PhysicalDeviceMemoryProperties &properties)
+{
+	for (const Image &image : physical)
+		destroy_image(device, image);
 
-// Local structs
-struct compile_result {
-	std::vector <unsigned int> spirv = {};
-	std::string log = "";
-	std::string source = "";
-};
+	physical.clear();
+	device = device_;
 
-// Compiling shaders
-inline EShLanguage translate_shader_stage(const vk::ShaderStageFlagBits &stage)
-{
-	switch (stage) {
-	case vk::ShaderStageFlagBits::eVertex:
-		return EShLangVertex;
-	case vk::ShaderStageFlagBits::eTessellationControl:
-		return EShLangTessControl;
-	case vk::ShaderStageFlagBits::eTessellationEvaluation:
-		return EShLangTessEvaluation;
-	case vk::ShaderStageFlagBits::eGeometry:
-		return EShLangGeometry;
-	case vk::ShaderStageFlagBits::eFragment:
-		return EShLangFragment;
-	case vk::ShaderStageFlagBits::eCompute:
-		return EShLangCompute;
-	case vk::ShaderStageFlagBits::eTaskEXT:
-		return EShLangTask;
-	case vk::ShaderStageFlagBits::eMeshNV:
-		return EShLangMesh;
-	case vk::ShaderStageFlagBits::eRaygenNV:
-		return EShLangRayGenNV;
-	case vk::ShaderStageFlagBits::eAnyHitNV:
-		return EShLangAnyHitNV;
-	case vk::ShaderStageFlagBits::eClosestHitNV:
-		return EShLangClosestHitNV;
-	case vk::ShaderStageFlagBits::eMissNV:
-		return EShLangMissNV;
-	case vk::ShaderStageFlagBits::eIntersectionNV:
-		return EShLangIntersectNV;
-	case vk::ShaderStageFlagBits::eCallableNV:
-		return EShLangCallableNV;
-	default:
-		break;
+	// Walk backwards from the outputs; a pass lives if it writes something
+	// still needed, and a write without a read ends the need
+	std::set <Handle> needed;
+	for (Handle i = 0; i < resources.size(); i++) {
+		if (resources[i].output)
+			needed.insert(i);
 	}
 
-	microlog::error("translate_shader_stage", "Unknown shader stage %s\n", vk::to_string(stage).c_str());
+	std::vector <bool> live(passes.size(), false);
+	for (size_t i = passes.size(); i-- > 0; ) {
+		const Pass &pass = passes[i];
 
-	return EShLangVertex;
-}
+		live[i] = pass.side_effect;
+		for (const Access &access : pass.accesses) {
+			if (access.write && needed.count(access.resource))
+				live[i] = true;
+		}
 
-inline compile_result glsl_to_spirv(const std::string &source,
-				    const std::set <std::string> &paths,
-				    const std::map <std::string, std::string> &defines,
-				    const vk::ShaderStageFlagBits &shader_type)
-{
-	// Output
-	compile_result out;
+		if (!live[i])
+			continue;
 
-	// Compile shader
-	EShLanguage stage = translate_shader_stage(shader_type);
+		for (const Access &access : pass.accesses) {
+			if (!access.write)
+				continue;
 
-	std::string preprocessed = source;
+			auto reads = [&](const Access &other) {
+				return !other.write && other.resource == access.resource;
+			};
 
-	// Cut the version string
-	// TODO: only assumes its the very first string
-	std::string version;
-	for (size_t i = 0; i < preprocessed.size(); i++) {
-		version += preprocessed[i];
-		if (preprocessed[i] == '\n')
-			break;
-	}
+			if (std::none_of(pass.accesses.begin(), pass.accesses.end(), reads))
+				needed.erase(access.resource);
+		}
 
-	preprocessed = preprocessed.substr(version.size());
-	for (auto &[symbol, value] : defines)
-		preprocessed = "#define " + symbol + " " + value + "\n" + preprocessed;
+		for (const Access &access : pass.accesses) {
+			if (!access.write)
+				needed.insert(access.resource);
+		}
+	}
 
-	preprocessed = version + preprocessed;
+	// Declaration order already respects every dependency
+	order.clear();
+	for (uint32_t i = 0; i < passes.size(); i++) {
+		if (live[i])
+			order.push_back(i);
+		else
+			microlog::info("RenderGraph", "Culled pass \"%s\"\n", passes[i].name.c_str());
+	}
 
-	// TODO: use &
-	const char *shaderStrings[1];
-	shaderStrings[0] = preprocessed.data();
+	// Lifetimes of the transient images, in positions of the live order
+	std::vector <std::pair <uint32_t, uint32_t>> lifetimes(resources.size(), { UINT32_MAX, 0 });
+	for (uint32_t p = 0; p < order.size(); p++) {
+		for (const Access &access : passes[order[p]].accesses) {
+			auto &lifetime = lifetimes[access.resource];
+			lifetime.first = std::min(lifetime.first, p);
+			lifetime.second = std::max(lifetime.second, p);
+		}
+	}
 
-	glslang::SpvOptions options;
-	options.generateDebugInfo = true;
+	// Share backing images between transients of the same description
+	// whose lifetimes do not overlap
+	std::vector <Handle> transients;
+	for (Handle i = 0; i < resources.size(); i++) {
+		if (resources[i].transient && lifetimes[i].first != UINT32_MAX)
+			transients.push_back(i);
+	}
 
-	glslang::TShader shader(stage);
+	std::sort(transients.begin(), transients.end(),
+		[&](Handle a, Handle b) { return lifetimes[a].first < lifetimes[b].first; });
 
-	shader.setEnvTarget(glslang::EShTargetLanguage::EShTargetSpv,
-			    glslang::EShTargetLanguageVersion::EShTargetSpv_1_6);
-	shader.setStrings(shaderStrings, 1);
+	std::vector <uint32_t> busy_until;
+	std::vector <ImageCreateInfo> descriptions;
 
-	// Enable SPIR-V and Vulkan rules when parsing GLSL
-	EShMessages messages = (EShMessages) (EShMsgDefault | EShMsgSpvRules
-			| EShMsgVulkanRules | EShMsgDebugInfo);
+	for (Handle handle : transients) {
+		Resource &resource = resources[handle];
+		auto [first, last] = lifetimes[handle];
 
-	// Include directories
-	standalone::DirectoryIncluder includer;
-	for (const auto &path : paths)
-		includer.include(path);
+		bool shared = false;
+		for (uint32_t i = 0; i < physical.size(); i++) {
+			if (busy_until[i] < first && detail::same_image_info(descriptions[i], *resource.info)) {
+				resource.physical = i;
+				busy_until[i] = last;
+				shared = true;
+				break;
+			}
+		}
 
-	// ShaderIncluder includer;
-	if (!shader.parse(GetDefaultResources(), 450, false, messages, includer)) {
-		out.log = shader.getInfoLog();
-		out.source = preprocessed;
-		return out;
+		if (!shared) {
+			resource.physical = physical.size();
+			physical.push_back(littlevk::image(device, *resource.info, properties).value);
+			busy_until.push_back(last);
+			descriptions.push_back(*resource.info);
+		}
 	}
 
-	// Link the program
-	glslang::TProgram program;
-	program.addShader(&shader);
+	microlog::info("RenderGraph", "%lu live passes, %lu transient images on %lu allocations\n",
+		(unsigned long) order.size(), (unsigned long) transients.size(),
+		(unsigned long) physical.size());
+}
 
-	if (!program.link(messages)) {
-		out.log = program.getInfoLog();
-		return out;
-	}
+// Barriers for every live pass, computed in order
+inline void RenderGraph::prepare()
+{
+	// Transient contents do not survive between frames
+	std::vector <bool> started(resources.size(), false);
 
-	glslang::GlslangToSpv(*program.getIntermediate(stage), out.spirv, &options);
+	for (uint32_t index : order) {
+		Pass &pass = passes[index];
 
-	return out;
-}
+		for (const Access &access : pass.accesses) {
+			const Resource &resource = resources[access.resource];
 
-inline std::string fmt_lines(const std::string &str)
-{
-	// Add line numbers to each line
-	std::string out = "";
-	std::string line;
+			if (resource.is_buffer) {
+				tracker.buffer(resource.buffer, access.usage.stage, access.usage.access);
+				continue;
+			}
 
-	std::istringstream stream(str);
+			const Image &target = image(access.resource);
+			if (resource.transient && !started[access.resource]) {
+				tracker.discard(target);
+				started[access.resource] = true;
+			}
 
-	int line_num = 1;
-	while (std::getline(stream, line)) {
-		char buffer[1024];
-		memset(buffer, 0, sizeof(buffer));
-		snprintf(buffer, sizeof(buffer), "%4d: %s\n", line_num++, line.c_str());
-		out += buffer;
-	}
+			tracker.image(target, access.usage);
+		}
 
-	return out;
+		tracker.take(pass.image_barriers, pass.buffer_barriers);
+	}
 }
 
-// Return proxy specialization for shader modules
-static void destroy_shader_module(const vk::Device &device,
-				  const vk::ShaderModule &shader)
+inline void RenderGraph::record(const vk::CommandBuffer &cmd)
 {
-	device.destroyShaderModule(shader);
-}
-
-using ShaderModuleReturnProxy = DeviceReturnProxy <vk::ShaderModule, destroy_shader_module>;
+	prepare();
 
-// Compile shader
-inline ShaderModuleReturnProxy
-compile(const vk::Device &device,
-	const std::string &source,
-	const vk::ShaderStageFlagBits &shader_type,
-	const Includes &includes = {},
-	const Defines &defines = {})
-{
-	// Check that file exists
-	glslang::InitializeProcess();
+	for (uint32_t index : order) {
+		const Pass &pass = passes[index];
+		if (!pass.image_barriers.empty() || !pass.buffer_barriers.empty())
+			detail::pipeline_barrier(cmd, pass.image_barriers, pass.buffer_barriers);
 
-	// Compile shader
-	compile_result out = glsl_to_spirv(source, includes, defines, shader_type);
-	if (!out.log.empty()) {
-		// TODO: show the errornous line(s)
-		microlog::error("shader",
-				"Shader compilation failed:\n%s\nSource:\n%s",
-				out.log.c_str(), fmt_lines(out.source).c_str());
-		return true;
+		if (pass.recorder)
+			pass.recorder(cmd);
 	}
-
-	vk::ShaderModuleCreateInfo create_info;
-	create_info.pCode = out.spirv.data();
-	create_info.codeSize = out.spirv.size() * sizeof(uint32_t);
-
-	return device.createShaderModule(create_info);
 }
 
-inline ShaderModuleReturnProxy
-compile(const vk::Device &device,
-	const std::filesystem::path &path,
-	const vk::ShaderStageFlagBits &shader_type,
-	const Includes &includes = {},
-	const Defines &defines = {})
+inline const std::vector <vk::CommandBuffer> &RenderGraph::record_parallel(uint32_t queue_family, uint32_t threads)
 {
-	// Check that file exists
-	glslang::InitializeProcess();
+	threads = std::max(1u, std::min <uint32_t> (threads, order.size()));
 
-	// Compile shader
-	std::string source = standalone::readfile(path);
-	compile_result out = glsl_to_spirv(source, includes, defines, shader_type);
-	if (!out.log.empty()) {
-		// TODO: show the errornous line(s)
-		microlog::error(__FUNCTION__,
-				"Shader compilation failed:\n%s\nSource:\n%s",
-				out.log.c_str(), fmt_lines(out.source).c_str());
-		return true;
-	}
+	if (pools.size() != threads || cmds.size() != order.size()) {
+		for (const vk::CommandPool &pool : pools)
+			device.destroyCommandPool(pool);
 
-	vk::ShaderModuleCreateInfo create_info;
-	create_info.pCode = out.spirv.data();
-	create_info.codeSize = out.spirv.size() * sizeof(uint32_t);
+		pools.clear();
+		cmds.resize(order.size());
 
-	return device.createShaderModule(create_info);
-}
+		for (uint32_t t = 0; t < threads; t++) {
+			pools.push_back(device.createCommandPool({ {}, queue_family }));
 
-} // namespace shader
+			for (uint32_t p = t; p < order.size(); p += threads) {
+				cmds[p] = device.allocateCommandBuffers({
+					pools[t], vk::CommandBufferLevel::ePrimary, 1
+				}).front();
+			}
+		}
+	}
 
-namespace pipeline {
+	prepare();
 
-inline void destroy_pipeline(const vk::Device &device, const vk::Pipeline &pipeline)
-{
-	device.destroyPipeline(pipeline);
-}
+	auto work = [&](uint32_t t) {
+		device.resetCommandPool(pools[t]);
 
-using PipelineReturnProxy = DeviceReturnProxy <vk::Pipeline, destroy_pipeline>;
+		for (uint32_t p = t; p < order.size(); p += threads) {
+			const Pass &pass = passes[order[p]];
+			const vk::CommandBuffer &cmd = cmds[p];
 
-// Regular graphics pipeline
-struct GraphicsCreateInfo {
-	using vertex_binding_t = vk::VertexInputBindingDescription;
-	using vertex_attribute_t = vk::ArrayProxy <vk::VertexInputAttributeDescription>;
+			cmd.begin({ vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
 
-	std::optional <vertex_binding_t> vertex_binding = std::nullopt;
-	std::optional <vertex_attribute_t> vertex_attributes = std::nullopt;
+			if (!pass.image_barriers.empty() || !pass.buffer_barriers.empty())
+				detail::pipeline_barrier(cmd, pass.image_barriers, pass.buffer_barriers);
 
-	std::vector <vk::PipelineShaderStageCreateInfo> shader_stages;
+			if (pass.recorder)
+				pass.recorder(cmd);
 
-	vk::Extent2D extent;
+			cmd.end();
+		}
+	};
 
-	vk::PolygonMode fill_mode = vk::PolygonMode::eFill;
-	vk::CullModeFlags cull_mode = vk::CullModeFlagBits::eBack;
+	std::vector <std::thread> workers;
+	for (uint32_t t = 1; t < threads; t++)
+		workers.emplace_back(work, t);
 
-	bool dynamic_viewport = false;
-	bool alpha_blend = false;
-	bool depth_test = true;
-	bool depth_write = true;
+	work(0);
 
-	vk::PipelineLayout pipeline_layout;
-	vk::RenderPass render_pass;
-	uint32_t subpass;
-};
+	for (std::thread &worker : workers)
+		worker.join();
 
-inline PipelineReturnProxy compile(const vk::Device &device, const GraphicsCreateInfo &info)
-{
-	if (!info.shader_stages.size())
-		microlog::error("pipeline::compile", "Empty shader stages\n");
+	return cmds;
+}
 
-	vk::PipelineVertexInputStateCreateInfo vertex_input_info {
-		{}, nullptr, nullptr
-	};
+inline void RenderGraph::drop()
+{
+	for (const Image &image : physical)
+		destroy_image(device, image);
 
-	if (info.vertex_binding && info.vertex_attributes)
-		vertex_input_info = { {}, *info.vertex_binding, *info.vertex_attributes };
+	for (const vk::CommandPool &pool : pools)
+		device.destroyCommandPool(pool);
 
-	vk::PipelineInputAssemblyStateCreateInfo input_assembly {
-		{}, vk::PrimitiveTopology::eTriangleList
-	};
+	physical.clear();
+	pools.clear();
+	cmds.clear();
+}
 
-	// Configuring the viewport
-	vk::PipelineViewportStateCreateInfo viewport_state {
-		{}, 1, nullptr, 1, nullptr
-	};
+// Buffer-image copy region wrapper; row length and image height are in
+// texels, zero meaning tightly packed (as in Vulkan)
+struct ImageCopyRegion {
+	vk::DeviceSize m_buffer_offset = 0;
+	uint32_t m_row_length = 0;
+	uint32_t m_image_height = 0;
+	vk::ImageAspectFlags m_aspect = vk::ImageAspectFlagBits::eColor;
+	uint32_t m_mip = 0;
+	uint32_t m_base_layer = 0;
+	uint32_t m_layers = 1;
+	vk::Offset3D m_offset = { 0, 0, 0 };
+	vk::Extent3D m_extent = { 1, 1, 1 };
+
+	constexpr operator vk::BufferImageCopy() const {
+		return vk::BufferImageCopy(
+			m_buffer_offset, m_row_length, m_image_height,
+			vk::ImageSubresourceLayers(m_aspect, m_mip, m_base_layer, m_layers),
+			m_offset, m_extent);
+	}
+
+	constexpr ImageCopyRegion &buffer_offset(vk::DeviceSize buffer_offset) {
+		this->m_buffer_offset = buffer_offset;
+		return *this;
+	}
 
-	vk::PipelineDynamicStateCreateInfo dynamic_state {
-		{}, 0, nullptr
-	};
+	constexpr ImageCopyRegion &row_length(uint32_t row_length) {
+		this->m_row_length = row_length;
+		return *this;
+	}
 
-	// Fixed viewport
-	vk::Viewport viewport {
-		0.0f, 0.0f,
-		(float) info.extent.width,
-		(float) info.extent.height,
-		0.0f, 1.0f
-	};
+	// Row pitch in bytes, converted to texels for the given format
+	constexpr ImageCopyRegion &row_pitch(vk::DeviceSize pitch, vk::Format format) {
+		FormatBlock block = format_block(format);
+		this->m_row_length = uint32_t(pitch/std::max(block.size, 1u)) * block.width;
+		return *this;
+	}
 
-	vk::Rect2D scissor { {}, info.extent };
+	constexpr ImageCopyRegion &image_height(uint32_t image_height) {
+		this->m_image_height = image_height;
+		return *this;
+	}
 
-	// Dynamic viewport
-	std::array <vk::DynamicState, 2> dynamic_states {
-		vk::DynamicState::eViewport,
-		vk::DynamicState::eScissor
-	};
+	constexpr ImageCopyRegion &aspect(vk::ImageAspectFlags aspect) {
+		this->m_aspect = aspect;
+		return *this;
+	}
 
-	// Select according to the configuration
-	if (info.dynamic_viewport) {
-		dynamic_state = vk::PipelineDynamicStateCreateInfo {
-			{},
-			(uint32_t) dynamic_states.size(),
-			dynamic_states.data()
-		};
-	} else {
-		viewport_state = vk::PipelineViewportStateCreateInfo {
-			{}, 1, &viewport, 1, &scissor
-		};
+	constexpr ImageCopyRegion &mip(uint32_t mip) {
+		this->m_mip = mip;
+		return *this;
 	}
 
-	vk::PipelineRasterizationStateCreateInfo rasterizer {
-		{},
-		false, false,
-		info.fill_mode,
-		info.cull_mode,
-		vk::FrontFace::eClockwise,
-		false,
-		0.0f, 0.0f, 0.0f, 1.0f
-	};
+	constexpr ImageCopyRegion &layers(uint32_t base_layer, uint32_t layers) {
+		this->m_base_layer = base_layer;
+		this->m_layers = layers;
+		return *this;
+	}
 
-	vk::PipelineMultisampleStateCreateInfo multisampling {
-		{}, vk::SampleCountFlagBits::e1
-	};
+	constexpr ImageCopyRegion &offset(int32_t x, int32_t y) {
+		this->m_offset = vk::Offset3D { x, y, 0 };
+		return *this;
+	}
 
-	vk::PipelineDepthStencilStateCreateInfo depth_stencil {
-		{},
-		info.depth_test,
-		info.depth_write,
-		vk::CompareOp::eLess,
-		false, false,
-		{}, {},
-		0.0f, 1.0f
-	};
+	constexpr ImageCopyRegion &extent(uint32_t width, uint32_t height) {
+		this->m_extent = vk::Extent3D { width, height, 1 };
+		return *this;
+	}
 
-	vk::PipelineColorBlendAttachmentState color_blend_attachment;
-	if (info.alpha_blend) {
-		color_blend_attachment = {
-			true,
-			vk::BlendFactor::eSrcAlpha,
-			vk::BlendFactor::eOneMinusSrcAlpha,
-			vk::BlendOp::eAdd,
-			vk::BlendFactor::eOne,
-			vk::BlendFactor::eZero,
-			vk::BlendOp::eAdd,
-			vk::ColorComponentFlagBits::eR
-			| vk::ColorComponentFlagBits::eG
-			| vk::ColorComponentFlagBits::eB
-			| vk::ColorComponentFlagBits::eA
-		};
-	} else {
-		color_blend_attachment = {
-			false,
-			vk::BlendFactor::eOne,
-			vk::BlendFactor::eZero,
-			vk::BlendOp::eAdd,
-			vk::BlendFactor::eOne,
-			vk::BlendFactor::eZero,
-			vk::BlendOp::eAdd,
-			vk::ColorComponentFlagBits::eR
-			| vk::ColorComponentFlagBits::eG
-			| vk::ColorComponentFlagBits::eB
-			| vk::ColorComponentFlagBits::eA
-		};
+	constexpr ImageCopyRegion &extent(const vk::Extent2D &extent) {
+		this->m_extent = vk::Extent3D { extent.width, extent.height, 1 };
+		return *this;
 	}
+};
 
-	vk::PipelineColorBlendStateCreateInfo color_blending {
-		{},
-		false,
-		vk::LogicOp::eCopy, 1,
-		&color_blend_attachment,
-		{ 0.0f, 0.0f, 0.0f, 0.0f }
-	};
+// Copies address a single aspect; depth is picked for depth/stencil images
+inline vk::ImageAspectFlags copy_aspect(const Image &image)
+{
+	if (image.aspect & vk::ImageAspectFlagBits::eDepth)
+		return vk::ImageAspectFlagBits::eDepth;
 
-	return device.createGraphicsPipeline(nullptr,
-		vk::GraphicsPipelineCreateInfo {
-			{}, info.shader_stages,
-			&vertex_input_info,
-			&input_assembly,
-			nullptr,
-			&viewport_state,
-			&rasterizer,
-			&multisampling,
-			&depth_stencil,
-			&color_blending,
-			&dynamic_state,
-			info.pipeline_layout,
-			info.render_pass,
-			info.subpass
-		}).value;
-}
+	if (!image.aspect)
+		return vk::ImageAspectFlagBits::eColor;
 
-// Compute pipeline
-struct ComputeCreateInfo {
-	vk::PipelineShaderStageCreateInfo shader_stage;
-	vk::PipelineLayout pipeline_layout;
-};
+	return image.aspect;
+}
 
-inline PipelineReturnProxy compile(const vk::Device &device, const ComputeCreateInfo &info)
+// Bytes of the buffer spanned by a copy region
+inline vk::DeviceSize region_size(const vk::BufferImageCopy &region, const vk::Format &format)
 {
-	return device.createComputePipeline(nullptr,
-		vk::ComputePipelineCreateInfo {
-			{}, info.shader_stage, info.pipeline_layout
-		}).value;
-}
+	FormatBlock block = format_block(format);
 
-} // namespace pipeline
+	uint32_t row_length = region.bufferRowLength ? region.bufferRowLength : region.imageExtent.width;
+	uint32_t image_height = region.bufferImageHeight ? region.bufferImageHeight : region.imageExtent.height;
 
-// Pre defined Vulkan types; not intended for concrete usage
-struct r32f {
-	char _data[sizeof(float)];
-};
+	vk::DeviceSize row = (row_length + block.width - 1)/block.width * block.size;
+	vk::DeviceSize slice = (image_height + block.height - 1)/block.height * row;
+	vk::DeviceSize slices = region.imageExtent.depth * region.imageSubresource.layerCount;
 
-struct rg32f {
-	char _data[2 * sizeof(float)];
-};
+	// The last slice only extends as far as the copied extent
+	vk::DeviceSize rows = (region.imageExtent.height + block.height - 1)/block.height;
+	vk::DeviceSize columns = (region.imageExtent.width + block.width - 1)/block.width;
 
-struct rgb32f {
-	char _data[3 * sizeof(float)];
-};
+	return (slices - 1) * slice + (rows - 1) * row + columns * block.size;
+}
 
-struct rgba32f {
-	char _data[4 * sizeof(float)];
+// Regions for every mip level and layer of an image, tightly packed
+// one level after another in a buffer (e.g. a staging buffer)
+struct PackedRegions {
+	std::vector <vk::BufferImageCopy> regions;
+	vk::DeviceSize size;
 };
 
-// Easier vertex layout, using templates only
-template <typename T, typename... Args>
-constexpr size_t sizeof_all()
+inline PackedRegions packed_regions(const Image &image, vk::DeviceSize offset = 0)
 {
-	if constexpr (sizeof...(Args))
-		return sizeof(T) + sizeof_all <Args...> ();
-	else
-		return sizeof(T);
-}
+	FormatBlock block = format_block(image.format);
+	vk::DeviceSize alignment = std::lcm <vk::DeviceSize> (4, std::max(block.size, 1u));
+
+	PackedRegions packed;
+	for (uint32_t level = 0; level < image.mip_levels; level++) {
+		vk::Extent2D extent {
+			std::max(image.extent.width >> level, 1u),
+			std::max(image.extent.height >> level, 1u)
+		};
+
+		offset = (offset + alignment - 1)/alignment * alignment;
+
+		packed.regions.push_back(ImageCopyRegion()
+			.buffer_offset(offset)
+			.aspect(copy_aspect(image))
+			.mip(level)
+			.layers(0, image.array_layers)
+			.extent(extent));
+
+		offset += block.bytes(extent) * image.array_layers;
+	}
+
+	packed.size = offset;
+	return packed;
+}
+
+namespace detail {
+
+// Warn about regions reaching past the end of the buffer
+inline void check_regions(const char *header,
+			  const Image &image,
+			  const Buffer &buffer,
+			  const std::vector <vk::BufferImageCopy> &regions)
+{
+	if (format_block(image.format).size == 0)
+		return;
+
+	for (const auto &region : regions) {
+		vk::DeviceSize end = region.bufferOffset + region_size(region, image.format);
+		if (end > buffer.device_size()) {
+			microlog::warning(header,
+				"Copy region (mip %u, layers %u-%u) needs %lu bytes "
+				"but the buffer only holds %lu bytes\n",
+				region.imageSubresource.mipLevel,
+				region.imageSubresource.baseArrayLayer,
+				region.imageSubresource.baseArrayLayer
+					+ region.imageSubresource.layerCount - 1,
+				(unsigned long) end,
+				(unsigned long) buffer.device_size());
+		}
+	}
+}
+
+} // namespace detail
+
+// Copying buffer to image
+inline void copy_buffer_to_image(const vk::CommandBuffer &cmd,
+				 const vk::Image &image,
+				 const Buffer &buffer,
+				 const vk::Extent2D &extent,
+				 const vk::ImageLayout &layout,
+				 const vk::ImageAspectFlags &aspect = vk::ImageAspectFlagBits::eColor)
+{
+	vk::BufferImageCopy region = ImageCopyRegion()
+		.aspect(aspect)
+		.extent(extent);
+
+	cmd.copyBufferToImage(*buffer, image, layout, region);
+}
+
+inline void copy_buffer_to_image(const vk::CommandBuffer &cmd,
+				 const Image &image,
+				 const Buffer &buffer,
+				 const vk::ImageLayout &layout)
+{
+	std::vector <vk::BufferImageCopy> regions {
+		ImageCopyRegion()
+			.aspect(copy_aspect(image))
+			.layers(0, image.array_layers)
+			.extent(image.extent)
+	};
+
+	detail::check_regions("copy_buffer_to_image", image, buffer, regions);
+	cmd.copyBufferToImage(*buffer, *image, layout, regions);
+}
+
+// Copying arbitrary regions (sub-rectangles, mip levels, array layers)
+// in a single command
+inline void copy_buffer_to_image(const vk::CommandBuffer &cmd,
+				 const vk::Image &image,
+				 const Buffer &buffer,
+				 const std::vector <vk::BufferImageCopy> &regions,
+				 const vk::ImageLayout &layout)
+{
+	cmd.copyBufferToImage(*buffer, image, layout, regions);
+}
+
+inline void copy_buffer_to_image(const vk::CommandBuffer &cmd,
+				 const Image &image,
+				 const Buffer &buffer,
+				 const std::vector <vk::BufferImageCopy> &regions,
+				 const vk::ImageLayout &layout)
+{
+	detail::check_regions("copy_buffer_to_image", image, buffer, regions);
+	cmd.copyBufferToImage(*buffer, *image, layout, regions);
+}
+
+// Copying image to buffer
+inline void copy_image_to_buffer(const vk::CommandBuffer &cmd,
+				 const vk::Image &image,
+				 const Buffer &buffer,
+				 const vk::Extent2D &extent,
+				 const vk::ImageLayout &layout,
+				 const vk::ImageAspectFlags &aspect = vk::ImageAspectFlagBits::eColor)
+{
+	vk::BufferImageCopy region = ImageCopyRegion()
+		.aspect(aspect)
+		.extent(extent);
+
+	cmd.copyImageToBuffer(image, layout, *buffer, region);
+}
+
+inline void copy_image_to_buffer(const vk::CommandBuffer &cmd,
+				 const Image &image,
+				 const Buffer &buffer,
+				 const vk::ImageLayout &layout)
+{
+	std::vector <vk::BufferImageCopy> regions {
+		ImageCopyRegion()
+			.aspect(copy_aspect(image))
+			.layers(0, image.array_layers)
+			.extent(image.extent)
+	};
+
+	detail::check_regions("copy_image_to_buffer", image, buffer, regions);
+	cmd.copyImageToBuffer(*image, layout, *buffer, regions);
+}
+
+inline void copy_image_to_buffer(const vk::CommandBuffer &cmd,
+				 const vk::Image &image,
+				 const Buffer &buffer,
+				 const std::vector <vk::BufferImageCopy> &regions,
+				 const vk::ImageLayout &layout)
+{
+	cmd.copyImageToBuffer(image, layout, *buffer, regions);
+}
+
+inline void copy_image_to_buffer(const vk::CommandBuffer &cmd,
+				 const Image &image,
+				 const Buffer &buffer,
+				 const std::vector <vk::BufferImageCopy> &regions,
+				 const vk::ImageLayout &layout)
+{
+	detail::check_regions("copy_image_to_buffer", image, buffer, regions);
+	cmd.copyImageToBuffer(*image, layout, *buffer, regions);
+}
+
+// Generate the mip chain of an image by successive blits from level zero;
+// expects every level in the transfer destination layout (e.g. right after
+// a copy_buffer_to_image) and leaves the image shader read-only. Formats
+// without linear filtering are blitted with nearest filtering, and formats
+// which cannot be blitted at all keep only their first level
+inline bool generate_mipmaps(const vk::PhysicalDevice &phdev,
+			     const vk::CommandBuffer &cmd,
+			     Image &image,
+			     vk::Filter filter = vk::Filter::eLinear)
+{
+	vk::FormatFeatureFlags features = phdev.getFormatProperties(image.format).optimalTilingFeatures;
+
+	constexpr vk::FormatFeatureFlags blit = vk::FormatFeatureFlagBits::eBlitSrc
+		| vk::FormatFeatureFlagBits::eBlitDst;
+
+	if ((features & blit) != blit) {
+		microlog::error("generate_mipmaps", "Format %s does not support blits\n",
+			vk::to_string(image.format).c_str());
+
+		littlevk::transition(cmd, image,
+			vk::ImageLayout::eTransferDstOptimal,
+			vk::ImageLayout::eShaderReadOnlyOptimal);
+
+		image.layout = vk::ImageLayout::eShaderReadOnlyOptimal;
+		return false;
+	}
+
+	if (filter == vk::Filter::eLinear && !(features & vk::FormatFeatureFlagBits::eSampledImageFilterLinear))
+		filter = vk::Filter::eNearest;
+
+	auto level_barrier = [&](uint32_t level,
+				 vk::ImageLayout old_layout,
+				 vk::ImageLayout new_layout,
+				 vk::AccessFlags2 src_access,
+				 vk::AccessFlags2 dst_access,
+				 vk::PipelineStageFlags2 dst_stage) {
+		vk::ImageMemoryBarrier2 barrier {
+			vk::PipelineStageFlagBits2::eTransfer, src_access,
+			dst_stage, dst_access,
+			old_layout, new_layout,
+			VK_QUEUE_FAMILY_IGNORED,
+			VK_QUEUE_FAMILY_IGNORED,
+			*image,
+			vk::ImageSubresourceRange {
+				image.aspect,
+				level, 1,
+				0, image.array_layers
+			}
+		};
+
+		detail::pipeline_barrier(cmd, barrier);
+	};
+
+	int32_t width = image.extent.width;
+	int32_t height = image.extent.height;
+
+	for (uint32_t level = 1; level < image.mip_levels; level++) {
+		// Previous level becomes the blit source
+		level_barrier(level - 1,
+			vk::ImageLayout::eTransferDstOptimal,
+			vk::ImageLayout::eTransferSrcOptimal,
+			vk::AccessFlagBits2::eTransferWrite,
+			vk::AccessFlagBits2::eTransferRead,
+			vk::PipelineStageFlagBits2::eBlit);
+
+		int32_t next_width = std::max(width/2, 1);
+		int32_t next_height = std::max(height/2, 1);
+
+		vk::ImageBlit blit {
+			vk::ImageSubresourceLayers {
+				image.aspect, level - 1,
+				0, image.array_layers
+			},
+			{ vk::Offset3D { 0, 0, 0 }, vk::Offset3D { width, height, 1 } },
+			vk::ImageSubresourceLayers {
+				image.aspect, level,
+				0, image.array_layers
+			},
+			{ vk::Offset3D { 0, 0, 0 }, vk::Offset3D { next_width, next_height, 1 } }
+		};
+
+		cmd.blitImage(*image, vk::ImageLayout::eTransferSrcOptimal,
+			      *image, vk::ImageLayout::eTransferDstOptimal,
+			      blit, filter);
+
+		// Previous level is finished
+		level_barrier(level - 1,
+			vk::ImageLayout::eTransferSrcOptimal,
+			vk::ImageLayout::eShaderReadOnlyOptimal,
+			vk::AccessFlagBits2::eNone,
+			vk::AccessFlagBits2::eShaderSampledRead,
+			vk::PipelineStageFlagBits2::eFragmentShader);
+
+		width = next_width;
+		height = next_height;
+	}
+
+	// Last level was only ever written to
+	level_barrier(image.mip_levels - 1,
+		vk::ImageLayout::eTransferDstOptimal,
+		vk::ImageLayout::eShaderReadOnlyOptimal,
+		vk::AccessFlagBits2::eTransferWrite,
+		vk::AccessFlagBits2::eShaderSampledRead,
+		vk::PipelineStageFlagBits2::eFragmentShader);
+
+	image.layout = vk::ImageLayout::eShaderReadOnlyOptimal;
+
+	return true;
+}
+
+// Binding resources to descriptor sets
+inline void bind_descriptor_set(const vk::Device &device,
+		                const vk::DescriptorSet &dset,
+				const Image &img,
+				const vk::Sampler &sampler)
+{
+	vk::DescriptorImageInfo image_info {
+		sampler, img.view,
+		vk::ImageLayout::eShaderReadOnlyOptimal
+	};
+
+	vk::WriteDescriptorSet write {
+		dset, 0, 0, 1,
+		vk::DescriptorType::eCombinedImageSampler,
+		&image_info
+	};
+
+	device.updateDescriptorSets({write}, {});
+}
+
+inline void bind_descriptor_set(const vk::Device &device,
+		                const vk::DescriptorSet &dset,
+				const Buffer &buffer,
+				uint32_t binding)
+{
+	vk::DescriptorBufferInfo buffer_info {
+		*buffer, 0, vk::WholeSize
+	};
+
+	vk::WriteDescriptorSet write {
+		dset, binding,
+		0, 1, vk::DescriptorType::eStorageBuffer,
+		{}, &buffer_info
+	};
+
+	device.updateDescriptorSets({write}, {});
+}
+
+// Construct framebuffer from image
+inline FramebufferReturnProxy framebuffer(const vk::Device &device,
+					  const vk::RenderPass &rp,
+					  const littlevk::Image &image)
+{
+	std::array <vk::ImageView, 1> attachments = {image.view};
+
+	vk::FramebufferCreateInfo framebuffer_info {
+		{}, rp,
+		(uint32_t) attachments.size(), attachments.data(),
+		image.extent.width, image.extent.height, 1
+	};
+
+	return device.createFramebuffer(framebuffer_info);
+}
+
+// Semaphore for a submission, with the stages it waits on (or signals after)
+struct SemaphoreStage {
+	vk::Semaphore semaphore;
+	vk::PipelineStageFlags2 stage = vk::PipelineStageFlagBits2::eAllCommands;
+};
+
+// Queue submission through vkQueueSubmit2 when synchronization2 is enabled;
+// the legacy path ignores the signal stages, which it cannot express
+inline void submit(const vk::Queue &queue,
+		   const vk::ArrayProxy <const vk::CommandBuffer> &cmds,
+		   const std::vector <SemaphoreStage> &wait = {},
+		   const std::vector <SemaphoreStage> &signal = {},
+		   const vk::Fence &fence = nullptr)
+{
+	if (detail::synchronization2()) {
+		std::vector <vk::CommandBufferSubmitInfo> cmd_infos;
+		for (const vk::CommandBuffer &cmd : cmds)
+			cmd_infos.push_back(vk::CommandBufferSubmitInfo { cmd });
+
+		std::vector <vk::SemaphoreSubmitInfo> wait_infos;
+		for (const SemaphoreStage &s : wait)
+			wait_infos.push_back(vk::SemaphoreSubmitInfo { s.semaphore, 0, s.stage });
+
+		std::vector <vk::SemaphoreSubmitInfo> signal_infos;
+		for (const SemaphoreStage &s : signal)
+			signal_infos.push_back(vk::SemaphoreSubmitInfo { s.semaphore, 0, s.stage });
+
+		vk::SubmitInfo2 submit_info {
+			{}, wait_infos, cmd_infos, signal_infos
+		};
+
+		vk::Result result = queue.submit2(1, &submit_info, fence);
+		if (result != vk::Result::eSuccess) {
+			microlog::error("submit", "Queue submission failed: %s\n",
+					vk::to_string(result).c_str());
+		}
+
+		return;
+	}
+
+	std::vector <vk::Semaphore> wait_semaphores;
+	std::vector <vk::PipelineStageFlags> wait_stages;
+	for (const SemaphoreStage &s : wait) {
+		wait_semaphores.push_back(s.semaphore);
+		wait_stages.push_back(detail::legacy_stages(s.stage, vk::PipelineStageFlagBits::eTopOfPipe));
+	}
+
+	std::vector <vk::Semaphore> signal_semaphores;
+	for (const SemaphoreStage &s : signal)
+		signal_semaphores.push_back(s.semaphore);
+
+	vk::SubmitInfo submit_info {
+		(uint32_t) wait_semaphores.size(), wait_semaphores.data(), wait_stages.data(),
+		cmds.size(), cmds.data(),
+		(uint32_t) signal_semaphores.size(), signal_semaphores.data()
+	};
+
+	vk::Result result = queue.submit(1, &submit_info, fence);
+	if (result != vk::Result::eSuccess) {
+		microlog::error("submit", "Queue submission failed: %s\n",
+				vk::to_string(result).c_str());
+	}
+}
+
+// Single-time command buffer submission
+inline void submit_now(const vk::Device &device,
+		       const vk::CommandPool &pool,
+		       const vk::Queue &queue,
+		       const std::function <void (const vk::CommandBuffer &)> &function)
+{
+	vk::CommandBuffer cmd = device
+		.allocateCommandBuffers(vk::CommandBufferAllocateInfo {
+			pool, vk::CommandBufferLevel::ePrimary, 1
+		}).front();
+
+	cmd.begin({ vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
+		function(cmd);
+	cmd.end();
+
+	submit(queue, cmd);
+	queue.waitIdle();
+
+	device.freeCommandBuffers(pool, 1, &cmd);
+}
+
+// Pre-compressed (or otherwise pre-built) texture containers
+namespace texture {
+
+// Image payload plus the copy regions for every level and layer; region
+// offsets are relative to the start of the payload and suitably aligned
+struct TextureData {
+	vk::Format format = vk::Format::eUndefined;
+	vk::Extent2D extent;
+	uint32_t mip_levels = 1;
+	uint32_t array_layers = 1;
+	bool cube = false;
+
+	std::vector <uint8_t> data;
+	std::vector <vk::BufferImageCopy> regions;
+
+	vk::ImageViewType view_type() const {
+		if (cube)
+			return array_layers > 6 ? vk::ImageViewType::eCubeArray : vk::ImageViewType::eCube;
+
+		return array_layers > 1 ? vk::ImageViewType::e2DArray : vk::ImageViewType::e2D;
+	}
+};
+
+// Check that the device can sample images of the given format; compressed
+// formats (BCn, ASTC, ETC2) are optional features
+inline bool supported(const vk::PhysicalDevice &phdev, const vk::Format &format)
+{
+	vk::FormatProperties properties = phdev.getFormatProperties(format);
+	return bool(properties.optimalTilingFeatures & vk::FormatFeatureFlagBits::eSampledImage);
+}
+
+namespace detail {
+
+inline std::vector <uint8_t> read_bytes(const std::filesystem::path &path)
+{
+	std::ifstream f(path, std::ios::binary | std::ios::ate);
+	if (!f.good()) {
+		microlog::error("texture", "Could not open file: %s\n", path.c_str());
+		return {};
+	}
+
+	std::vector <uint8_t> bytes(f.tellg());
+	f.seekg(0, f.beg);
+	f.read((char *) bytes.data(), bytes.size());
+	return bytes;
+}
+
+template <typename T>
+inline T read(const std::vector <uint8_t> &bytes, size_t offset)
+{
+	T value;
+	std::memcpy(&value, bytes.data() + offset, sizeof(T));
+	return value;
+}
+
+inline vk::Extent3D level_extent(const vk::Extent2D &extent, uint32_t level)
+{
+	return vk::Extent3D {
+		std::max(extent.width >> level, 1u),
+		std::max(extent.height >> level, 1u),
+		1
+	};
+}
+
+// Copy a surface from the file into the payload; buffer offsets must be
+// multiples of four and of the texel block size
+inline vk::DeviceSize append(std::vector <uint8_t> &payload,
+			     const std::vector <uint8_t> &bytes,
+			     size_t offset, size_t size,
+			     const FormatBlock &block)
+{
+	vk::DeviceSize alignment = std::lcm <vk::DeviceSize> (4, block.size);
+	vk::DeviceSize start = (payload.size() + alignment - 1)/alignment * alignment;
+
+	payload.resize(start);
+	payload.insert(payload.end(), bytes.begin() + offset, bytes.begin() + offset + size);
+
+	return start;
+}
+
+} // namespace detail
+
+// Khronos KTX2 containers; supercompressed (and Basis Universal) payloads
+// are not supported since they need a transcoder
+inline std::optional <TextureData> ktx2(const std::filesystem::path &path)
+{
+	static constexpr uint8_t identifier[12] {
+		0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32,
+		0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A
+	};
+
+	// Identifier, header and index
+	static constexpr size_t level_index_offset = 80;
+
+	TextureData texture;
+
+	const auto bytes = detail::read_bytes(path);
+	if (bytes.size() < level_index_offset
+			|| std::memcmp(bytes.data(), identifier, sizeof(identifier))) {
+		microlog::error("texture::ktx2", "%s is not a KTX2 file\n", path.c_str());
+		return std::nullopt;
+	}
+
+	uint32_t format = detail::read <uint32_t> (bytes, 12);
+	uint32_t width = detail::read <uint32_t> (bytes, 20);
+	uint32_t height = detail::read <uint32_t> (bytes, 24);
+	uint32_t depth = detail::read <uint32_t> (bytes, 28);
+	uint32_t layers = detail::read <uint32_t> (bytes, 32);
+	uint32_t faces = detail::read <uint32_t> (bytes, 36);
+	uint32_t levels = detail::read <uint32_t> (bytes, 40);
+	uint32_t supercompression = detail::read <uint32_t> (bytes, 44);
+
+	if (format == VK_FORMAT_UNDEFINED || supercompression != 0) {
+		microlog::error("texture::ktx2",
+			"%s uses a supercompressed or Basis Universal "
+			"payload, which is unsupported\n", path.c_str());
+		return std::nullopt;
+	}
+
+	if (depth > 1) {
+		microlog::error("texture::ktx2",
+			"%s is a 3D texture, which is unsupported\n",
+			path.c_str());
+		return std::nullopt;
+	}
+
+	texture.format = vk::Format(format);
+
+	FormatBlock block = format_block(texture.format);
+	if (block.size == 0) {
+		microlog::error("texture::ktx2", "%s has an unsupported format\n", path.c_str());
+		return std::nullopt;
+	}
+
+	texture.extent = vk::Extent2D { width, std::max(height, 1u) };
+	texture.mip_levels = std::max(levels, 1u);
+	texture.array_layers = std::max(layers, 1u) * std::max(faces, 1u);
+	texture.cube = (faces == 6);
+
+	// Level index; level zero comes first, each level holds all layers
+	size_t index_end = level_index_offset + 24 * texture.mip_levels;
+	if (bytes.size() < index_end) {
+		microlog::error("texture::ktx2", "%s is truncated\n", path.c_str());
+		return std::nullopt;
+	}
+
+	for (uint32_t i = 0; i < texture.mip_levels; i++) {
+		size_t entry = level_index_offset + 24 * i;
+		uint64_t offset = detail::read <uint64_t> (bytes, entry);
+		uint64_t length = detail::read <uint64_t> (bytes, entry + 8);
+		if (offset + length > bytes.size()) {
+			microlog::error("texture::ktx2", "%s is truncated\n", path.c_str());
+			return std::nullopt;
+		}
+
+		texture.regions.push_back(vk::BufferImageCopy {
+			detail::append(texture.data, bytes, offset, length, block), 0, 0,
+			vk::ImageSubresourceLayers {
+				vk::ImageAspectFlagBits::eColor,
+				i, 0, texture.array_layers
+			},
+			vk::Offset3D { 0, 0, 0 },
+			detail::level_extent(texture.extent, i)
+		});
+	}
+
+	return texture;
+}
+
+// DirectDraw surfaces; BCn through the DX10 extension header or the legacy
+// DXT1/DXT3/DXT5/ATI1/ATI2 FourCC codes
+inline std::optional <TextureData> dds(const std::filesystem::path &path)
+{
+	static constexpr uint32_t DDSD_MIPMAPCOUNT = 0x20000;
+	static constexpr uint32_t DDSCAPS2_CUBEMAP = 0x200;
+	static constexpr uint32_t DDS_RESOURCE_MISC_TEXTURECUBE = 0x4;
+
+	auto fourcc = [](const char (&code)[5]) {
+		return uint32_t(code[0]) | (uint32_t(code[1]) << 8)
+			| (uint32_t(code[2]) << 16) | (uint32_t(code[3]) << 24);
+	};
+
+	TextureData texture;
+
+	const auto bytes = detail::read_bytes(path);
+	if (bytes.size() < 128 || detail::read <uint32_t> (bytes, 0) != fourcc("DDS ")) {
+		microlog::error("texture::dds", "%s is not a DDS file\n", path.c_str());
+		return std::nullopt;
+	}
+
+	uint32_t flags = detail::read <uint32_t> (bytes, 8);
+	uint32_t height = detail::read <uint32_t> (bytes, 12);
+	uint32_t width = detail::read <uint32_t> (bytes, 16);
+	uint32_t levels = detail::read <uint32_t> (bytes, 28);
+	uint32_t code = detail::read <uint32_t> (bytes, 84);
+	uint32_t caps2 = detail::read <uint32_t> (bytes, 112);
+
+	size_t offset = 128;
+	bool cube = (caps2 & DDSCAPS2_CUBEMAP);
+	uint32_t layers = cube ? 6 : 1;
+
+	if (code == fourcc("DX10")) {
+		if (bytes.size() < 148) {
+			microlog::error("texture::dds", "%s is truncated\n", path.c_str());
+			return std::nullopt;
+		}
+
+		uint32_t dxgi = detail::read <uint32_t> (bytes, 128);
+		uint32_t misc = detail::read <uint32_t> (bytes, 136);
+		uint32_t array_size = std::max(detail::read <uint32_t> (bytes, 140), 1u);
+
+		switch (dxgi) {
+		case 28: texture.format = vk::Format::eR8G8B8A8Unorm; break;
+		case 29: texture.format = vk::Format::eR8G8B8A8Srgb; break;
+		case 71: texture.format = vk::Format::eBc1RgbaUnormBlock; break;
+		case 72: texture.format = vk::Format::eBc1RgbaSrgbBlock; break;
+		case 74: texture.format = vk::Format::eBc2UnormBlock; break;
+		case 75: texture.format = vk::Format::eBc2SrgbBlock; break;
+		case 77: texture.format = vk::Format::eBc3UnormBlock; break;
+		case 78: texture.format = vk::Format::eBc3SrgbBlock; break;
+		case 80: texture.format = vk::Format::eBc4UnormBlock; break;
+		case 81: texture.format = vk::Format::eBc4SnormBlock; break;
+		case 83: texture.format = vk::Format::eBc5UnormBlock; break;
+		case 84: texture.format = vk::Format::eBc5SnormBlock; break;
+		case 87: texture.format = vk::Format::eB8G8R8A8Unorm; break;
+		case 91: texture.format = vk::Format::eB8G8R8A8Srgb; break;
+		case 95: texture.format = vk::Format::eBc6HUfloatBlock; break;
+		case 96: texture.format = vk::Format::eBc6HSfloatBlock; break;
+		case 98: texture.format = vk::Format::eBc7UnormBlock; break;
+		case 99: texture.format = vk::Format::eBc7SrgbBlock; break;
+		default:
+			break;
+		}
+
+		// The extension header describes cube maps through its own flags
+		cube = (misc & DDS_RESOURCE_MISC_TEXTURECUBE);
+		layers = array_size * (cube ? 6 : 1);
+		offset = 148;
+	} else if (code == fourcc("DXT1")) {
+		texture.format = vk::Format::eBc1RgbaUnormBlock;
+	} else if (code == fourcc("DXT3")) {
+		texture.format = vk::Format::eBc2UnormBlock;
+	} else if (code == fourcc("DXT5")) {
+		texture.format = vk::Format::eBc3UnormBlock;
+	} else if (code == fourcc("ATI1") || code == fourcc("BC4U")) {
+		texture.format = vk::Format::eBc4UnormBlock;
+	} else if (code == fourcc("ATI2") || code == fourcc("BC5U")) {
+		texture.format = vk::Format::eBc5UnormBlock;
+	}
+
+	FormatBlock block = format_block(texture.format);
+	if (block.size == 0) {
+		microlog::error("texture::dds", "%s has an unsupported format\n", path.c_str());
+		return std::nullopt;
+	}
+
+	texture.extent = vk::Extent2D { width, height };
+	texture.mip_levels = (flags & DDSD_MIPMAPCOUNT) ? std::max(levels, 1u) : 1;
+	texture.array_layers = layers;
+	texture.cube = cube;
+
+	// Surfaces are stored layer by layer, each with its full mip chain
+	for (uint32_t layer = 0; layer < texture.array_layers; layer++) {
+		for (uint32_t level = 0; level < texture.mip_levels; level++) {
+			vk::Extent3D extent = detail::level_extent(texture.extent, level);
+			vk::DeviceSize size = block.bytes({ extent.width, extent.height });
+			if (offset + size > bytes.size()) {
+				microlog::error("texture::dds", "%s is truncated\n", path.c_str());
+				return std::nullopt;
+			}
+
+			texture.regions.push_back(vk::BufferImageCopy {
+				detail::append(texture.data, bytes, offset, size, block), 0, 0,
+				vk::ImageSubresourceLayers {
+					vk::ImageAspectFlagBits::eColor,
+					level, layer, 1
+				},
+				vk::Offset3D { 0, 0, 0 },
+				extent
+			});
+
+			offset += size;
+		}
+	}
+
+	return texture;
+}
+
+// Pick the loader from the file extension
+inline std::optional <TextureData> load(const std::filesystem::path &path)
+{
+	std::string extension = path.extension().string();
+	std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+
+	if (extension == ".ktx2")
+		return ktx2(path);
+	if (extension == ".dds")
+		return dds(path);
+
+	microlog::error("texture::load", "Unsupported texture container %s\n", path.c_str());
+	return std::nullopt;
+}
+
+} // namespace texture
+
+// Upload a texture container with all of its levels in a single submission
+inline ImageReturnProxy texture_image(const vk::PhysicalDevice &phdev,
+				      const vk::Device &device,
+				      const vk::CommandPool &pool,
+				      const vk::Queue &queue,
+				      const texture::TextureData &texture)
+{
+	if (!texture::supported(phdev, texture.format)) {
+		microlog::error("texture_image",
+			"Format %s cannot be sampled on this device\n",
+			vk::to_string(texture.format).c_str());
+		return true;
+	}
+
+	vk::PhysicalDeviceMemoryProperties properties = phdev.getMemoryProperties();
+
+	ImageCreateInfo info {
+		texture.extent,
+		texture.format,
+		vk::ImageUsageFlagBits::eSampled
+			| vk::ImageUsageFlagBits::eTransferDst,
+		vk::ImageAspectFlagBits::eColor,
+		vk::ImageType::e2D,
+		texture.view_type(),
+		false,
+		texture.mip_levels,
+		texture.array_layers
+	};
+
+	Image image = littlevk::image(device, info, properties).value;
+	Buffer staging = littlevk::buffer(device, properties,
+		texture.data.size(), vk::BufferUsageFlagBits::eTransferSrc).value;
+
+	upload(device, staging, texture.data);
+
+	submit_now(device, pool, queue,
+		[&](const vk::CommandBuffer &cmd) {
+			transition <vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal> (cmd, image);
+			copy_buffer_to_image(cmd, image, staging, texture.regions, vk::ImageLayout::eTransferDstOptimal);
+			transition <vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eShaderReadOnlyOptimal> (cmd, image);
+		}
+	);
+
+	destroy_buffer(device, staging);
+	image.layout = vk::ImageLayout::eShaderReadOnlyOptimal;
+
+	return image;
+}
+
+// Ring of host visible buffers for asynchronous readback; each slot carries
+// its own command buffer and fence, so downloads are tracked individually
+struct ReadbackRing {
+	struct Slot {
+		Buffer buffer;
+		vk::CommandBuffer cmd;
+		vk::Fence fence;
+
+		// Bumped every time the slot is reused
+		std::shared_ptr <uint64_t> generation;
+	};
+
+	vk::PhysicalDeviceMemoryProperties properties;
+	vk::CommandPool pool;
+	std::vector <Slot> slots;
+	size_t next = 0;
+};
+
+inline void destroy_readback_ring(const vk::Device &device, const ReadbackRing &ring)
+{
+	for (const auto &slot : ring.slots) {
+		(void) device.waitForFences(slot.fence, VK_TRUE, UINT64_MAX);
+		device.destroyFence(slot.fence);
+		destroy_buffer(device, slot.buffer);
+	}
+
+	device.destroyCommandPool(ring.pool);
+}
+
+using ReadbackRingReturnProxy = DeviceReturnProxy <ReadbackRing, destroy_readback_ring>;
+
+inline ReadbackRingReturnProxy readback_ring(const vk::Device &device,
+					     const vk::PhysicalDeviceMemoryProperties &properties,
+					     uint32_t queue_family,
+					     uint32_t slots,
+					     vk::DeviceSize size)
+{
+	ReadbackRing ring;
+	ring.properties = properties;
+	ring.pool = device.createCommandPool({
+		vk::CommandPoolCreateFlagBits::eResetCommandBuffer,
+		queue_family
+	});
+
+	auto cmds = device.allocateCommandBuffers({
+		ring.pool, vk::CommandBufferLevel::ePrimary, slots
+	});
+
+	for (uint32_t i = 0; i < slots; i++) {
+		ReadbackRing::Slot slot;
+		slot.buffer = littlevk::buffer(device, properties, size,
+			vk::BufferUsageFlagBits::eTransferDst).value;
+		slot.cmd = cmds[i];
+		slot.fence = device.createFence({ vk::FenceCreateFlagBits::eSignaled });
+		slot.generation = std::make_shared <uint64_t> (0);
+		ring.slots.push_back(slot);
+	}
+
+	return ring;
+}
+
+// Handle to a download in flight; resolves once the slot's fence signals.
+// The data must be retrieved before the ring wraps around to the same slot
+struct ReadbackFuture {
+	vk::Device device;
+	vk::Fence fence;
+	Buffer buffer;
+	vk::DeviceSize size;
+
+	std::shared_ptr <uint64_t> generation;
+	uint64_t expected;
+
+	bool valid() const {
+		return generation && *generation == expected;
+	}
+
+	bool ready() const {
+		return device.getFenceStatus(fence) == vk::Result::eSuccess;
+	}
+
+	void wait() const {
+		(void) device.waitForFences(fence, VK_TRUE, UINT64_MAX);
+	}
+
+	void get(void *data) const {
+		if (!valid()) {
+			microlog::error("readback",
+				"Readback slot was reused before its "
+				"data was retrieved\n");
+			return;
+		}
+
+		wait();
+
+		void *mapped = device.mapMemory(buffer.memory, 0, size);
+		std::memcpy(data, mapped, size);
+		device.unmapMemory(buffer.memory);
+	}
+
+	template <typename T>
+	void get(std::vector <T> &vec) const {
+		vec.resize((size + sizeof(T) - 1)/sizeof(T));
+		get(vec.data());
+	}
+};
+
+namespace detail {
+
+// Claim the next slot with at least size bytes, once the GPU is done with it
+inline ReadbackRing::Slot &readback_slot(const vk::Device &device,
+					 ReadbackRing &ring,
+					 vk::DeviceSize size)
+{
+	ReadbackRing::Slot &slot = ring.slots[ring.next];
+	ring.next = (ring.next + 1) % ring.slots.size();
+
+	(void) device.waitForFences(slot.fence, VK_TRUE, UINT64_MAX);
+	device.resetFences(slot.fence);
+
+	if (slot.buffer.device_size() < size) {
+		destroy_buffer(device, slot.buffer);
+		slot.buffer = littlevk::buffer(device, ring.properties, size,
+			vk::BufferUsageFlagBits::eTransferDst).value;
+	}
+
+	(*slot.generation)++;
+
+	slot.cmd.begin({ vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
+
+	return slot;
+}
+
+inline ReadbackFuture readback_submit(const vk::Device &device,
+				      const vk::Queue &queue,
+				      ReadbackRing::Slot &slot,
+				      vk::DeviceSize size,
+				      const std::vector <vk::Semaphore> &wait = {},
+				      const std::vector <vk::Semaphore> &signal = {})
+{
+	// Make the transfer visible to the host
+	pipeline_barrier(slot.cmd, vk::MemoryBarrier2 {
+		vk::PipelineStageFlagBits2::eCopy, vk::AccessFlagBits2::eTransferWrite,
+		vk::PipelineStageFlagBits2::eHost, vk::AccessFlagBits2::eHostRead
+	});
+
+	slot.cmd.end();
+
+	// Layout transitions surround the copy, so the whole batch is covered
+	std::vector <SemaphoreStage> wait_stages;
+	for (const vk::Semaphore &semaphore : wait)
+		wait_stages.push_back({ semaphore });
+
+	std::vector <SemaphoreStage> signal_stages;
+	for (const vk::Semaphore &semaphore : signal)
+		signal_stages.push_back({ semaphore });
+
+	submit(queue, slot.cmd, wait_stages, signal_stages, slot.fence);
+
+	return ReadbackFuture {
+		device, slot.fence, slot.buffer, size,
+		slot.generation, *slot.generation
+	};
+}
+
+// Waits for earlier writes to the image before copying from it, even when
+// it is already in the transfer source layout; a render pass leaving it
+// there through its final layout does not order its writes before the copy
+inline void readback_barrier(const vk::CommandBuffer &cmd,
+			     const vk::Image &image,
+			     const vk::ImageAspectFlags &aspect,
+			     const vk::ImageLayout &layout)
+{
+	vk::ImageMemoryBarrier2 barrier {
+		vk::PipelineStageFlagBits2::eAllCommands, vk::AccessFlagBits2::eMemoryWrite,
+		vk::PipelineStageFlagBits2::eCopy, vk::AccessFlagBits2::eTransferRead,
+		layout, vk::ImageLayout::eTransferSrcOptimal,
+		VK_QUEUE_FAMILY_IGNORED,
+		VK_QUEUE_FAMILY_IGNORED,
+		image,
+		vk::ImageSubresourceRange {
+			aspect,
+			0, VK_REMAINING_MIP_LEVELS,
+			0, VK_REMAINING_ARRAY_LAYERS
+		}
+	};
+
+	pipeline_barrier(cmd, barrier);
+}
+
+} // namespace detail
+
+// Asynchronous downloads; the copy is submitted right away (after all
+// previously submitted work on the queue) and the CPU is free to continue
+inline ReadbackFuture download_async(const vk::Device &device,
+				     const vk::Queue &queue,
+				     ReadbackRing &ring,
+				     const Buffer &buffer,
+				     vk::DeviceSize size = 0)
+{
+	// By default the whole buffer is read back
+	if (size == 0)
+		size = buffer.device_size();
+
+	ReadbackRing::Slot &slot = detail::readback_slot(device, ring, size);
+
+	// Wait for earlier writes to the source
+	detail::pipeline_barrier(slot.cmd, vk::MemoryBarrier2 {
+		vk::PipelineStageFlagBits2::eAllCommands, vk::AccessFlagBits2::eMemoryWrite,
+		vk::PipelineStageFlagBits2::eCopy, vk::AccessFlagBits2::eTransferRead
+	});
+
+	slot.cmd.copyBuffer(*buffer, *slot.buffer, vk::BufferCopy { 0, 0, size });
+
+	return detail::readback_submit(device, queue, slot, size);
+}
+
+inline ReadbackFuture download_async(const vk::Device &device,
+				     const vk::Queue &queue,
+				     ReadbackRing &ring,
+				     const Image &image,
+				     const vk::ImageLayout &layout)
+{
+	std::vector <vk::BufferImageCopy> regions {
+		ImageCopyRegion()
+			.aspect(copy_aspect(image))
+			.layers(0, image.array_layers)
+			.extent(image.extent)
+	};
+
+	vk::DeviceSize size = region_size(regions.front(), image.format);
+	ReadbackRing::Slot &slot = detail::readback_slot(device, ring, size);
+
+	detail::readback_barrier(slot.cmd, *image, copy_aspect(image), layout);
+
+	copy_image_to_buffer(slot.cmd, image, slot.buffer, regions, vk::ImageLayout::eTransferSrcOptimal);
+
+	if (layout != vk::ImageLayout::eTransferSrcOptimal)
+		transition(slot.cmd, image, vk::ImageLayout::eTransferSrcOptimal, layout);
+
+	return detail::readback_submit(device, queue, slot, size);
+}
+
+// Frames produced by offscreen rendering, handed to a sink once read back
+struct OffscreenFrame {
+	uint64_t index;
+	vk::Extent2D extent;
+	vk::Format format;
+	std::vector <uint8_t> data;
+};
+
+using FrameSink = std::function <void (const OffscreenFrame &)>;
+
+// Offscreen stand-in for a swapchain; render passes targeting these images
+// should leave them in the transfer source layout (or whatever layout is set)
+struct OffscreenChain {
+	vk::Device device;
+	vk::Format format;
+	vk::Extent2D extent;
+	vk::ImageLayout layout = vk::ImageLayout::eTransferSrcOptimal;
+
+	std::vector <Image> images;
+	ReadbackRing ring;
+
+	FrameSink sink;
+
+	struct Pending {
+		uint32_t image;
+		uint64_t frame;
+		ReadbackFuture future;
+	};
+
+	std::queue <Pending> pending;
+	std::vector <bool> busy;
+	uint32_t next = 0;
+	uint64_t frame = 0;
+
+	// Hand the oldest download to the sink (blocking)
+	void resolve() {
+		Pending p = pending.front();
+		pending.pop();
+
+		OffscreenFrame out { p.frame, extent, format, {} };
+		p.future.get(out.data);
+		busy[p.image] = false;
+
+		if (sink)
+			sink(out);
+	}
+
+	// Resolve every download that has completed, in order
+	void poll() {
+		while (!pending.empty() && pending.front().future.ready())
+			resolve();
+	}
+
+	// Resolve all outstanding downloads
+	void flush() {
+		while (!pending.empty())
+			resolve();
+	}
+};
+
+inline void destroy_offscreen_chain(const vk::Device &device, const OffscreenChain &chain)
+{
+	for (const Image &image : chain.images)
+		destroy_image(device, image);
+
+	destroy_readback_ring(device, chain.ring);
+}
+
+using OffscreenChainReturnProxy = DeviceReturnProxy <OffscreenChain, destroy_offscreen_chain>;
+
+inline OffscreenChainReturnProxy offscreen_chain(const vk::Device &device,
+						 const vk::PhysicalDeviceMemoryProperties &properties,
+						 uint32_t queue_family,
+						 const vk::Extent2D &extent,
+						 const vk::Format &format,
+						 uint32_t count,
+						 const FrameSink &sink = {})
+{
+	OffscreenChain chain;
+	chain.device = device;
+	chain.format = format;
+	chain.extent = extent;
+	chain.sink = sink;
+	chain.busy.resize(count, false);
+
+	for (uint32_t i = 0; i < count; i++) {
+		ImageCreateInfo info {
+			extent, format,
+			vk::ImageUsageFlagBits::eColorAttachment
+				| vk::ImageUsageFlagBits::eTransferSrc,
+			vk::ImageAspectFlagBits::eColor
+		};
+
+		chain.images.push_back(image(device, info, properties).value);
+	}
+
+	vk::DeviceSize size = format_block(format).bytes(extent);
+	chain.ring = readback_ring(device, properties, queue_family, count, size).value;
+
+	return chain;
+}
+
+// Same shape as the swapchain variants; acquisition signals the frame's
+// image available semaphore so render loops can stay unchanged
+inline SurfaceOperation acquire_image(const vk::Device &device,
+				      const vk::Queue &queue,
+				      OffscreenChain &chain,
+				      const PresentSyncronization::Frame &sync_frame)
+{
+	// Wait for previous frame to finish
+	(void) device.waitForFences(sync_frame.in_flight, VK_TRUE, UINT64_MAX);
+	device.resetFences(sync_frame.in_flight);
+
+	uint32_t index = chain.next;
+	chain.next = (chain.next + 1) % chain.images.size();
+
+	// Image is still being read back
+	while (chain.busy[index])
+		chain.resolve();
+
+	submit(queue, {}, {}, { { sync_frame.image_available } });
+
+	return { SurfaceOperation::eOk, index };
+}
+
+inline SurfaceOperation present_image(const vk::Queue &queue,
+				      OffscreenChain &chain,
+				      const std::optional <PresentSyncronization::Frame> &sync_frame,
+				      uint32_t index)
+{
+	// Consume the render finished semaphore
+	if (sync_frame)
+		submit(queue, {}, { { sync_frame->render_finished } });
+
+	ReadbackFuture future = download_async(chain.device, queue,
+		chain.ring, chain.images[index], chain.layout);
+
+	chain.busy[index] = true;
+	chain.pending.push({ index, chain.frame++, future });
+	chain.poll();
+
+	return { SurfaceOperation::eOk, 0 };
+}
+
+namespace detail {
+
+// Eight bit RGB(A) pixels of a frame, swizzled from BGRA if needed
+inline bool frame_pixels(const char *header, const OffscreenFrame &frame,
+			 std::vector <uint8_t> &pixels, uint32_t channels)
+{
+	if (format_block(frame.format).size != 4) {
+		microlog::error(header, "Unsupported format %s\n",
+				vk::to_string(frame.format).c_str());
+		return false;
+	}
+
+	bool bgra = (frame.format == vk::Format::eB8G8R8A8Unorm
+			|| frame.format == vk::Format::eB8G8R8A8Srgb);
+
+	size_t count = size_t(frame.extent.width) * frame.extent.height;
+	pixels.resize(channels * count);
+	for (size_t i = 0; i < count; i++) {
+		const uint8_t *px = &frame.data[4 * i];
+		uint8_t *out = &pixels[channels * i];
+		out[0] = bgra ? px[2] : px[0];
+		out[1] = px[1];
+		out[2] = bgra ? px[0] : px[2];
+		if (channels == 4)
+			out[3] = px[3];
+	}
+
+	return true;
+}
+
+inline std::filesystem::path frame_path(const std::filesystem::path &directory,
+					const OffscreenFrame &frame,
+					const char *extension)
+{
+	char name[32];
+	snprintf(name, sizeof(name), "frame%06lu.%s", (unsigned long) frame.index, extension);
+	return directory / name;
+}
+
+} // namespace detail
+
+// Sink writing each frame as a binary PPM into a directory; only for four
+// channel, eight bit formats
+inline FrameSink ppm_sink(const std::filesystem::path &directory)
+{
+	std::filesystem::create_directories(directory);
+
+	return [directory](const OffscreenFrame &frame) {
+		std::vector <uint8_t> rgb;
+		if (!detail::frame_pixels("ppm_sink", frame, rgb, 3))
+			return;
+
+		std::ofstream file(detail::frame_path(directory, frame, "ppm"), std::ios::binary);
+		file << "P6\n" << frame.extent.width << " " << frame.extent.height << "\n255\n";
+		file.write((const char *) rgb.data(), rgb.size());
+	};
+}
+
+namespace detail {
+
+inline void push_be32(std::vector <uint8_t> &bytes, uint32_t value)
+{
+	bytes.push_back(value >> 24);
+	bytes.push_back(value >> 16);
+	bytes.push_back(value >> 8);
+	bytes.push_back(value);
+}
+
+inline uint32_t crc32(const uint8_t *data, size_t size)
+{
+	static const std::array <uint32_t, 256> table = [] {
+		std::array <uint32_t, 256> t;
+		for (uint32_t n = 0; n < 256; n++) {
+			uint32_t c = n;
+			for (int k = 0; k < 8; k++)
+				c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : (c >> 1);
+			t[n] = c;
+		}
+
+		return t;
+	} ();
+
+	uint32_t crc = 0xFFFFFFFFu;
+	for (size_t i = 0; i < size; i++)
+		crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+
+	return ~crc;
+}
+
+// Minimal PNG encoder; the image data is stored without compression,
+// which keeps encoding cheap enough to follow the render rate
+inline std::vector <uint8_t> png_encode(uint32_t width, uint32_t height,
+					const std::vector <uint8_t> &rgba)
+{
+	// Scanlines, each prefixed with filter type zero
+	size_t stride = 4 * size_t(width);
+
+	std::vector <uint8_t> raw;
+	raw.reserve((stride + 1) * height);
+	for (uint32_t y = 0; y < height; y++) {
+		raw.push_back(0);
+		raw.insert(raw.end(), rgba.begin() + y * stride, rgba.begin() + (y + 1) * stride);
+	}
+
+	// Zlib stream of stored deflate blocks
+	std::vector <uint8_t> zlib { 0x78, 0x01 };
+
+	size_t offset = 0;
+	do {
+		uint16_t n = std::min <size_t> (0xFFFF, raw.size() - offset);
+		zlib.push_back(offset + n == raw.size());
+		zlib.push_back(n & 0xFF);
+		zlib.push_back(n >> 8);
+		zlib.push_back(~n & 0xFF);
+		zlib.push_back((~n >> 8) & 0xFF);
+		zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + n);
+		offset += n;
+	} while (offset < raw.size());
+
+	uint32_t a = 1;
+	uint32_t b = 0;
+	for (uint8_t byte : raw) {
+		a = (a + byte) % 65521;
+		b = (b + a) % 65521;
+	}
+
+	push_be32(zlib, (b << 16) | a);
+
+	// Assemble the chunks
+	std::vector <uint8_t> png { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+
+	auto chunk = [&](const char *type, const std::vector <uint8_t> &data) {
+		push_be32(png, data.size());
+
+		size_t start = png.size();
+		png.insert(png.end(), type, type + 4);
+		png.insert(png.end(), data.begin(), data.end());
+		push_be32(png, crc32(&png[start], png.size() - start));
+	};
+
+	std::vector <uint8_t> header;
+	push_be32(header, width);
+	push_be32(header, height);
+	header.insert(header.end(), { 8, 6, 0, 0, 0 });
+
+	chunk("IHDR", header);
+	chunk("IDAT", zlib);
+	chunk("IEND", {});
+
+	return png;
+}
+
+} // namespace detail
+
+// Sink writing each frame as an RGBA PNG into a directory
+inline FrameSink png_sink(const std::filesystem::path &directory)
+{
+	std::filesystem::create_directories(directory);
+
+	return [directory](const OffscreenFrame &frame) {
+		std::vector <uint8_t> rgba;
+		if (!detail::frame_pixels("png_sink", frame, rgba, 4))
+			return;
+
+		std::vector <uint8_t> png = detail::png_encode(frame.extent.width, frame.extent.height, rgba);
+
+		std::ofstream file(detail::frame_path(directory, frame, "png"), std::ios::binary);
+		file.write((const char *) png.data(), png.size());
+	};
+}
+
+// Sink appending the frames, as read back, to a single file
+inline FrameSink raw_sink(const std::filesystem::path &path)
+{
+	auto file = std::make_shared <std::ofstream> (path, std::ios::binary);
+
+	return [file](const OffscreenFrame &frame) {
+		file->write((const char *) frame.data.data(), frame.data.size());
+	};
+}
+
+namespace detail {
+
+// Writes into a pipe whose reader may have exited; SIGPIPE is blocked on the
+// calling thread for the duration, so the failure shows up as EPIPE instead
+// of terminating the process
+inline bool write_pipe(FILE *pipe, const void *data, size_t size)
+{
+#ifdef __linux__
+	sigset_t sigpipe;
+	sigset_t previous;
+	sigemptyset(&sigpipe);
+	sigaddset(&sigpipe, SIGPIPE);
+	pthread_sigmask(SIG_BLOCK, &sigpipe, &previous);
+#endif
+
+	errno = 0;
+	bool written = (fwrite(data, 1, size, pipe) == size);
+	int error = errno;
+
+#ifdef __linux__
+	// Consume the signal raised by the failed write before unblocking
+	if (error == EPIPE && !sigismember(&previous, SIGPIPE)) {
+		timespec zero { 0, 0 };
+		while (sigtimedwait(&sigpipe, nullptr, &zero) == SIGPIPE);
+	}
+
+	pthread_sigmask(SIG_SETMASK, &previous, nullptr);
+#endif
+
+	errno = error;
+	return written;
+}
+
+} // namespace detail
+
+// Sink streaming the frames, as read back, into the standard input of a
+// process; e.g. ffmpeg -f rawvideo -pix_fmt bgra -s WxH -i - out.mp4
+inline FrameSink pipe_sink(const std::string &command)
+{
+	std::shared_ptr <FILE> pipe(popen(command.c_str(), "w"),
+		[](FILE *f) { if (f) pclose(f); });
+
+	if (!pipe) {
+		microlog::error("pipe_sink", "Failed to open pipe to \"%s\"\n", command.c_str());
+		return {};
+	}
+
+	// Unbuffered, so nothing is left to flush (and fail) when closing
+	setvbuf(pipe.get(), nullptr, _IONBF, 0);
+
+	auto closed = std::make_shared <bool> (false);
+
+	return [pipe, closed](const OffscreenFrame &frame) {
+		if (*closed)
+			return;
+
+		if (detail::write_pipe(pipe.get(), frame.data.data(), frame.data.size()))
+			return;
+
+		if (errno == EPIPE) {
+			microlog::error("pipe_sink", "Reader closed the pipe at frame %lu, "
+				"dropping the remaining frames\n", (unsigned long) frame.index);
+			*closed = true;
+		} else {
+			microlog::error("pipe_sink", "Failed to write frame %lu\n", (unsigned long) frame.index);
+		}
+	};
+}
+
+// Pipelined capture of presented or offscreen images; copies are submitted
+// into a readback ring and finished frames go to the sink on a worker thread
+struct FrameCapture {
+	vk::Device device;
+	vk::Format format;
+	vk::Extent2D extent;
+
+	ReadbackRing ring;
+	std::vector <vk::Semaphore> captured;
+	FrameSink sink;
+
+	struct Job {
+		uint32_t slot;
+		uint64_t frame;
+		ReadbackFuture future;
+	};
+
+	std::thread worker;
+	std::mutex lock;
+	std::condition_variable cv;
+	std::queue <Job> jobs;
+	std::vector <bool> busy;
+	bool running = false;
+	uint64_t frame = 0;
+
+	bool start(const vk::Device &,
+		   const vk::PhysicalDeviceMemoryProperties &,
+		   uint32_t,
+		   const vk::Extent2D &,
+		   const vk::Format &,
+		   const FrameSink &,
+		   uint32_t = 3);
+
+	// Copies the image once the frame has rendered; when a frame is given,
+	// the returned one should be presented with instead
+	std::optional <PresentSyncronization::Frame> capture(const vk::Queue &,
+							     const vk::Image &,
+							     const vk::ImageLayout &,
+							     const std::optional <PresentSyncronization::Frame> & = std::nullopt);
+
+	std::optional <PresentSyncronization::Frame> capture(const vk::Queue &queue,
+							     const Image &image,
+							     const vk::ImageLayout &layout,
+							     const std::optional <PresentSyncronization::Frame> &sync_frame = std::nullopt) {
+		return capture(queue, *image, layout, sync_frame);
+	}
+
+	// Drains outstanding frames and releases the ring
+	void stop();
+
+	void work();
+
+	~FrameCapture() {
+		stop();
+	}
+};
+
+inline bool FrameCapture::start(const vk::Device &device_,
+				const vk::PhysicalDeviceMemoryProperties &properties,
+				uint32_t queue_family,
+				const vk::Extent2D &extent_,
+				const vk::Format &format_,
+				const FrameSink &sink_,
+				uint32_t slots)
+{
+	device = device_;
+	extent = extent_;
+	format = format_;
+	sink = sink_;
+
+	vk::DeviceSize size = format_block(format).bytes(extent);
+	ring = readback_ring(device, properties, queue_family, slots, size).value;
+
+	for (uint32_t i = 0; i < slots; i++)
+		captured.push_back(device.createSemaphore({}));
+
+	busy.assign(slots, false);
+	frame = 0;
+	running = true;
+	worker = std::thread(&FrameCapture::work, this);
+
+	return true;
+}
+
+inline std::optional <PresentSyncronization::Frame>
+FrameCapture::capture(const vk::Queue &queue,
+		      const vk::Image &image,
+		      const vk::ImageLayout &layout,
+		      const std::optional <PresentSyncronization::Frame> &sync_frame)
+{
+	uint32_t index = ring.next;
+
+	// Wait for the worker to release the slot
+	{
+		std::unique_lock <std::mutex> guard(lock);
+		cv.wait(guard, [&]() { return !busy[index]; });
+		busy[index] = true;
+	}
+
+	vk::DeviceSize size = format_block(format).bytes(extent);
+	ReadbackRing::Slot &slot = detail::readback_slot(device, ring, size);
+
+	std::vector <vk::BufferImageCopy> regions {
+		ImageCopyRegion().extent(extent)
+	};
+
+	detail::readback_barrier(slot.cmd, image, vk::ImageAspectFlagBits::eColor, layout);
+
+	copy_image_to_buffer(slot.cmd, image, slot.buffer, regions, vk::ImageLayout::eTransferSrcOptimal);
+
+	if (layout != vk::ImageLayout::eTransferSrcOptimal)
+		transition(slot.cmd, image, vk::ImageLayout::eTransferSrcOptimal, layout);
+
+	std::vector <vk::Semaphore> wait;
+	std::vector <vk::Semaphore> signal;
+	if (sync_frame) {
+		wait.push_back(sync_frame->render_finished);
+		signal.push_back(captured[index]);
+	}
+
+	ReadbackFuture future = detail::readback_submit(device, queue, slot, size, wait, signal);
+
+	{
+		std::lock_guard <std::mutex> guard(lock);
+		jobs.push({ index, frame++, future });
+	}
+
+	cv.notify_all();
+
+	if (!sync_frame)
+		return std::nullopt;
+
+	return PresentSyncronization::Frame {
+		sync_frame->image_available,
+		captured[index],
+		sync_frame->in_flight
+	};
+}
+
+inline void FrameCapture::work()
+{
+	while (true) {
+		std::optional <Job> job;
+
+		{
+			std::unique_lock <std::mutex> guard(lock);
+			cv.wait(guard, [&]() { return !jobs.empty() || !running; });
+
+			// Stopped and drained
+			if (jobs.empty())
+				return;
+
+			job = jobs.front();
+			jobs.pop();
+		}
+
+		OffscreenFrame out { job->frame, extent, format, {} };
+		job->future.get(out.data);
+
+		{
+			std::lock_guard <std::mutex> guard(lock);
+			busy[job->slot] = false;
+		}
+
+		cv.notify_all();
+
+		if (sink)
+			sink(out);
+	}
+}
+
+inline void FrameCapture::stop()
+{
+	if (!running)
+		return;
+
+	{
+		std::lock_guard <std::mutex> guard(lock);
+		running = false;
+	}
+
+	cv.notify_all();
+	worker.join();
+
+	device.waitIdle();
+	for (const vk::Semaphore &semaphore : captured)
+		device.destroySemaphore(semaphore);
+
+	destroy_readback_ring(device, ring);
+	captured.clear();
+}
+
+// Class based initialization without a window or surface; requires
+// config().headless to be set before the instance is first used
+struct HeadlessSkeleton {
+	vk::Device device;
+	vk::PhysicalDevice phdev = nullptr;
+
+	vk::Queue graphics_queue;
+	uint32_t graphics_family;
+
+	OffscreenChain swapchain;
+
+	bool skeletonize(const vk::PhysicalDevice &,
+			 const vk::Extent2D &,
+			 const std::vector <const char *> &,
+			 const std::optional <vk::PhysicalDeviceFeatures2KHR> & = std::nullopt,
+			 uint32_t = 2,
+			 const vk::Format & = vk::Format::eB8G8R8A8Unorm,
+			 const FrameSink & = {});
+
+	virtual ~HeadlessSkeleton() = default;
+
+	virtual bool drop();
+
+	float aspect_ratio() const;
+};
+
+inline bool HeadlessSkeleton::skeletonize(
+	const vk::PhysicalDevice &phdev_, const vk::Extent2D &extent,
+	const std::vector <const char *> &device_extensions,
+	const std::optional <vk::PhysicalDeviceFeatures2KHR> &features,
+	uint32_t images,
+	const vk::Format &format,
+	const FrameSink &sink)
+{
+#ifndef LITTLEVK_NO_GLFW
+	if (!config().headless) {
+		microlog::warning("HeadlessSkeleton",
+			"config().headless is not set, "
+			"GLFW will still be initialized\n");
+	}
+#endif
+
+	phdev = phdev_;
+	graphics_family = find_graphics_queue_family(phdev);
+
+	uint32_t count = phdev.getQueueFamilyProperties()[graphics_family].queueCount;
+	device = littlevk::device(phdev, graphics_family, count, device_extensions, features);
+	graphics_queue = device.getQueue(graphics_family, 0);
+
+	swapchain = offscreen_chain(device, phdev.getMemoryProperties(),
+		graphics_family, extent, format, images, sink).value;
+
+	return true;
+}
+
+inline bool HeadlessSkeleton::drop()
+{
+	device.waitIdle();
+	swapchain.flush();
+	destroy_offscreen_chain(device, swapchain);
+	detail::forget_device(device);
+	device.destroy();
+	return true;
+}
+
+inline float HeadlessSkeleton::aspect_ratio() const
+{
+	return (float) swapchain.extent.width / (float) swapchain.extent.height;
+}
+
+namespace detail {
+
+// Command buffers submitted without waiting, kept until their fence signals
+struct RetiredCommands {
+	struct Entry {
+		vk::CommandPool pool;
+		vk::CommandBuffer cmd;
+		vk::Fence fence;
+	};
+
+	std::mutex lock;
+	std::vector <Entry> pending;
+	std::vector <vk::Fence> fences;
+};
+
+// Frees completed command buffers and returns a free fence
+inline vk::Fence retire_fence(const vk::Device &device, RetiredCommands &retired)
+{
+	std::lock_guard <std::mutex> guard(retired.lock);
+
+	auto completed = [&](const RetiredCommands::Entry &entry) {
+		if (device.getFenceStatus(entry.fence) != vk::Result::eSuccess)
+			return false;
+
+		device.freeCommandBuffers(entry.pool, entry.cmd);
+		device.resetFences(entry.fence);
+		retired.fences.push_back(entry.fence);
+		return true;
+	};
+
+	std::erase_if(retired.pending, completed);
+
+	if (retired.fences.empty())
+		return device.createFence({});
+
+	vk::Fence fence = retired.fences.back();
+	retired.fences.pop_back();
+	return fence;
+}
+
+inline void retire(RetiredCommands &retired,
+		   const vk::CommandPool &pool,
+		   const vk::CommandBuffer &cmd,
+		   const vk::Fence &fence)
+{
+	std::lock_guard <std::mutex> guard(retired.lock);
+	retired.pending.push_back({ pool, cmd, fence });
+}
+
+// Waits on everything still pending and destroys the fences; the command
+// buffers go with their pools
+inline void release_retired(const vk::Device &device, RetiredCommands &retired)
+{
+	std::lock_guard <std::mutex> guard(retired.lock);
+
+	for (const RetiredCommands::Entry &entry : retired.pending) {
+		(void) device.waitForFences(entry.fence, true, UINT64_MAX);
+		device.destroyFence(entry.fence);
+	}
+
+	for (const vk::Fence &fence : retired.fences)
+		device.destroyFence(fence);
+
+	retired.pending.clear();
+	retired.fences.clear();
+}
+
+}
+
+// Other companion functions with automatic memory management
+static void destroy_command_pool(const vk::Device &device,
+				 const vk::CommandPool &pool)
+{
+	device.destroyCommandPool(pool);
+}
+
+using CommandPoolReturnProxy = DeviceReturnProxy <vk::CommandPool, destroy_command_pool>;
+
+inline CommandPoolReturnProxy command_pool(const vk::Device &device,
+		                           const vk::CommandPoolCreateInfo &info)
+{
+	vk::CommandPool pool;
+	if (device.createCommandPool(&info, nullptr, &pool) != vk::Result::eSuccess)
+		return true;
+
+	return std::move(pool);
+}
+
+template <typename ... Args>
+inline CommandPoolReturnProxy command_pool(const vk::Device &device, const Args &... args)
+{
+	vk::CommandPoolCreateInfo info { args... };
+
+	vk::CommandPool pool;
+	if (device.createCommandPool(&info, nullptr, &pool) != vk::Result::eSuccess)
+		return true;
+
+	return std::move(pool);
+}
+
+template <typename ... Args>
+inline auto command_buffers(const vk::Device &device, const vk::CommandPool &pool, const Args &... args)
+{
+	return device.allocateCommandBuffers({ pool, args... });
+}
+
+// Recycles command buffers from per-frame, per-thread pools; once a frame's
+// fence signals its pools are reset as a whole and buffers are handed out
+// again, so steady-state frames allocate nothing
+struct CommandAllocator {
+	struct Pool {
+		vk::CommandPool pool;
+		std::vector <vk::CommandBuffer> primaries;
+		std::vector <vk::CommandBuffer> secondaries;
+		uint32_t used_primaries = 0;
+		uint32_t used_secondaries = 0;
+		uint32_t allocations = 0;
+	};
+
+	vk::Device device;
+	uint32_t threads = 0;
+	uint32_t frame = 0;
+
+	// Indexed by frame, then thread
+	std::vector <std::vector <Pool>> pools;
+
+	// One-off submits through LinkedCommandQueue; the retire list is
+	// shared with the copy held for destruction
+	vk::CommandPool submits;
+	std::shared_ptr <detail::RetiredCommands> retired;
+
+	// Waits for the fence guarding the frame's previous submission (not
+	// reset here) and then recycles every thread's pool of that frame
+	void begin_frame(uint32_t frame_, const vk::Fence &fence = nullptr) {
+		frame = frame_;
+		if (fence)
+			(void) device.waitForFences(fence, true, UINT64_MAX);
+
+		for (Pool &pool : pools[frame]) {
+			device.resetCommandPool(pool.pool);
+			pool.used_primaries = 0;
+			pool.used_secondaries = 0;
+		}
+	}
+
+	// Each thread must only use its own index
+	vk::CommandBuffer primary(uint32_t thread = 0) {
+		Pool &pool = pools[frame][thread];
+		return next(pool, pool.primaries, pool.used_primaries, vk::CommandBufferLevel::ePrimary);
+	}
+
+	vk::CommandBuffer secondary(uint32_t thread = 0) {
+		Pool &pool = pools[frame][thread];
+		return next(pool, pool.secondaries, pool.used_secondaries, vk::CommandBufferLevel::eSecondary);
+	}
+
+	vk::CommandBuffer next(Pool &pool,
+			       std::vector <vk::CommandBuffer> &buffers,
+			       uint32_t &used,
+			       vk::CommandBufferLevel level) {
+		if (used == buffers.size()) {
+			buffers.push_back(device.allocateCommandBuffers({ pool.pool, level, 1 }).front());
+			pool.allocations++;
+		}
+
+		return buffers[used++];
+	}
+
+	// Total allocations, for checking the steady state
+	uint64_t allocations() const {
+		uint64_t total = 0;
+		for (const auto &frame : pools) {
+			for (const Pool &pool : frame)
+				total += pool.allocations;
+		}
+
+		return total;
+	}
+};
+
+static void destroy_command_allocator(const vk::Device &device,
+				      const CommandAllocator &allocator)
+{
+	if (allocator.retired)
+		detail::release_retired(device, *allocator.retired);
+
+	device.destroyCommandPool(allocator.submits);
+	for (const auto &frame : allocator.pools) {
+		for (const auto &pool : frame)
+			device.destroyCommandPool(pool.pool);
+	}
+}
+
+using CommandAllocatorReturnProxy = DeviceReturnProxy <CommandAllocator, destroy_command_allocator>;
+
+inline CommandAllocatorReturnProxy command_allocator(const vk::Device &device,
+						     uint32_t queue_family,
+						     uint32_t frames,
+						     uint32_t threads = 1)
+{
+	CommandAllocator allocator;
+	allocator.device = device;
+	allocator.threads = std::max(threads, 1u);
+	allocator.pools.resize(frames);
+	allocator.retired = std::make_shared <detail::RetiredCommands> ();
+
+	vk::CommandPoolCreateInfo info { vk::CommandPoolCreateFlagBits::eTransient, queue_family };
+
+	// Pools not created yet are null, which destroying ignores
+	bool failed = device.createCommandPool(&info, nullptr, &allocator.submits) != vk::Result::eSuccess;
+	for (auto &frame : allocator.pools) {
+		frame.resize(allocator.threads);
+		for (auto &pool : frame) {
+			if (failed)
+				break;
+
+			failed = device.createCommandPool(&info, nullptr, &pool.pool) != vk::Result::eSuccess;
+		}
+	}
+
+	if (failed) {
+		destroy_command_allocator(device, allocator);
+		return true;
+	}
+
+	return allocator;
+}
+
+// State secondary command buffers continue from; either a render pass
+// instance or a dynamic rendering scope (begun with secondary contents)
+struct SecondaryInheritance {
+	vk::RenderPass render_pass;
+	uint32_t subpass = 0;
+	vk::Framebuffer framebuffer;
+
+	std::optional <std::vector <vk::Format>> color_formats;
+	vk::Format depth_format = vk::Format::eUndefined;
+
+	// Dynamic state is not inherited; set per buffer if given
+	std::optional <vk::Extent2D> viewport;
+
+	static SecondaryInheritance from_render_pass(const vk::RenderPass &render_pass,
+						     uint32_t subpass,
+						     const vk::Framebuffer &framebuffer = nullptr) {
+		SecondaryInheritance inheritance;
+		inheritance.render_pass = render_pass;
+		inheritance.subpass = subpass;
+		inheritance.framebuffer = framebuffer;
+		return inheritance;
+	}
+
+	static SecondaryInheritance from_rendering(const std::vector <vk::Format> &colors,
+						   vk::Format depth = vk::Format::eUndefined) {
+		SecondaryInheritance inheritance;
+		inheritance.color_formats = colors;
+		inheritance.depth_format = depth;
+		return inheritance;
+	}
+
+	SecondaryInheritance &with_viewport(const vk::Extent2D &extent) {
+		viewport = extent;
+		return *this;
+	}
+};
+
+// Records [begin, end) of a draw list; bound pipelines, descriptors and
+// push constants do not carry over between command buffers
+using DrawRange = std::function <void (const vk::CommandBuffer &, uint32_t, uint32_t)>;
+
+// Persistent worker threads recording draw lists into secondary command
+// buffers; workers pull chunks off a shared counter, so uneven draws balance
+// out, and the results are stitched into the primary with executeCommands.
+// Pools are per thread and per frame, and are reset when the frame is
+// recorded again (its previous submission must have completed)
+struct ParallelRecorder {
+	vk::Device device;
+	uint32_t threads = 0;
+
+	// One pool per frame and thread
+	CommandAllocator allocator;
+
+	// Current job
+	struct Job {
+		const SecondaryInheritance *inheritance;
+		const DrawRange *range;
+		uint32_t count;
+		uint32_t chunk;
+	} job;
+
+	std::atomic <uint32_t> next;
+
+	// Secondary recorded by each thread, null if it got no draws
+	std::vector <vk::CommandBuffer> recorded;
+
+	std::vector <std::thread> workers;
+	std::mutex lock;
+	std::condition_variable cv;
+	std::condition_variable done;
+	uint64_t generation = 0;
+	uint32_t remaining = 0;
+	bool running = false;
+
+	bool start(const vk::Device &, uint32_t, uint32_t, uint32_t);
+
+	// Joins the workers and destroys the pools; does nothing if stopped
+	void stop();
+
+	~ParallelRecorder() {
+		stop();
+	}
+
+	// Records the whole draw list and executes it in the primary, which
+	// must be inside the inherited render pass or rendering scope
+	void record(const vk::CommandBuffer &, uint32_t,
+		    const SecondaryInheritance &,
+		    uint32_t, const DrawRange &, uint32_t = 256);
+
+	void run(uint32_t);
+	void work(uint32_t);
+};
+
+inline bool ParallelRecorder::start(const vk::Device &device_,
+				    uint32_t queue_family,
+				    uint32_t threads_,
+				    uint32_t frames)
+{
+	device = device_;
+	threads = std::max(threads_, 1u);
+
+	auto proxy = command_allocator(device, queue_family, frames, threads);
+	if (proxy.failed)
+		return false;
+
+	allocator = proxy.value;
+	recorded.assign(threads, nullptr);
+	running = true;
+
+	// The calling thread acts as worker zero
+	for (uint32_t t = 1; t < threads; t++)
+		workers.emplace_back(&ParallelRecorder::work, this, t);
+
+	return true;
+}
+
+inline void ParallelRecorder::stop()
+{
+	if (!running)
+		return;
+
+	{
+		std::lock_guard <std::mutex> guard(lock);
+		running = false;
+	}
+
+	cv.notify_all();
+	for (std::thread &worker : workers)
+		worker.join();
+
+	workers.clear();
+
+	destroy_command_allocator(device, allocator);
+	allocator = {};
+}
+
+inline void ParallelRecorder::run(uint32_t t)
+{
+	const SecondaryInheritance &inheritance = *job.inheritance;
+
+	vk::CommandBufferInheritanceInfo inheritance_info {
+		inheritance.render_pass,
+		inheritance.subpass,
+		inheritance.framebuffer
+	};
+
+	vk::CommandBufferInheritanceRenderingInfo rendering_info;
+	if (inheritance.color_formats) {
+		rendering_info.setColorAttachmentFormats(*inheritance.color_formats);
+		rendering_info.depthAttachmentFormat = inheritance.depth_format;
+		rendering_info.rasterizationSamples = vk::SampleCountFlagBits::e1;
+		inheritance_info.pNext = &rendering_info;
+	}
+
+	vk::CommandBuffer cmd = nullptr;
+	while (true) {
+		uint32_t begin = next.fetch_add(job.chunk);
+		if (begin >= job.count)
+			break;
+
+		if (!cmd) {
+			cmd = allocator.secondary(t);
+			cmd.begin({
+				vk::CommandBufferUsageFlagBits::eOneTimeSubmit
+				| vk::CommandBufferUsageFlagBits::eRenderPassContinue,
+				&inheritance_info
+			});
+
+			if (inheritance.viewport)
+				viewport_and_scissor(cmd, *inheritance.viewport);
+		}
+
+		(*job.range)(cmd, begin, std::min(begin + job.chunk, job.count));
+	}
+
+	if (cmd)
+		cmd.end();
+
+	recorded[t] = cmd;
+}
+
+inline void ParallelRecorder::work(uint32_t t)
+{
+	uint64_t seen = 0;
+
+	while (true) {
+		{
+			std::unique_lock <std::mutex> guard(lock);
+			cv.wait(guard, [&]() { return generation != seen || !running; });
+			if (!running)
+				return;
+
+			seen = generation;
+		}
+
+		run(t);
+
+		{
+			std::lock_guard <std::mutex> guard(lock);
+			if (--remaining == 0)
+				done.notify_all();
+		}
+	}
+}
+
+inline void ParallelRecorder::record(const vk::CommandBuffer &primary,
+				     uint32_t frame,
+				     const SecondaryInheritance &inheritance,
+				     uint32_t count,
+				     const DrawRange &range,
+				     uint32_t chunk)
+{
+	job = Job { &inheritance, &range, count, std::max(chunk, 1u) };
+	next = 0;
+
+	// Workers only touch their own pool of the frame from here on
+	allocator.begin_frame(frame);
+
+	{
+		std::lock_guard <std::mutex> guard(lock);
+		remaining = threads - 1;
+		generation++;
+	}
+
+	cv.notify_all();
+
+	run(0);
+
+	{
+		std::unique_lock <std::mutex> guard(lock);
+		done.wait(guard, [&]() { return remaining == 0; });
+	}
+
+	std::vector <vk::CommandBuffer> secondaries;
+	for (const vk::CommandBuffer &cmd : recorded) {
+		if (cmd)
+			secondaries.push_back(cmd);
+	}
+
+	if (!secondaries.empty())
+		primary.executeCommands(secondaries);
+}
+
+static void destroy_descriptor_pool(const vk::Device &device,
+				    const vk::DescriptorPool &pool)
+{
+	device.destroyDescriptorPool(pool);
+}
+
+using DescriptorPoolReturnProxy = DeviceReturnProxy <vk::DescriptorPool, destroy_descriptor_pool>;
+
+inline DescriptorPoolReturnProxy descriptor_pool(const vk::Device &device,
+		                                 const vk::DescriptorPoolCreateInfo &info)
+{
+	vk::DescriptorPool pool;
+	if (device.createDescriptorPool(&info, nullptr, &pool) !=
+	    vk::Result::eSuccess)
+		return true;
+
+	return std::move(pool);
+}
+
+static void destroy_descriptor_set_layout(const vk::Device &device,
+					  const vk::DescriptorSetLayout &layout)
+{
+	device.destroyDescriptorSetLayout(layout);
+}
+
+using DescriptorSetLayoutReturnProxy = DeviceReturnProxy<vk::DescriptorSetLayout, destroy_descriptor_set_layout>;
+
+inline DescriptorSetLayoutReturnProxy
+descriptor_set_layout(const vk::Device &device,
+		      const vk::DescriptorSetLayoutCreateInfo &info)
+{
+	vk::DescriptorSetLayout layout;
+	if (device.createDescriptorSetLayout(&info, nullptr, &layout) !=
+	    vk::Result::eSuccess)
+		return true;
+
+	return std::move(layout);
+}
+
+static void destroy_pipeline_layout(const vk::Device &device,
+				    const vk::PipelineLayout &layout)
+{
+	device.destroyPipelineLayout(layout);
+}
+
+using PipelineLayoutReturnProxy =
+	DeviceReturnProxy<vk::PipelineLayout, destroy_pipeline_layout>;
+
+inline PipelineLayoutReturnProxy
+pipeline_layout(const vk::Device &device,
+		const vk::PipelineLayoutCreateInfo &info)
+{
+	vk::PipelineLayout layout;
+	if (device.createPipelineLayout(&info, nullptr, &layout) !=
+	    vk::Result::eSuccess)
+		return true;
+
+	return std::move(layout);
+}
+
+static void destroy_sampler(const vk::Device &device,
+			    const vk::Sampler &sampler)
+{
+	device.destroySampler(sampler);
+}
+
+using SamplerReturnProxy = DeviceReturnProxy<vk::Sampler, destroy_sampler>;
+
+inline SamplerReturnProxy sampler(const vk::Device &device,
+				  const vk::SamplerCreateInfo &info)
+{
+	vk::Sampler sampler;
+	if (device.createSampler(&info, nullptr, &sampler) !=
+	    vk::Result::eSuccess)
+		return true;
+
+	return std::move(sampler);
+}
+
+// Default sampler builder
+struct SamplerAssembler {
+	const vk::Device &device;
+	Deallocator &dal;
+
+	vk::Filter mag = vk::Filter::eLinear;
+	vk::Filter min = vk::Filter::eLinear;
+	vk::SamplerMipmapMode mip = vk::SamplerMipmapMode::eLinear;
+
+	SamplerAssembler(const vk::Device &device, Deallocator &dal)
+		: device(device), dal(dal) {}
+
+	SamplerAssembler &filtering(vk::Filter mode) {
+		mag = mode;
+		min = mode;
+		return *this;
+	}
+
+	SamplerAssembler &mipping(vk::SamplerMipmapMode mode) {
+		mip = mode;
+		return *this;
+	}
+
+	operator vk::Sampler() const {
+		vk::SamplerCreateInfo info {
+			vk::SamplerCreateFlags {},
+			mag,
+			min,
+			mip,
+			vk::SamplerAddressMode::eRepeat,
+			vk::SamplerAddressMode::eRepeat,
+			vk::SamplerAddressMode::eRepeat,
+			0.0f,
+			vk::False,
+			1.0f,
+			vk::False,
+			vk::CompareOp::eAlways,
+			0.0f,
+			VK_LOD_CLAMP_NONE,
+			vk::BorderColor::eIntOpaqueBlack,
+			vk::False
+		};
+
+		return sampler(device, info).unwrap(dal);
+	}
+};
+
+// Bind pattern for all physical-logical device operations
+struct LinkedDevices {
+	const vk::PhysicalDevice &phdev;
+	const vk::Device &device;
+
+	constexpr LinkedDevices(const vk::PhysicalDevice &phdev_,
+				const vk::Device &device_)
+		: phdev(phdev_), device(device_) {}
+
+#ifndef LITTLEVK_NO_GLFW
+	LinkedDevices &resize(const vk::SurfaceKHR &surface,
+			      Window &window,
+			      Swapchain &swapchain) {
+		int new_width = 0;
+		int new_height = 0;
+
+		int current_width = 0;
+		int current_height = 0;
+
+		do {
+			glfwGetFramebufferSize(window.handle, &current_width, &current_height);
+			while (current_width == 0 || current_height == 0) {
+				glfwWaitEvents();
+				glfwGetFramebufferSize(window.handle,
+						       &current_width,
+						       &current_height);
+			}
+
+			glfwGetFramebufferSize(window.handle, &new_width, &new_height);
+		} while (new_width != current_width || new_height != current_height);
+
+		// Resize only after stable sizes
+		vk::SurfaceCapabilitiesKHR caps = phdev.getSurfaceCapabilitiesKHR(surface);
+		new_width = std::clamp(new_width, int(caps.minImageExtent.width), int(caps.maxImageExtent.width));
+		new_height = std::clamp(new_height, int(caps.minImageExtent.height), int(caps.maxImageExtent.height));
+
+		device.waitIdle();
+
+		vk::Extent2D new_extent = {uint32_t(new_width),
+					   uint32_t(new_height)};
+		littlevk::resize(device, swapchain, new_extent);
+		window.extent = new_extent;
+
+		return *this;
+	}
+#endif
+
+	// TODO: replace?
+	Swapchain swapchain(const vk::SurfaceKHR &surface, const vk::Extent2D &extent, const QueueFamilyIndices &indices) {
+		return littlevk::swapchain(phdev, device, surface, extent, indices);
+	}
+
+	Swapchain swapchain(const vk::SurfaceKHR &surface, const QueueFamilyIndices &indices) {
+		vk::SurfaceCapabilitiesKHR capabilities = phdev.getSurfaceCapabilitiesKHR(surface);
+		return littlevk::swapchain(phdev, device, surface, capabilities.currentExtent, indices);
+	}
+};
+
+constexpr inline LinkedDevices bind(const vk::PhysicalDevice &phdev,
+				    const vk::Device &device)
+{
+	return LinkedDevices(phdev, device);
+}
+
+// Bind pattern for command submission
+struct LinkedCommandQueue {
+	const vk::Device &device;
+	const vk::CommandPool &pool;
+	const vk::Queue &queue;
+
+	// Set when bound to a command allocator
+	detail::RetiredCommands *retired = nullptr;
+
+	// Returns without waiting only when bound to a command allocator.
+	// Bound to a bare pool there is nothing to retire the buffer into, so
+	// this waits for the submission itself (not the whole device, unlike
+	// submit_and_wait) and frees the buffer; earlier versions returned
+	// right away and leaked it
+	template <typename F>
+	requires std::is_invocable_r_v <void, F, vk::CommandBuffer>
+	LinkedCommandQueue &submit(const F &ftn) {
+		// Also frees earlier submissions which have completed
+		vk::Fence fence = retired
+			? detail::retire_fence(device, *retired)
+			: device.createFence({});
+
+		vk::CommandBuffer cmd = device.allocateCommandBuffers(
+			vk::CommandBufferAllocateInfo {
+				pool, vk::CommandBufferLevel::ePrimary, 1
+			}
+		).front();
+
+		cmd.begin({ vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
+			ftn(cmd);
+		cmd.end();
+
+		littlevk::submit(queue, cmd, {}, {}, fence);
+
+		if (retired) {
+			detail::retire(*retired, pool, cmd, fence);
+		} else {
+			(void) device.waitForFences(fence, true, UINT64_MAX);
+			device.destroyFence(fence);
+			device.freeCommandBuffers(pool, cmd);
+		}
+
+		return *this;
+	}
+
+	template <typename F>
+	requires std::is_invocable_r_v <void, F, vk::CommandBuffer>
+	LinkedCommandQueue &submit_and_wait(const F &ftn) {
+		vk::CommandBuffer cmd = device.allocateCommandBuffers(
+			vk::CommandBufferAllocateInfo {
+				pool, vk::CommandBufferLevel::ePrimary, 1
+			}
+		).front();
+
+		cmd.begin({ vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
+			ftn(cmd);
+		cmd.end();
+
+		littlevk::submit(queue, cmd);
+
+		device.waitIdle();
+		device.freeCommandBuffers(pool, cmd);
+
+		return *this;
+	}
+};
+
+constexpr inline LinkedCommandQueue bind(const vk::Device &device,
+		                         const vk::CommandPool &pool,
+					 const vk::Queue &queue)
+{
+	return LinkedCommandQueue(device, pool, queue);
+}
+
+// One-off submits from the allocator's own pool, one thread at a time
+inline LinkedCommandQueue bind(const vk::Device &device,
+			       const CommandAllocator &allocator,
+			       const vk::Queue &queue)
+{
+	return LinkedCommandQueue(device, allocator.submits, queue, allocator.retired.get());
+}
+
+// Bind pattern to do all allocations at once, then unpack
+template <typename... Args>
+struct LinkedDeviceAllocator : std::tuple <Args...> {
+	const vk::Device &device;
+	const vk::PhysicalDeviceMemoryProperties &properties;
+	littlevk::Deallocator &dal;
+
+	constexpr LinkedDeviceAllocator(const vk::Device &device_,
+			                const vk::PhysicalDeviceMemoryProperties &properties_,
+					littlevk::Deallocator &dal_, const Args &...args)
+		: std::tuple <Args...> (args...), device(device_), properties(properties_), dal(dal_) {}
+
+	constexpr LinkedDeviceAllocator(const vk::Device &device_,
+			                const vk::PhysicalDeviceMemoryProperties &properties_,
+					littlevk::Deallocator &dal_, const std::tuple <Args...> &args)
+		: std::tuple <Args...> (args), device(device_), properties(properties_), dal(dal_) {}
+
+	operator const auto &() const {
+		if constexpr (sizeof...(Args) == 1)
+			return std::get <0> (*this);
+		else
+			return *this;
+	}
+
+	template <typename... InfoArgs>
+	requires std::is_constructible_v <ImageCreateInfo, InfoArgs...>
+	[[nodiscard]] LinkedDeviceAllocator <Args..., littlevk::Image>
+	image(const InfoArgs &...args) {
+		ImageCreateInfo info(args...);
+		auto image = littlevk::image(device, info, properties).unwrap(dal);
+		auto new_values = std::tuple_cat((std::tuple <Args...>) *this, std::make_tuple(image));
+		return {device, properties, dal, new_values};
+	}
+
+	template <typename... BufferArgs>
+	[[nodiscard]] LinkedDeviceAllocator <Args..., littlevk::Buffer>
+	buffer(const BufferArgs &...args) {
+		auto buffer = littlevk::buffer(device, properties, args...).unwrap(dal);
+		auto new_values = std::tuple_cat((std::tuple <Args...>) *this, std::make_tuple(buffer));
+		return {device, properties, dal, new_values};
+	}
+};
+
+// Starts with nothing
+constexpr LinkedDeviceAllocator <> bind(const vk::Device &device,
+		                        const vk::PhysicalDeviceMemoryProperties &properties,
+					littlevk::Deallocator &dal)
+{
+	return {device, properties, dal};
+}
+
+struct LinkedDeviceDescriptorPool {
+	const vk::Device &device;
+	const vk::DescriptorPool &pool;
+
+	[[nodiscard]] std::vector <vk::DescriptorSet>
+	allocate_descriptor_sets(const vk::DescriptorSetLayout &dsl) const
+	{
+		return device.allocateDescriptorSets(
+			vk::DescriptorSetAllocateInfo {pool, dsl});
+	}
+
+	[[nodiscard]] std::vector <vk::DescriptorSet>
+	allocate_descriptor_sets(const std::vector <vk::DescriptorSetLayout> &dsls) const
+	{
+		return device.allocateDescriptorSets(vk::DescriptorSetAllocateInfo { pool, dsls });
+	}
+};
+
+constexpr LinkedDeviceDescriptorPool bind(const vk::Device &device, const vk::DescriptorPool &pool)
+{
+	return { device, pool };
+}
+
+// Descriptor set update structure
+struct DescriptorUpdateQueue {
+	vk::DescriptorSet descriptor;
+	std::vector <vk::DescriptorSetLayoutBinding> bindings;
+
+	DescriptorUpdateQueue(const vk::DescriptorSet &descriptor_,
+			      const std::vector <vk::DescriptorSetLayoutBinding> &bindings_)
+			: descriptor(descriptor_), bindings(bindings_) {}
+
+	DescriptorUpdateQueue(const vk::DescriptorSet &descriptor_,
+			      const std::map <uint32_t, vk::DescriptorSetLayoutBinding> &bindings_)
+			: descriptor(descriptor_) {
+		for (auto &[k, v] : bindings_) {
+			if (k >= bindings.size())
+				bindings.resize(k + 1);
+
+			bindings[k] = v;
+		}
+	}
+
+	// Allow for arbitrarily many updates; enable partial/full updates
+	std::list <vk::DescriptorImageInfo> image_infos;
+	std::list <vk::DescriptorBufferInfo> buffer_infos;
+	std::vector <vk::WriteDescriptorSet> writes;
+
+	DescriptorUpdateQueue &queue_update(uint32_t binding,
+					    uint32_t element,
+					    const vk::Sampler &sampler,
+					    const vk::ImageView &view,
+					    const vk::ImageLayout &layout) {
+		image_infos.emplace_back(sampler, view, layout);
+
+		auto &info = image_infos.back();
+		writes.emplace_back(descriptor, binding, element,
+			bindings[binding].descriptorCount,
+			bindings[binding].descriptorType,
+			&info, nullptr, nullptr);
+
+		return *this;
+	}
+
+	DescriptorUpdateQueue &queue_update(uint32_t binding,
+					    uint32_t element,
+					    const vk::Buffer &buffer,
+					    uint32_t offset,
+					    uint32_t range) {
+		buffer_infos.emplace_back(buffer, offset, range);
+
+		auto &info = buffer_infos.back();
+		writes.emplace_back(descriptor, binding, element,
+			bindings[binding].descriptorCount,
+			bindings[binding].descriptorType,
+			nullptr, &info, nullptr);
+
+		return *this;
+	}
+
+	void apply(const vk::Device &device) const {
+		device.updateDescriptorSets(writes, nullptr);
+	}
+};
+
+// Descriptor set update structures
+// TODO: deprecate
+struct LinkedDescriptorUpdater {
+	const vk::Device &device;
+	const vk::DescriptorSet &dset;
+	const std::vector <vk::DescriptorSetLayoutBinding> &bindings;
+
+	// Allow for arbitrarily many updates; enable partial/full updates
+	std::vector <vk::DescriptorImageInfo> image_infos;
+	std::vector <vk::DescriptorBufferInfo> buffer_infos;
+	std::vector <size_t> image_indices;
+	std::vector <size_t> buffer_indices;
+	std::vector <vk::WriteDescriptorSet> writes;
+
+	LinkedDescriptorUpdater(const vk::Device &device_,
+			        const vk::DescriptorSet &dset_,
+				const std::vector <vk::DescriptorSetLayoutBinding> &bindings_)
+		: device(device_), dset(dset_), bindings(bindings_) {}
+
+	~LinkedDescriptorUpdater() {
+		if (writes.empty())
+			return;
+
+		microlog::warning("linked_descriptor_updator",
+			"Updates to descriptor set (handle = %p) where invoked, "
+			"but never finalized.\n", (void *) dset);
+	}
+
+	LinkedDescriptorUpdater &queue_update(uint32_t binding,
+					      uint32_t element,
+					      const vk::Sampler &sampler,
+					      const vk::ImageView &view,
+					      const vk::ImageLayout &layout) {
+		image_infos.emplace_back(sampler, view, layout);
+		image_indices.push_back(writes.size());
+		writes.emplace_back(dset, binding, element,
+				    bindings[binding].descriptorCount,
+				    bindings[binding].descriptorType);
+		return *this;
+	}
+
+	LinkedDescriptorUpdater &queue_update(uint32_t binding,
+			                      uint32_t element,
+					      const vk::Buffer &buffer,
+					      uint32_t offset,
+					      uint32_t range) {
+		buffer_infos.emplace_back(buffer, offset, range);
+		buffer_indices.push_back(writes.size());
+		writes.emplace_back(dset, binding, element,
+				    bindings[binding].descriptorCount,
+				    bindings[binding].descriptorType);
+		return *this;
+	}
+
+	void finalize() {
+		// Assign the addresses
+		for (size_t i = 0; i < image_infos.size(); i++) {
+			size_t index = image_indices[i];
+			writes[index].pImageInfo = &image_infos[i];
+		}
+
+		for (size_t i = 0; i < buffer_infos.size(); i++) {
+			size_t index = buffer_indices[i];
+			writes[index].pBufferInfo = &buffer_infos[i];
+		}
+
+		// Execute the update
+		device.updateDescriptorSets(writes, nullptr);
+
+		// Clear to indicate finished business
+		image_infos.clear();
+		buffer_infos.clear();
+		image_indices.clear();
+		buffer_indices.clear();
+		writes.clear();
+	}
+
+	void offload(std::vector <vk::WriteDescriptorSet> &other) {
+		other.insert(other.end(), writes.begin(), writes.end());
+	}
+};
+
+inline LinkedDescriptorUpdater bind(const vk::Device &device,
+		        	    const vk::DescriptorSet &dset,
+				    const std::vector <vk::DescriptorSetLayoutBinding> &bindings)
+{
+	return { device, dset, bindings };
+}
+
+namespace shader {
+
+// TODO: detail here as well...
+using Defines = std::map<std::string, std::string>;
+using Includes = std::set<std::string>;
+
+// SPIR-V optimization; only takes effect with ENABLE_OPT defined, see the
+// includes. Size passes run through glslang, performance passes through
+// SPIRV-Tools directly, since glslang only applies them to HLSL
+enum OptimizationLevel {
+	eNoOptimization,
+	eOptimizeSize,
+	eOptimizePerformance,
+};
+
+struct Options {
+	OptimizationLevel optimization = eNoOptimization;
+
+#ifdef NDEBUG
+	bool debug_info = false;
+#else
+	bool debug_info = true;
+#endif
+
+	bool validate = false;
+
+	// Reuse the SPIR-V of identical compilations
+	bool cache = true;
+
+	// Optimized, stripped and validated
+	static Options release(OptimizationLevel level = eOptimizePerformance) {
+		Options options;
+		options.optimization = level;
+		options.debug_info = false;
+		options.validate = true;
+		return options;
+	}
+};
+
+// Local structs
+struct compile_result {
+	std::vector <unsigned int> spirv = {};
+	std::string log = "";
+	std::string source = "";
+	std::set <std::string> dependencies = {};
+};
+
+// Compiling shaders
+inline EShLanguage translate_shader_stage(const vk::ShaderStageFlagBits &stage)
+{
+	switch (stage) {
+	case vk::ShaderStageFlagBits::eVertex:
+		return EShLangVertex;
+	case vk::ShaderStageFlagBits::eTessellationControl:
+		return EShLangTessControl;
+	case vk::ShaderStageFlagBits::eTessellationEvaluation:
+		return EShLangTessEvaluation;
+	case vk::ShaderStageFlagBits::eGeometry:
+		return EShLangGeometry;
+	case vk::ShaderStageFlagBits::eFragment:
+		return EShLangFragment;
+	case vk::ShaderStageFlagBits::eCompute:
+		return EShLangCompute;
+	case vk::ShaderStageFlagBits::eTaskEXT:
+		return EShLangTask;
+	case vk::ShaderStageFlagBits::eMeshNV:
+		return EShLangMesh;
+	case vk::ShaderStageFlagBits::eRaygenNV:
+		return EShLangRayGenNV;
+	case vk::ShaderStageFlagBits::eAnyHitNV:
+		return EShLangAnyHitNV;
+	case vk::ShaderStageFlagBits::eClosestHitNV:
+		return EShLangClosestHitNV;
+	case vk::ShaderStageFlagBits::eMissNV:
+		return EShLangMissNV;
+	case vk::ShaderStageFlagBits::eIntersectionNV:
+		return EShLangIntersectNV;
+	case vk::ShaderStageFlagBits::eCallableNV:
+		return EShLangCallableNV;
+	default:
+		break;
+	}
+
+	microlog::error("translate_shader_stage", "Unknown shader stage %s\n", vk::to_string(stage).c_str());
+
+	return EShLangVertex;
+}
+
+inline compile_result glsl_to_spirv(const std::string &source,
+				    const std::set <std::string> &paths,
+				    const std::map <std::string, std::string> &defines,
+				    const vk::ShaderStageFlagBits &shader_type,
+				    const Options &options = {})
+{
+	// Output
+	compile_result out;
+
+	// Compile shader
+	EShLanguage stage = translate_shader_stage(shader_type);
+
+	std::string preprocessed = source;
+
+	// Cut the version string
+	// TODO: only assumes its the very first string
+	std::string version;
+	for (size_t i = 0; i < preprocessed.size(); i++) {
+		version += preprocessed[i];
+		if (preprocessed[i] == '\n')
+			break;
+	}
+
+	preprocessed = preprocessed.substr(version.size());
+	for (auto &[symbol, value] : defines)
+		preprocessed = "#define " + symbol + " " + value + "\n" + preprocessed;
+
+	preprocessed = version + preprocessed;
+
+	// TODO: use &
+	const char *shaderStrings[1];
+	shaderStrings[0] = preprocessed.data();
+
+#if !defined(ENABLE_OPT) || !ENABLE_OPT
+	static std::atomic <bool> warned = false;
+	if ((options.optimization != eNoOptimization || options.validate) && !warned.exchange(true)) {
+		microlog::warning("shader", "SPIR-V optimization and validation "
+			"need ENABLE_OPT; shaders are compiled as is\n");
+	}
+#endif
+
+	glslang::SpvOptions spv_options;
+	spv_options.generateDebugInfo = options.debug_info;
+	spv_options.stripDebugInfo = !options.debug_info;
+	spv_options.disableOptimizer = (options.optimization != eOptimizeSize);
+	spv_options.optimizeSize = (options.optimization == eOptimizeSize);
+	spv_options.validate = options.validate;
+
+	glslang::TShader shader(stage);
+
+	shader.setEnvTarget(glslang::EShTargetLanguage::EShTargetSpv,
+			    glslang::EShTargetLanguageVersion::EShTargetSpv_1_6);
+	shader.setStrings(shaderStrings, 1);
+
+	// Enable SPIR-V and Vulkan rules when parsing GLSL
+	EShMessages messages = (EShMessages) (EShMsgDefault | EShMsgSpvRules | EShMsgVulkanRules);
+	if (options.debug_info)
+		messages = (EShMessages) (messages | EShMsgDebugInfo);
+
+	// Include directories
+	standalone::DirectoryIncluder includer;
+	for (const auto &path : paths)
+		includer.include(path);
+
+	// ShaderIncluder includer;
+	bool parsed = shader.parse(GetDefaultResources(), 450, false, messages, includer);
+	out.dependencies = includer.included;
+
+	if (!parsed) {
+		out.log = shader.getInfoLog();
+		out.source = preprocessed;
+		return out;
+	}
+
+	// Link the program
+	glslang::TProgram program;
+	program.addShader(&shader);
+
+	if (!program.link(messages)) {
+		out.log = program.getInfoLog();
+		return out;
+	}
+
+	spv::SpvBuildLogger logger;
+	glslang::GlslangToSpv(*program.getIntermediate(stage), out.spirv, &logger, &spv_options);
+
+	// Validation failures are reported as errors, one per line
+	std::string log = logger.getAllMessages();
+
+#if defined(ENABLE_OPT) && ENABLE_OPT
+	if (options.optimization == eOptimizePerformance) {
+		auto consumer = [&](spv_message_level_t level, const char *,
+				    const spv_position_t &, const char *message) {
+			if (level <= SPV_MSG_ERROR)
+				log += std::string("error: ") + message + "\n";
+		};
+
+		spvtools::Optimizer optimizer(SPV_ENV_VULKAN_1_3);
+		optimizer.SetMessageConsumer(consumer);
+		optimizer.RegisterPerformancePasses();
+
+		std::vector <unsigned int> optimized;
+		if (optimizer.Run(out.spirv.data(), out.spirv.size(), &optimized))
+			out.spirv = std::move(optimized);
+
+		// glslang only validated the module before these passes
+		if (options.validate) {
+			spvtools::SpirvTools tools(SPV_ENV_VULKAN_1_3);
+			tools.SetMessageConsumer(consumer);
+			tools.Validate(out.spirv.data(), out.spirv.size());
+		}
+	}
+#endif
+
+	bool failed = log.starts_with("error: ") || log.find("\nerror: ") != std::string::npos;
+	if (failed) {
+		out.log = log;
+		out.source = preprocessed;
+	} else if (!log.empty()) {
+		microlog::warning("shader", "%s", log.c_str());
+	}
+
+	return out;
+}
+
+inline std::string fmt_lines(const std::string &str)
+{
+	// Add line numbers to each line
+	std::string out = "";
+	std::string line;
+
+	std::istringstream stream(str);
+
+	int line_num = 1;
+	while (std::getline(stream, line)) {
+		char buffer[1024];
+		memset(buffer, 0, sizeof(buffer));
+		snprintf(buffer, sizeof(buffer), "%4d: %s\n", line_num++, line.c_str());
+		out += buffer;
+	}
+
+	return out;
+}
+
+// Return proxy specialization for shader modules
+static void destroy_shader_module(const vk::Device &device,
+				  const vk::ShaderModule &shader)
+{
+	device.destroyShaderModule(shader);
+}
+
+using ShaderModuleReturnProxy = DeviceReturnProxy <vk::ShaderModule, destroy_shader_module>;
+
+// Compiled SPIR-V by everything that went into it except included files,
+// which are not tracked; clear it when those change
+struct SpirvCache {
+	std::mutex lock;
+	std::map <std::string, compile_result> entries;
+};
+
+inline SpirvCache &spirv_cache()
+{
+	static SpirvCache cache;
+	return cache;
+}
+
+inline void clear_cache()
+{
+	SpirvCache &cache = spirv_cache();
+	std::lock_guard <std::mutex> guard(cache.lock);
+	cache.entries.clear();
+}
+
+inline std::string cache_key(const std::string &source,
+			     const vk::ShaderStageFlagBits &shader_type,
+			     const Includes &includes,
+			     const Defines &defines,
+			     const Options &options)
+{
+	std::string key = std::to_string(uint32_t(shader_type))
+		+ ":" + std::to_string(options.optimization)
+		+ ":" + std::to_string(options.debug_info)
+		+ ":" + std::to_string(options.validate) + "\n";
+
+	for (const auto &path : includes)
+		key += "-I" + path + "\n";
+	for (const auto &[symbol, value] : defines)
+		key += "-D" + symbol + "=" + value + "\n";
+
+	return key + source;
+}
+
+// Compile GLSL to SPIR-V, without creating a module; errors are logged
+inline std::optional <compile_result>
+build(const std::string &source,
+      const vk::ShaderStageFlagBits &shader_type,
+      const Includes &includes = {},
+      const Defines &defines = {},
+      const Options &options = {})
+{
+	SpirvCache &cache = spirv_cache();
+
+	std::string key;
+	if (options.cache) {
+		key = cache_key(source, shader_type, includes, defines, options);
+
+		std::lock_guard <std::mutex> guard(cache.lock);
+		auto it = cache.entries.find(key);
+		if (it != cache.entries.end())
+			return it->second;
+	}
+
+	glslang::InitializeProcess();
+
+	compile_result out = glsl_to_spirv(source, includes, defines, shader_type, options);
+	if (!out.log.empty()) {
+		// TODO: show the errornous line(s)
+		microlog::error("shader",
+				"Shader compilation failed:\n%s\nSource:\n%s",
+				out.log.c_str(), fmt_lines(out.source).c_str());
+		return std::nullopt;
+	}
+
+	if (options.cache) {
+		std::lock_guard <std::mutex> guard(cache.lock);
+		cache.entries[key] = out;
+	}
+
+	return out;
+}
+
+inline std::optional <std::vector <unsigned int>>
+spirv(const std::string &source,
+      const vk::ShaderStageFlagBits &shader_type,
+      const Includes &includes = {},
+      const Defines &defines = {},
+      const Options &options = {})
+{
+	auto out = build(source, shader_type, includes, defines, options);
+	if (!out)
+		return std::nullopt;
+
+	return out->spirv;
+}
+
+// Shader module from compiled SPIR-V
+inline ShaderModuleReturnProxy create(const vk::Device &device, const std::vector <unsigned int> &code)
+{
+	vk::ShaderModuleCreateInfo create_info;
+	create_info.pCode = code.data();
+	create_info.codeSize = code.size() * sizeof(uint32_t);
+
+	return device.createShaderModule(create_info);
+}
+
+// Compile shader
+inline ShaderModuleReturnProxy
+compile(const vk::Device &device,
+	const std::string &source,
+	const vk::ShaderStageFlagBits &shader_type,
+	const Includes &includes = {},
+	const Defines &defines = {},
+	const Options &options = {})
+{
+	auto code = spirv(source, shader_type, includes, defines, options);
+	if (!code)
+		return true;
+
+	return create(device, *code);
+}
+
+inline ShaderModuleReturnProxy
+compile(const vk::Device &device,
+	const std::filesystem::path &path,
+	const vk::ShaderStageFlagBits &shader_type,
+	const Includes &includes = {},
+	const Defines &defines = {},
+	const Options &options = {})
+{
+	std::string source = standalone::readfile(path);
+	return compile(device, source, shader_type, includes, defines, options);
+}
+
+// Resources a shader (or bundle of shaders) declares, read from its SPIR-V;
+// enough to derive the exact pipeline layout without repeating it by hand
+struct Reflection {
+	vk::ShaderStageFlags stages;
+
+	// Descriptor bindings, by set and then binding
+	std::map <uint32_t, std::map <uint32_t, vk::DescriptorSetLayoutBinding>> sets;
+
+	std::vector <vk::PushConstantRange> push_constants;
+
+	// Vertex stage inputs (location and format only), sorted by location
+	std::vector <vk::VertexInputAttributeDescription> vertex_inputs;
+
+	// Compute stage local size
+	std::array <uint32_t, 3> workgroup_size { 1, 1, 1 };
+
+	// Bindings of a set, in binding order; empty for unused sets
+	std::vector <vk::DescriptorSetLayoutBinding> bindings(uint32_t set) const {
+		std::vector <vk::DescriptorSetLayoutBinding> out;
+
+		auto it = sets.find(set);
+		if (it == sets.end())
+			return out;
+
+		for (const auto &[_, binding] : it->second)
+			out.push_back(binding);
+
+		return out;
+	}
+
+	// Number of set layouts the pipeline layout needs, gaps included
+	uint32_t set_count() const {
+		return sets.empty() ? 0 : sets.rbegin()->first + 1;
+	}
+
+	// Whether pipelines of both can share a layout
+	bool same_layout(const Reflection &other) const {
+		return sets == other.sets && push_constants == other.push_constants;
+	}
+
+	// Combine with the reflection of another stage of the same pipeline
+	Reflection &merge(const Reflection &other) {
+		stages |= other.stages;
+
+		for (const auto &[set, bindings] : other.sets) {
+			for (const auto &[index, binding] : bindings) {
+				auto &existing = sets[set];
+
+				auto it = existing.find(index);
+				if (it == existing.end()) {
+					existing[index] = binding;
+					continue;
+				}
+
+				if (it->second.descriptorType != binding.descriptorType
+						|| it->second.descriptorCount != binding.descriptorCount) {
+					microlog::warning("reflection",
+						"Stages disagree on set %u, binding %u (%s x%u and %s x%u)\n",
+						set, index,
+						vk::to_string(it->second.descriptorType).c_str(), it->second.descriptorCount,
+						vk::to_string(binding.descriptorType).c_str(), binding.descriptorCount);
+				}
+
+				it->second.stageFlags |= binding.stageFlags;
+			}
+		}
+
+		// Identical ranges are shared, others are kept apart
+		for (const auto &range : other.push_constants) {
+			auto it = std::find_if(push_constants.begin(), push_constants.end(),
+				[&](const vk::PushConstantRange &r) {
+					return r.offset == range.offset && r.size == range.size;
+				});
+
+			if (it == push_constants.end())
+				push_constants.push_back(range);
+			else
+				it->stageFlags |= range.stageFlags;
+		}
+
+		if (!other.vertex_inputs.empty())
+			vertex_inputs = other.vertex_inputs;
+
+		if (other.stages & vk::ShaderStageFlagBits::eCompute)
+			workgroup_size = other.workgroup_size;
+
+		return *this;
+	}
+};
+
+// The subset of the SPIR-V specification needed for reflection
+namespace spv {
+
+constexpr uint32_t magic = 0x07230203;
+
+enum Op : uint32_t {
+	OpExecutionMode = 16,
+	OpTypeVoid = 19,
+	OpTypeBool = 20,
+	OpTypeInt = 21,
+	OpTypeFloat = 22,
+	OpTypeVector = 23,
+	OpTypeMatrix = 24,
+	OpTypeImage = 25,
+	OpTypeSampler = 26,
+	OpTypeSampledImage = 27,
+	OpTypeArray = 28,
+	OpTypeRuntimeArray = 29,
+	OpTypeStruct = 30,
+	OpTypePointer = 32,
+	OpConstantTrue = 41,
+	OpConstantFalse = 42,
+	OpConstant = 43,
+	OpConstantComposite = 44,
+	OpSpecConstantTrue = 48,
+	OpSpecConstantFalse = 49,
+	OpSpecConstant = 50,
+	OpSpecConstantComposite = 51,
+	OpVariable = 59,
+	OpDecorate = 71,
+	OpMemberDecorate = 72,
+	OpExecutionModeId = 331,
+	OpTypeAccelerationStructureKHR = 5341,
+};
+
+enum Decoration : uint32_t {
+	Block = 2,
+	BufferBlock = 3,
+	ArrayStride = 6,
+	MatrixStride = 7,
+	BuiltIn = 11,
+	Location = 30,
+	Binding = 33,
+	DescriptorSet = 34,
+	Offset = 35,
+};
+
+enum StorageClass : uint32_t {
+	UniformConstant = 0,
+	Input = 1,
+	Uniform = 2,
+	PushConstant = 9,
+	StorageBuffer = 12,
+};
+
+constexpr uint32_t LocalSize = 17;
+constexpr uint32_t LocalSizeId = 38;
+constexpr uint32_t WorkgroupSize = 25;
+constexpr uint32_t DimBuffer = 5;
+constexpr uint32_t DimSubpassData = 6;
+
+} // namespace spv
+
+// Reflect the SPIR-V of a single stage
+inline Reflection reflect(const std::vector <unsigned int> &code, vk::ShaderStageFlagBits stage)
+{
+	using namespace spv;
+
+	Reflection out;
+	out.stages = stage;
+
+	if (code.size() < 5 || code[0] != magic) {
+		microlog::error("reflect", "Invalid SPIR-V module\n");
+		return out;
+	}
+
+	// Types keep their operands, after the result id
+	struct Type {
+		uint32_t op = 0;
+		std::vector <uint32_t> operands;
+	};
+
+	struct Decorations {
+		std::optional <uint32_t> set;
+		std::optional <uint32_t> binding;
+		std::optional <uint32_t> location;
+		std::optional <uint32_t> stride;
+		bool builtin = false;
+		bool block = false;
+		bool buffer_block = false;
+	};
+
+	struct Variable {
+		uint32_t id;
+		uint32_t type;
+		uint32_t storage;
+	};
+
+	std::map <uint32_t, Type> types;
+
+	// Scalar constants, with the default value for specialization constants
+	std::map <uint32_t, uint32_t> constants;
+	std::map <uint32_t, std::vector <uint32_t>> composites;
+
+	// Workgroup size given by constant ids, either through LocalSizeId or
+	// the WorkgroupSize built-in (which takes precedence)
+	std::optional <std::array <uint32_t, 3>> local_size_ids;
+	std::optional <uint32_t> workgroup_size_id;
+	std::map <uint32_t, Decorations> decorations;
+	std::map <std::pair <uint32_t, uint32_t>, uint32_t> member_offsets;
+	std::map <std::pair <uint32_t, uint32_t>, uint32_t> matrix_strides;
+	std::vector <Variable> variables;
+
+	for (size_t i = 5; i < code.size(); ) {
+		uint32_t count = code[i] >> 16;
+		uint32_t op = code[i] & 0xFFFF;
+		if (count == 0 || i + count > code.size())
+			break;
+
+		const unsigned int *words = &code[i];
+
+		switch (op) {
+		case OpExecutionMode:
+			if (count >= 6 && words[2] == LocalSize)
+				out.workgroup_size = { words[3], words[4], words[5] };
+			break;
+		case OpExecutionModeId:
+			if (count >= 6 && words[2] == LocalSizeId)
+				local_size_ids = { words[3], words[4], words[5] };
+			break;
+		case OpDecorate:
+		{
+			if (count < 3)
+				break;
+
+			Decorations &d = decorations[words[1]];
+			switch (words[2]) {
+			case Block: d.block = true; break;
+			case BufferBlock: d.buffer_block = true; break;
+			case BuiltIn:
+				d.builtin = true;
+				if (count >= 4 && words[3] == WorkgroupSize)
+					workgroup_size_id = words[1];
+				break;
+			case ArrayStride: d.stride = words[3]; break;
+			case Location: d.location = words[3]; break;
+			case Binding: d.binding = words[3]; break;
+			case DescriptorSet: d.set = words[3]; break;
+			default: break;
+			}
+		} break;
+		case OpMemberDecorate:
+			if (count >= 5 && words[3] == Offset)
+				member_offsets[{ words[1], words[2] }] = words[4];
+			else if (count >= 5 && words[3] == MatrixStride)
+				matrix_strides[{ words[1], words[2] }] = words[4];
+			else if (count >= 4 && words[3] == BuiltIn)
+				decorations[words[1]].builtin = true;
+			break;
+		case OpTypeVoid:
+		case OpTypeBool:
+		case OpTypeInt:
+		case OpTypeFloat:
+		case OpTypeVector:
+		case OpTypeMatrix:
+		case OpTypeImage:
+		case OpTypeSampler:
+		case OpTypeSampledImage:
+		case OpTypeArray:
+		case OpTypeRuntimeArray:
+		case OpTypeStruct:
+		case OpTypePointer:
+		case OpTypeAccelerationStructureKHR:
+			types[words[1]] = { op, std::vector <uint32_t> (words + 2, words + count) };
+			break;
+		case OpConstant:
+		case OpSpecConstant:
+			if (count >= 4)
+				constants[words[2]] = words[3];
+			break;
+		case OpConstantTrue:
+		case OpSpecConstantTrue:
+			constants[words[2]] = 1;
+			break;
+		case OpConstantFalse:
+		case OpSpecConstantFalse:
+			constants[words[2]] = 0;
+			break;
+		case OpConstantComposite:
+		case OpSpecConstantComposite:
+			composites[words[2]] = std::vector <uint32_t> (words + 3, words + count);
+			break;
+		case OpVariable:
+			variables.push_back({ words[2], words[1], words[3] });
+			break;
+		default:
+			break;
+		}
+
+		i += count;
+	}
+
+	// Specialization constants are reflected with their default values
+	if (local_size_ids) {
+		for (uint32_t k = 0; k < 3; k++)
+			out.workgroup_size[k] = constants[(*local_size_ids)[k]];
+	}
+
+	if (workgroup_size_id) {
+		const std::vector <uint32_t> &ids = composites[*workgroup_size_id];
+		for (uint32_t k = 0; k < 3 && k < ids.size(); k++)
+			out.workgroup_size[k] = constants[ids[k]];
+	}
+
+	// Byte size of a type with explicit layout, as far as it is needed for
+	// push constant ranges; runtime arrays take no space
+	std::function <uint32_t (uint32_t)> size_of = [&](uint32_t id) -> uint32_t {
+		const Type &type = types[id];
+
+		switch (type.op) {
+		case OpTypeBool:
+			return 4;
+		case OpTypeInt:
+		case OpTypeFloat:
+			return type.operands[0] / 8;
+		case OpTypeVector:
+		case OpTypeMatrix:
+			return type.operands[1] * size_of(type.operands[0]);
+		case OpTypeArray:
+		{
+			const Decorations &d = decorations[id];
+			uint32_t element = d.stride ? *d.stride : size_of(type.operands[0]);
+			return constants[type.operands[1]] * element;
+		}
+		case OpTypeStruct:
+		{
+			uint32_t end = 0;
+			for (uint32_t m = 0; m < type.operands.size(); m++) {
+				uint32_t member = type.operands[m];
+				uint32_t size = size_of(member);
+
+				auto stride = matrix_strides.find({ id, m });
+				if (stride != matrix_strides.end() && types[member].op == OpTypeMatrix)
+					size = types[member].operands[1] * stride->second;
+
+				end = std::max(end, member_offsets[{ id, m }] + size);
+			}
+
+			return end;
+		}
+		default:
+			break;
+		}
+
+		return 0;
+	};
+
+	// Vertex input formats for scalars and vectors of 32-bit components
+	auto input_format = [&](uint32_t id) -> vk::Format {
+		static constexpr vk::Format floats[] {
+			vk::Format::eR32Sfloat, vk::Format::eR32G32Sfloat,
+			vk::Format::eR32G32B32Sfloat, vk::Format::eR32G32B32A32Sfloat
+		};
+
+		static constexpr vk::Format ints[] {
+			vk::Format::eR32Sint, vk::Format::eR32G32Sint,
+			vk::Format::eR32G32B32Sint, vk::Format::eR32G32B32A32Sint
+		};
+
+		static constexpr vk::Format uints[] {
+			vk::Format::eR32Uint, vk::Format::eR32G32Uint,
+			vk::Format::eR32G32B32Uint, vk::Format::eR32G32B32A32Uint
+		};
+
+		uint32_t components = 1;
+		uint32_t scalar = id;
+		if (types[id].op == OpTypeVector) {
+			components = types[id].operands[1];
+			scalar = types[id].operands[0];
+		}
+
+		const Type &type = types[scalar];
+		if (components < 1 || components > 4 || type.operands.empty() || type.operands[0] != 32)
+			return vk::Format::eUndefined;
+
+		if (type.op == OpTypeFloat)
+			return floats[components - 1];
+		if (type.op == OpTypeInt)
+			return type.operands[1] ? ints[components - 1] : uints[components - 1];
+
+		return vk::Format::eUndefined;
+	};
+
+	for (const Variable &variable : variables) {
+		const Type &pointer = types[variable.type];
+		if (pointer.op != OpTypePointer)
+			continue;
+
+		uint32_t pointee = pointer.operands[1];
+		const Decorations &d = decorations[variable.id];
+
+		if (variable.storage == PushConstant) {
+			const Type &block = types[pointee];
+
+			// Ranges start at the first member actually declared
+			uint32_t begin = ~0u;
+			for (uint32_t m = 0; m < block.operands.size(); m++)
+				begin = std::min(begin, member_offsets[{ pointee, m }]);
+
+			if (begin == ~0u)
+				begin = 0;
+
+			uint32_t end = size_of(pointee);
+			if (end > begin)
+				out.push_constants.push_back({ stage, begin, end - begin });
+
+			continue;
+		}
+
+		if (variable.storage == Input) {
+			if (stage != vk::ShaderStageFlagBits::eVertex || d.builtin
+					|| decorations[pointee].builtin || !d.location)
+				continue;
+
+			out.vertex_inputs.push_back({ *d.location, 0, input_format(pointee), 0 });
+			continue;
+		}
+
+		if (variable.storage != UniformConstant
+				&& variable.storage != Uniform
+				&& variable.storage != StorageBuffer)
+			continue;
+
+		if (!d.binding)
+			continue;
+
+		// Arrays of descriptors
+		uint32_t type = pointee;
+		uint32_t count = 1;
+		while (types[type].op == OpTypeArray || types[type].op == OpTypeRuntimeArray) {
+			if (types[type].op == OpTypeArray) {
+				count *= constants[types[type].operands[1]];
+			} else {
+				microlog::warning("reflect",
+					"Runtime sized descriptor array at binding %u; "
+					"reflected with a count of one\n", *d.binding);
+			}
+
+			type = types[type].operands[0];
+		}
+
+		std::optional <vk::DescriptorType> descriptor;
+
+		const Type &resource = types[type];
+		switch (resource.op) {
+		case OpTypeSampledImage:
+			descriptor = vk::DescriptorType::eCombinedImageSampler;
+			break;
+		case OpTypeSampler:
+			descriptor = vk::DescriptorType::eSampler;
+			break;
+		case OpTypeImage:
+		{
+			// Operands are the sampled type, dim, depth, arrayed, ms and sampled
+			uint32_t dim = resource.operands[1];
+			bool storage = (resource.operands[5] == 2);
+			if (dim == DimBuffer)
+				descriptor = storage ? vk::DescriptorType::eStorageTexelBuffer : vk::DescriptorType::eUniformTexelBuffer;
+			else if (dim == DimSubpassData)
+				descriptor = vk::DescriptorType::eInputAttachment;
+			else
+				descriptor = storage ? vk::DescriptorType::eStorageImage : vk::DescriptorType::eSampledImage;
+		} break;
+		case OpTypeAccelerationStructureKHR:
+			descriptor = vk::DescriptorType::eAccelerationStructureKHR;
+			break;
+		case OpTypeStruct:
+			if (variable.storage == StorageBuffer || decorations[type].buffer_block)
+				descriptor = vk::DescriptorType::eStorageBuffer;
+			else
+				descriptor = vk::DescriptorType::eUniformBuffer;
+			break;
+		default:
+			break;
+		}
+
+		if (!descriptor) {
+			microlog::warning("reflect", "Unsupported resource type at binding %u\n", *d.binding);
+			continue;
+		}
+
+		out.sets[d.set.value_or(0)][*d.binding] = vk::DescriptorSetLayoutBinding {
+			*d.binding, *descriptor, count, stage
+		};
+	}
+
+	std::sort(out.vertex_inputs.begin(), out.vertex_inputs.end(),
+		[](const auto &a, const auto &b) { return a.location < b.location; });
+
+	return out;
+}
+
+} // namespace shader
+
+namespace pipeline {
+
+inline void destroy_pipeline(const vk::Device &device, const vk::Pipeline &pipeline)
+{
+	device.destroyPipeline(pipeline);
+}
+
+using PipelineReturnProxy = DeviceReturnProxy <vk::Pipeline, destroy_pipeline>;
+
+// Regular graphics pipeline
+struct GraphicsCreateInfo {
+	using vertex_binding_t = vk::ArrayProxy <vk::VertexInputBindingDescription>;
+	using vertex_attribute_t = vk::ArrayProxy <vk::VertexInputAttributeDescription>;
+
+	std::optional <vertex_binding_t> vertex_binding = std::nullopt;
+	std::optional <vertex_attribute_t> vertex_attributes = std::nullopt;
+
+	std::vector <vk::PipelineShaderStageCreateInfo> shader_stages;
+
+	vk::Extent2D extent;
+
+	vk::PolygonMode fill_mode = vk::PolygonMode::eFill;
+	vk::CullModeFlags cull_mode = vk::CullModeFlagBits::eBack;
+
+	bool dynamic_viewport = false;
+	bool alpha_blend = false;
+	bool depth_test = true;
+	bool depth_write = true;
+
+	vk::PipelineLayout pipeline_layout;
+	vk::RenderPass render_pass;
+	uint32_t subpass;
+
+	// Dynamic rendering, used instead of the render pass when set
+	std::optional <std::vector <vk::Format>> color_formats;
+	vk::Format depth_format = vk::Format::eUndefined;
+	vk::Format stencil_format = vk::Format::eUndefined;
+};
+
+inline PipelineReturnProxy compile(const vk::Device &device, const GraphicsCreateInfo &info)
+{
+	if (!info.shader_stages.size())
+		microlog::error("pipeline::compile", "Empty shader stages\n");
+
+	vk::PipelineVertexInputStateCreateInfo vertex_input_info {
+		{}, nullptr, nullptr
+	};
+
+	if (info.vertex_binding && info.vertex_attributes)
+		vertex_input_info = { {}, *info.vertex_binding, *info.vertex_attributes };
+
+	vk::PipelineInputAssemblyStateCreateInfo input_assembly {
+		{}, vk::PrimitiveTopology::eTriangleList
+	};
+
+	// Configuring the viewport
+	vk::PipelineViewportStateCreateInfo viewport_state {
+		{}, 1, nullptr, 1, nullptr
+	};
+
+	vk::PipelineDynamicStateCreateInfo dynamic_state {
+		{}, 0, nullptr
+	};
+
+	// Fixed viewport
+	vk::Viewport viewport {
+		0.0f, 0.0f,
+		(float) info.extent.width,
+		(float) info.extent.height,
+		0.0f, 1.0f
+	};
+
+	vk::Rect2D scissor { {}, info.extent };
+
+	// Dynamic viewport
+	std::array <vk::DynamicState, 2> dynamic_states {
+		vk::DynamicState::eViewport,
+		vk::DynamicState::eScissor
+	};
+
+	// Select according to the configuration
+	if (info.dynamic_viewport) {
+		dynamic_state = vk::PipelineDynamicStateCreateInfo {
+			{},
+			(uint32_t) dynamic_states.size(),
+			dynamic_states.data()
+		};
+	} else {
+		viewport_state = vk::PipelineViewportStateCreateInfo {
+			{}, 1, &viewport, 1, &scissor
+		};
+	}
+
+	vk::PipelineRasterizationStateCreateInfo rasterizer {
+		{},
+		false, false,
+		info.fill_mode,
+		info.cull_mode,
+		vk::FrontFace::eClockwise,
+		false,
+		0.0f, 0.0f, 0.0f, 1.0f
+	};
+
+	vk::PipelineMultisampleStateCreateInfo multisampling {
+		{}, vk::SampleCountFlagBits::e1
+	};
+
+	vk::PipelineDepthStencilStateCreateInfo depth_stencil {
+		{},
+		info.depth_test,
+		info.depth_write,
+		vk::CompareOp::eLess,
+		false, false,
+		{}, {},
+		0.0f, 1.0f
+	};
+
+	vk::PipelineColorBlendAttachmentState color_blend_attachment;
+	if (info.alpha_blend) {
+		color_blend_attachment = {
+			true,
+			vk::BlendFactor::eSrcAlpha,
+			vk::BlendFactor::eOneMinusSrcAlpha,
+			vk::BlendOp::eAdd,
+			vk::BlendFactor::eOne,
+			vk::BlendFactor::eZero,
+			vk::BlendOp::eAdd,
+			vk::ColorComponentFlagBits::eR
+			| vk::ColorComponentFlagBits::eG
+			| vk::ColorComponentFlagBits::eB
+			| vk::ColorComponentFlagBits::eA
+		};
+	} else {
+		color_blend_attachment = {
+			false,
+			vk::BlendFactor::eOne,
+			vk::BlendFactor::eZero,
+			vk::BlendOp::eAdd,
+			vk::BlendFactor::eOne,
+			vk::BlendFactor::eZero,
+			vk::BlendOp::eAdd,
+			vk::ColorComponentFlagBits::eR
+			| vk::ColorComponentFlagBits::eG
+			| vk::ColorComponentFlagBits::eB
+			| vk::ColorComponentFlagBits::eA
+		};
+	}
+
+	vk::PipelineColorBlendStateCreateInfo color_blending {
+		{},
+		false,
+		vk::LogicOp::eCopy, 1,
+		&color_blend_attachment,
+		{ 0.0f, 0.0f, 0.0f, 0.0f }
+	};
+
+	// Attachment formats replace the render pass
+	if (info.color_formats && !capabilities(device).dynamic_rendering) {
+		microlog::error("pipeline::compile", "Dynamic rendering is not enabled on the device\n");
+		return true;
+	}
+
+	if (info.color_formats) {
+		std::vector <vk::PipelineColorBlendAttachmentState> blend_attachments(info.color_formats->size(), color_blend_attachment);
+		color_blending.attachmentCount = blend_attachments.size();
+		color_blending.pAttachments = blend_attachments.data();
+
+		vk::PipelineRenderingCreateInfo rendering_info {
+			0, *info.color_formats,
+			info.depth_format,
+			info.stencil_format
+		};
+
+		vk::GraphicsPipelineCreateInfo pipeline_info {
+			{}, info.shader_stages,
+			&vertex_input_info,
+			&input_assembly,
+			nullptr,
+			&viewport_state,
+			&rasterizer,
+			&multisampling,
+			&depth_stencil,
+			&color_blending,
+			&dynamic_state,
+			info.pipeline_layout,
+			nullptr, 0
+		};
+
+		pipeline_info.pNext = &rendering_info;
+
+		return device.createGraphicsPipeline(nullptr, pipeline_info).value;
+	}
+
+	return device.createGraphicsPipeline(nullptr,
+		vk::GraphicsPipelineCreateInfo {
+			{}, info.shader_stages,
+			&vertex_input_info,
+			&input_assembly,
+			nullptr,
+			&viewport_state,
+			&rasterizer,
+			&multisampling,
+			&depth_stencil,
+			&color_blending,
+			&dynamic_state,
+			info.pipeline_layout,
+			info.render_pass,
+			info.subpass
+		}).value;
+}
+
+// Compute pipeline
+struct ComputeCreateInfo {
+	vk::PipelineShaderStageCreateInfo shader_stage;
+	vk::PipelineLayout pipeline_layout;
+};
+
+inline PipelineReturnProxy compile(const vk::Device &device, const ComputeCreateInfo &info)
+{
+	return device.createComputePipeline(nullptr,
+		vk::ComputePipelineCreateInfo {
+			{}, info.shader_stage, info.pipeline_layout
+		}).value;
+}
+
+} // namespace pipeline
+
+// Pre defined Vulkan types; not intended for concrete usage
+struct r32f {
+	char _data[sizeof(float)];
+};
+
+struct rg32f {
+	char _data[2 * sizeof(float)];
+};
+
+struct rgb32f {
+	char _data[3 * sizeof(float)];
+};
+
+struct rgba32f {
+	char _data[4 * sizeof(float)];
+};
+
+// Quantized vertex types; fill them with the encode helpers below
+struct rg16f {
+	uint16_t data[2];
+};
+
+struct rgba16f {
+	uint16_t data[4];
+};
+
+struct rg16snorm {
+	int16_t data[2];
+};
+
+struct rgba16snorm {
+	int16_t data[4];
+};
+
+struct rg16unorm {
+	uint16_t data[2];
+};
+
+struct rgba16unorm {
+	uint16_t data[4];
+};
+
+struct rgba8snorm {
+	int8_t data[4];
+};
+
+struct rgba8unorm {
+	uint8_t data[4];
+};
+
+// Packed 10-10-10-2; components are in [0, 1], so normals are remapped
+// and decoded as n * 2 - 1 in shaders
+struct a2b10g10r10 {
+	uint32_t data;
+};
+
+// Octahedral unit vectors, read as a snorm vec2; decode in shaders with
+//	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+//	n.xy = (n.z < 0.0) ? (1.0 - abs(n.yx)) * sign(n.xy) : n.xy;
+//	n = normalize(n);
+struct oct16 {
+	int16_t data[2];
+};
+
+struct oct8 {
+	int8_t data[2];
+};
+
+namespace encode {
+
+// Float to half with round to nearest even; overflow saturates to infinity
+inline uint16_t half(float value)
+{
+	uint32_t bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+
+	uint32_t sign = (bits >> 16) & 0x8000;
+	uint32_t magnitude = bits & 0x7fffffff;
+
+	// NaN and infinity
+	if (magnitude >= 0x7f800000)
+		return sign | 0x7c00 | ((magnitude > 0x7f800000) ? 0x200 : 0);
+
+	// Too large, saturate to infinity
+	if (magnitude >= 0x477ff000)
+		return sign | 0x7c00;
+
+	// Subnormal (or zero) halves
+	if (magnitude < 0x38800000) {
+		float f;
+		std::memcpy(&f, &magnitude, sizeof(f));
+
+		// Adding 0.5 aligns the mantissa to the half subnormal step
+		f += 0.5f;
+
+		uint32_t aligned;
+		std::memcpy(&aligned, &f, sizeof(aligned));
+		return sign | (aligned - 0x3f000000);
+	}
+
+	uint32_t odd = (magnitude >> 13) & 1;
+	magnitude += 0xc8000fff + odd;
+	return sign | (magnitude >> 13);
+}
+
+inline int16_t snorm16(float value)
+{
+	return int16_t(std::lround(std::clamp(value, -1.0f, 1.0f) * 32767.0f));
+}
+
+inline uint16_t unorm16(float value)
+{
+	return uint16_t(std::lround(std::clamp(value, 0.0f, 1.0f) * 65535.0f));
+}
+
+inline int8_t snorm8(float value)
+{
+	return int8_t(std::lround(std::clamp(value, -1.0f, 1.0f) * 127.0f));
+}
+
+inline uint8_t unorm8(float value)
+{
+	return uint8_t(std::lround(std::clamp(value, 0.0f, 1.0f) * 255.0f));
+}
+
+inline rg16f half2(float x, float y)
+{
+	return {{ half(x), half(y) }};
+}
+
+inline rgba16f half4(float x, float y, float z, float w)
+{
+	return {{ half(x), half(y), half(z), half(w) }};
+}
+
+inline rg16snorm snorm16x2(float x, float y)
+{
+	return {{ snorm16(x), snorm16(y) }};
+}
+
+inline rgba16snorm snorm16x4(float x, float y, float z, float w)
+{
+	return {{ snorm16(x), snorm16(y), snorm16(z), snorm16(w) }};
+}
+
+inline rg16unorm unorm16x2(float x, float y)
+{
+	return {{ unorm16(x), unorm16(y) }};
+}
+
+inline rgba16unorm unorm16x4(float x, float y, float z, float w)
+{
+	return {{ unorm16(x), unorm16(y), unorm16(z), unorm16(w) }};
+}
+
+inline rgba8snorm snorm8x4(float x, float y, float z, float w)
+{
+	return {{ snorm8(x), snorm8(y), snorm8(z), snorm8(w) }};
+}
+
+inline rgba8unorm unorm8x4(float x, float y, float z, float w)
+{
+	return {{ unorm8(x), unorm8(y), unorm8(z), unorm8(w) }};
+}
+
+// Unit vector remapped to [0, 1]
+inline a2b10g10r10 normal_a2b10g10r10(float x, float y, float z, uint32_t w = 0)
+{
+	auto channel = [](float v) {
+		return uint32_t(std::lround(std::clamp(v * 0.5f + 0.5f, 0.0f, 1.0f) * 1023.0f));
+	};
+
+	return { channel(x) | (channel(y) << 10) | (channel(z) << 20) | ((w & 0x3) << 30) };
+}
+
+// Projects a unit vector onto the octahedron and unfolds the lower half
+inline std::array <float, 2> octahedral(float x, float y, float z)
+{
+	float l1 = std::abs(x) + std::abs(y) + std::abs(z);
+	if (l1 <= 0.0f)
+		return { 0.0f, 0.0f };
+
+	float u = x / l1;
+	float v = y / l1;
+	if (z < 0.0f) {
+		float fu = (1.0f - std::abs(v)) * (u >= 0.0f ? 1.0f : -1.0f);
+		float fv = (1.0f - std::abs(u)) * (v >= 0.0f ? 1.0f : -1.0f);
+		u = fu;
+		v = fv;
+	}
+
+	return { u, v };
+}
+
+inline oct16 octahedral16(float x, float y, float z)
+{
+	auto [u, v] = octahedral(x, y, z);
+	return {{ snorm16(u), snorm16(v) }};
+}
+
+inline oct8 octahedral8(float x, float y, float z)
+{
+	auto [u, v] = octahedral(x, y, z);
+	return {{ snorm8(u), snorm8(v) }};
+}
+
+} // namespace encode
+
+// Easier vertex layout, using templates only
+template <typename T, typename... Args>
+constexpr size_t sizeof_all()
+{
+	if constexpr (sizeof...(Args))
+		return sizeof(T) + sizeof_all <Args...> ();
+	else
+		return sizeof(T);
+}
+
+template <typename T, bool instantiated = true>
+struct type_translator {
+	static_assert(!instantiated, "Unsupported format translation for this type");
+	static constexpr vk::Format format = vk::Format::eUndefined;
+};
+
+// Attribute placed at an explicit shader location; the attributes after it
+// continue from there
+template <uint32_t L, typename T>
+struct location {
+	T value;
+};
+
+template <typename T>
+struct attribute_location {
+	static constexpr bool fixed = false;
+	static constexpr uint32_t value = 0;
+	using type = T;
+};
+
+template <uint32_t L, typename T>
+struct attribute_location <location <L, T>> {
+	static constexpr bool fixed = true;
+	static constexpr uint32_t value = L;
+	using type = T;
+};
+
+template <uint32_t index, uint32_t offset, typename T, uint32_t binding = 0>
+constexpr vk::VertexInputAttributeDescription attribute_for()
+{
+	return vk::VertexInputAttributeDescription {
+		index, binding,
+		type_translator <typename attribute_location <T> ::type> ::format,
+		offset
+	};
+}
+
+template <uint32_t binding, uint32_t index, uint32_t offset, typename T, typename... Args>
+constexpr std::array <vk::VertexInputAttributeDescription, 1 + sizeof...(Args)>
+binding_attributes_for()
+{
+	constexpr uint32_t location = attribute_location <T> ::fixed
+		? attribute_location <T> ::value : index;
+
+	if constexpr (sizeof...(Args)) {
+		auto previous = binding_attributes_for <binding, location + 1, offset + sizeof(T), Args...> ();
+		std::array <vk::VertexInputAttributeDescription, 1 + sizeof...(Args)> out;
+		out[0] = attribute_for <location, offset, T, binding> ();
+		for (uint32_t i = 0; i < sizeof...(Args); i++)
+			out[i + 1] = previous[i];
+		return out;
+	} else {
+		return { attribute_for <location, offset, T, binding> () };
+	}
+}
+
+template <uint32_t index, uint32_t offset, typename T, typename... Args>
+constexpr std::array <vk::VertexInputAttributeDescription, 1 + sizeof...(Args)>
+attributes_for()
+{
+	return binding_attributes_for <0, index, offset, T, Args...> ();
+}
+
+template <typename... Args>
+struct VertexLayout {
+	static constexpr size_t size = sizeof_all <Args...> ();
+
+	static constexpr vk::VertexInputBindingDescription binding {
+		0, size, vk::VertexInputRate::eVertex
+	};
+
+	static constexpr std::array <vk::VertexInputBindingDescription, 1> bindings { binding };
+
+	static constexpr std::array <vk::VertexInputAttributeDescription, sizeof...(Args)> attributes {
+		attributes_for <0, 0, Args...> ()
+	};
+};
+
+// One buffer binding of a multi-binding layout, with its input rate
+template <uint32_t Binding, vk::VertexInputRate Rate, typename... Args>
+struct VertexBinding {
+	static constexpr size_t size = sizeof_all <Args...> ();
+	static constexpr size_t count = sizeof...(Args);
+
+	static constexpr vk::VertexInputBindingDescription binding {
+		Binding, size, Rate
+	};
+
+	template <uint32_t first>
+	static constexpr auto attributes() {
+		return binding_attributes_for <Binding, first, 0, Args...> ();
+	}
+};
+
+template <uint32_t Binding, typename... Args>
+using PerVertex = VertexBinding <Binding, vk::VertexInputRate::eVertex, Args...>;
+
+template <uint32_t Binding, typename... Args>
+using PerInstance = VertexBinding <Binding, vk::VertexInputRate::eInstance, Args...>;
+
+// Attributes of consecutive bindings; locations carry on across bindings
+template <uint32_t first, typename B, typename... Rest>
+constexpr std::array <vk::VertexInputAttributeDescription, (B::count + ... + Rest::count)>
+layout_attributes_for()
+{
+	constexpr auto head = B::template attributes <first> ();
+
+	std::array <vk::VertexInputAttributeDescription, (B::count + ... + Rest::count)> out;
+	for (uint32_t i = 0; i < B::count; i++)
+		out[i] = head[i];
+
+	if constexpr (sizeof...(Rest)) {
+		constexpr auto tail = layout_attributes_for <head.back().location + 1, Rest...> ();
+		for (uint32_t i = 0; i < tail.size(); i++)
+			out[B::count + i] = tail[i];
+	}
+
+	return out;
+}
+
+// Several vertex streams, e.g. positions apart for depth only passes or
+// per-instance data; accepted wherever a VertexLayout is
+template <typename... Bindings>
+struct MultiVertexLayout {
+	static constexpr std::array <vk::VertexInputBindingDescription, sizeof...(Bindings)> bindings {
+		Bindings::binding...
+	};
+
+	static constexpr auto attributes = layout_attributes_for <0, Bindings...> ();
+};
+
+// Vertex layouts reflected from user structs; declare the fields once (at
+// global scope) with LITTLEVK_VERTEX(Vertex, position, normal, uv) and the
+// formats, true offsets and stride are derived from the struct itself
+struct VertexField {
+	vk::Format format;
+	uint32_t offset;
+	uint32_t size;
+};
+
+// Checked once per field, so the failing field type shows up in the error
+template <typename T>
+constexpr vk::Format vertex_field_format()
+{
+	constexpr vk::Format format = type_translator <T> ::format;
+	static_assert(format != vk::Format::eUndefined, "Vertex field type translates to an undefined format");
+	return format;
+}
+
+template <typename V, bool instantiated = true>
+struct vertex_reflection {
+	static_assert(!instantiated, "Vertex type was not declared with LITTLEVK_VERTEX");
+	static constexpr std::array <VertexField, 0> fields {};
+};
+
+// Reflected vertex as one binding of a MultiVertexLayout
+template <typename V, uint32_t Binding = 0, vk::VertexInputRate Rate = vk::VertexInputRate::eVertex>
+struct ReflectedBinding {
+	static constexpr auto fields = vertex_reflection <V> ::fields;
+	static constexpr size_t count = fields.size();
+
+	static constexpr vk::VertexInputBindingDescription binding {
+		Binding, sizeof(V), Rate
+	};
+
+	template <uint32_t first>
+	static constexpr auto attributes() {
+		std::array <vk::VertexInputAttributeDescription, count> out;
+		for (uint32_t i = 0; i < count; i++)
+			out[i] = { first + i, Binding, fields[i].format, fields[i].offset };
+		return out;
+	}
+
+	// No padding between or after the fields
+	static constexpr bool packed() {
+		size_t total = 0;
+		for (const VertexField &field : fields)
+			total += field.size;
+
+		return total == sizeof(V);
+	}
+};
+
+// Reflected vertex as a single binding layout, like VertexLayout
+template <typename V>
+struct ReflectedLayout {
+	using reflected = ReflectedBinding <V>;
+
+	static constexpr vk::VertexInputBindingDescription binding = reflected::binding;
+	static constexpr std::array <vk::VertexInputBindingDescription, 1> bindings { binding };
+	static constexpr auto attributes = reflected::template attributes <0> ();
+};
+
+// Whether a hand written layout agrees with the struct it describes
+template <typename Layout, typename V>
+constexpr bool layout_matches()
+{
+	constexpr auto expected = ReflectedLayout <V> ::attributes;
+	if (Layout::attributes.size() != expected.size())
+		return false;
+
+	if (Layout::bindings.size() != 1 || Layout::bindings[0].stride != sizeof(V))
+		return false;
+
+	for (uint32_t i = 0; i < expected.size(); i++) {
+		if (Layout::attributes[i].format != expected[i].format
+				|| Layout::attributes[i].offset != expected[i].offset)
+			return false;
+	}
+
+	return true;
+}
+
+// Specialization constants of a single stage
+struct Specialization {
+	std::vector <vk::SpecializationMapEntry> entries;
+	std::vector <uint8_t> data;
+	vk::SpecializationInfo info;
+
+	// Booleans are stored as 32-bit values, as Vulkan expects
+	template <typename T>
+	void set(uint32_t id, const T &value) {
+		if constexpr (std::is_same_v <T, bool>) {
+			set <vk::Bool32> (id, value ? VK_TRUE : VK_FALSE);
+		} else {
+			static_assert(std::is_trivially_copyable_v <T>,
+				"Specialization constants must be trivially copyable");
+
+			auto it = std::find_if(entries.begin(), entries.end(),
+				[&](const vk::SpecializationMapEntry &entry) {
+					return entry.constantID == id;
+				});
+
+			if (it != entries.end() && it->size == sizeof(T)) {
+				std::memcpy(&data[it->offset], &value, sizeof(T));
+				return;
+			}
+
+			if (it != entries.end())
+				entries.erase(it);
+
+			entries.push_back({ id, uint32_t(data.size()), sizeof(T) });
+			data.resize(data.size() + sizeof(T));
+			std::memcpy(&data[entries.back().offset], &value, sizeof(T));
+		}
+	}
+
+	const vk::SpecializationInfo *link() {
+		if (entries.empty())
+			return nullptr;
+
+		info = vk::SpecializationInfo {
+			uint32_t(entries.size()), entries.data(),
+			data.size(), data.data()
+		};
+
+		return &info;
+	}
+};
+
+// Group of shaders for a pipeline; copies share the shader modules, so
+// variants which only differ in specialization constants are cheap:
+//
+//	auto variant = bundle;
+//	variant.spec <uint32_t> (vk::ShaderStageFlagBits::eCompute, 0, 128);
+struct ShaderStageBundle {
+	vk::Device device;
+	littlevk::Deallocator &dal;
+
+	std::vector <vk::PipelineShaderStageCreateInfo> stages;
+
+	// Entry point names and specialization constants referenced by the
+	// stages, in the same order
+	std::list <std::string> entries;
+	std::vector <Specialization> specializations;
+
+	// Resources declared across all stages
+	shader::Reflection reflection;
+
+	// Applies to the stages added after it is set
+	shader::Options options;
+
+	// How each stage was compiled, and every file read for it, so that the
+	// bundle can be rebuilt when those change
+	struct Source {
+		std::string glsl;
+		std::optional <std::filesystem::path> path;
+		vk::ShaderStageFlagBits flags;
+		shader::Includes includes;
+		shader::Defines defines;
+		shader::Options options;
+	};
+
+	std::vector <Source> sources;
+	std::set <std::string> dependencies;
+
+	ShaderStageBundle(const vk::Device &device, littlevk::Deallocator &dal)
+		: device(device), dal(dal) {}
+
+	// The stages point into the entries and specializations
+	ShaderStageBundle(const ShaderStageBundle &other)
+		: device(other.device),
+		dal(other.dal),
+		stages(other.stages),
+		entries(other.entries),
+		specializations(other.specializations),
+		reflection(other.reflection),
+		options(other.options),
+		sources(other.sources),
+		dependencies(other.dependencies) {
+		relink();
+	}
+
+	ShaderStageBundle &with_options(const shader::Options &options_) {
+		options = options_;
+		return *this;
+	}
+
+	// TODO: entry points
+	ShaderStageBundle &source(const std::string &glsl,
+				  vk::ShaderStageFlagBits flags,
+				  const std::string &entry = "main",
+				  const shader::Includes &includes = {},
+				  const shader::Defines &defines = {}) {
+		vk::ShaderModule module;
+
+		auto out = littlevk::shader::build(glsl, flags, includes, defines, options);
+		if (out) {
+			module = littlevk::shader::create(device, out->spirv).unwrap(dal);
+			reflection.merge(littlevk::shader::reflect(out->spirv, flags));
+			dependencies.insert(out->dependencies.begin(), out->dependencies.end());
+		}
+
+		sources.push_back({ glsl, std::nullopt, flags, includes, defines, options });
+		entries.emplace_back(entry);
+		specializations.emplace_back();
+		stages.push_back({ {}, flags, module });
+		relink();
+		return *this;
+	}
+
+	ShaderStageBundle &file(const std::filesystem::path &path,
+				vk::ShaderStageFlagBits flags,
+				const std::string &entry = "main",
+				const shader::Includes &includes = {},
+				const shader::Defines &defines = {}) {
+		std::filesystem::path parent = path.parent_path();
+		std::string glsl = standalone::readfile(path);
+
+		auto copy_includes = includes;
+		copy_includes.insert(parent.string());
+		source(glsl, flags, entry, copy_includes, defines);
+
+		sources.back().path = path;
+		dependencies.insert(path.string());
+		return *this;
+	}
+
+	// Recompiles every stage (rereading files) into a new bundle with the
+	// same specialization constants; the cache is bypassed, as it does not
+	// know about included files
+	std::optional <ShaderStageBundle> rebuild(littlevk::Deallocator &dal_) const {
+		ShaderStageBundle out(device, dal_);
+
+		auto entry = entries.begin();
+		for (size_t i = 0; i < sources.size(); i++, entry++) {
+			const Source &src = sources[i];
+
+			out.options = src.options;
+			out.options.cache = false;
+
+			std::string glsl = src.path ? standalone::readfile(*src.path) : src.glsl;
+			out.source(glsl, src.flags, *entry, src.includes, src.defines);
+
+			// Keep the original options for further rebuilds
+			out.sources.back().path = src.path;
+			out.sources.back().options = src.options;
+			out.specializations.back() = specializations[i];
+
+			if (src.path)
+				out.dependencies.insert(src.path->string());
+
+			if (!out.stages.back().module)
+				return std::nullopt;
+		}
+
+		out.options = options;
+		out.relink();
+		return out;
+	}
+
+	// Specialization constant of the most recently added stage
+	template <typename T>
+	ShaderStageBundle &spec(uint32_t id, const T &value) {
+		if (stages.empty()) {
+			microlog::error("spec", "No stage to specialize\n");
+			return *this;
+		}
+
+		specializations.back().set(id, value);
+		relink();
+		return *this;
+	}
+
+	// Specialization constant of the stage(s) of the given type
+	template <typename T>
+	ShaderStageBundle &spec(vk::ShaderStageFlagBits stage, uint32_t id, const T &value) {
+		bool found = false;
+		for (size_t i = 0; i < stages.size(); i++) {
+			if (stages[i].stage == stage) {
+				specializations[i].set(id, value);
+				found = true;
+			}
+		}
+
+		if (!found)
+			microlog::error("spec", "No %s stage to specialize\n", vk::to_string(stage).c_str());
+
+		relink();
+		return *this;
+	}
+
+	void relink() {
+		auto entry = entries.begin();
+		for (size_t i = 0; i < stages.size(); i++, entry++) {
+			stages[i].pName = entry->c_str();
+			stages[i].pSpecializationInfo = specializations[i].link();
+		}
+	}
+};
+
+// General purpose pipeline type
+struct Pipeline {
+	vk::Pipeline handle;
+	vk::PipelineLayout layout;
+	std::optional <vk::DescriptorSetLayout> dsl;
+	std::map <uint32_t, vk::DescriptorSetLayoutBinding> bindings;
+
+	// Every set layout and its bindings, indexed by set; dsl and bindings
+	// describe set 0
+	std::vector <vk::DescriptorSetLayout> dsls;
+	std::vector <std::vector <vk::DescriptorSetLayoutBinding>> set_bindings;
+
+	std::vector <vk::PushConstantRange> push_constants;
+};
+
+namespace detail {
+
+// Set layouts and the pipeline layout over them; shared layouts are used
+// as is (and owned elsewhere), sets without bindings get empty layouts so
+// that indices line up
+inline void assemble_pipeline_layout(const vk::Device &device,
+				     littlevk::Deallocator &dal,
+				     Pipeline &pipeline,
+				     const std::map <uint32_t, std::vector <vk::DescriptorSetLayoutBinding>> &sets,
+				     const std::map <uint32_t, vk::DescriptorSetLayout> &shared,
+				     const std::vector <vk::PushConstantRange> &push_constants)
+{
+	uint32_t count = 0;
+	if (sets.size())
+		count = std::max(count, sets.rbegin()->first + 1);
+	if (shared.size())
+		count = std::max(count, shared.rbegin()->first + 1);
+
+	for (uint32_t set = 0; set < count; set++) {
+		std::vector <vk::DescriptorSetLayoutBinding> bindings;
+		if (sets.count(set))
+			bindings = sets.at(set);
+
+		vk::DescriptorSetLayout dsl;
+		if (shared.count(set)) {
+			dsl = shared.at(set);
+		} else {
+			dsl = descriptor_set_layout(device,
+				vk::DescriptorSetLayoutCreateInfo {
+					{}, bindings
+				}).unwrap(dal);
+		}
+
+		pipeline.dsls.push_back(dsl);
+		pipeline.set_bindings.push_back(bindings);
+	}
+
+	if (count) {
+		pipeline.dsl = pipeline.dsls.front();
+		for (auto &dslb : pipeline.set_bindings.front())
+			pipeline.bindings[dslb.binding] = dslb;
+	}
+
+	pipeline.push_constants = push_constants;
+	pipeline.layout = littlevk::pipeline_layout(device,
+		vk::PipelineLayoutCreateInfo {
+			{}, pipeline.dsls, push_constants
+		}).unwrap(dal);
+}
+
+// Same, with the sets and push constants the shaders declare
+inline void assemble_pipeline_layout(const vk::Device &device,
+				     littlevk::Deallocator &dal,
+				     Pipeline &pipeline,
+				     const shader::Reflection &reflection,
+				     const std::map <uint32_t, vk::DescriptorSetLayout> &shared)
+{
+	std::map <uint32_t, std::vector <vk::DescriptorSetLayoutBinding>> sets;
+	for (const auto &[set, _] : reflection.sets)
+		sets[set] = reflection.bindings(set);
+
+	assemble_pipeline_layout(device, dal, pipeline, sets, shared, reflection.push_constants);
+}
+
+} // namespace detail
+
+// General purpose pipeline compiler
+enum PipelineType {
+	eGraphics,
+	eCompute,
+};
+
+template <PipelineType T>
+struct PipelineAssembler {};
+
+template <>
+struct PipelineAssembler <eGraphics> {
+	// Essential
+	const vk::Device &device;
+	const littlevk::Window &window;
+	littlevk::Deallocator &dal;
+
+	// Render pass
+	vk::RenderPass render_pass;
+	uint32_t subpass;
+
+	// Or attachment formats, for dynamic rendering
+	std::optional <std::vector <vk::Format>> color_formats;
+	vk::Format depth_format;
+
+	// Vertex information
+	std::vector <vk::VertexInputBindingDescription> vertex_bindings;
+	std::vector <vk::VertexInputAttributeDescription> vertex_attributes;
+
+	// Shader information
+	std::optional <std::reference_wrapper <const ShaderStageBundle>> bundle;
+
+	// Pipeline layout information, by set; shared layouts come from
+	// other pipelines
+	std::map <uint32_t, std::vector <vk::DescriptorSetLayoutBinding>> dsl_bindings;
+	std::map <uint32_t, vk::DescriptorSetLayout> shared_dsls;
+	std::vector <vk::PushConstantRange> push_constants;
+	bool reflected_layout;
+
+	// Extras
+	vk::PolygonMode fill;
+	vk::CullModeFlags culling;
+
+	bool depth_test;
+	bool depth_write;
+	bool alpha_blend;
+
+	PipelineAssembler(const vk::Device &device_,
+			  const littlevk::Window &window_,
+			  littlevk::Deallocator &dal_)
+		: device(device_),
+		window(window_),
+		dal(dal_),
+		subpass(0),
+		depth_format(vk::Format::eUndefined),
+		reflected_layout(false),
+		fill(vk::PolygonMode::eFill),
+		culling(vk::CullModeFlagBits::eBack),
+		depth_test(true),
+		depth_write(true),
+		alpha_blend(true) {}
+
+	PipelineAssembler &with_render_pass(const vk::RenderPass &render_pass_,
+					    uint32_t subpass_) {
+		render_pass = render_pass_;
+		subpass = subpass_;
+		return *this;
+	}
+
+	// Dynamic rendering; no render pass (or framebuffers) required
+	PipelineAssembler &with_rendering(const std::vector <vk::Format> &colors,
+					  vk::Format depth = vk::Format::eUndefined) {
+		color_formats = colors;
+		depth_format = depth;
+		return *this;
+	}
+
+	// Either a VertexLayout or a MultiVertexLayout
+	template <typename Layout>
+	requires requires { Layout::bindings; Layout::attributes; }
+	PipelineAssembler &with_vertex_layout(const Layout &) {
+		vertex_bindings = std::vector <vk::VertexInputBindingDescription>
+			(Layout::bindings.begin(), Layout::bindings.end());
+		vertex_attributes = std::vector <vk::VertexInputAttributeDescription>
+			(Layout::attributes.begin(), Layout::attributes.end());
+		return *this;
+	}
+
+	PipelineAssembler &with_vertex_binding(const vk::VertexInputBindingDescription &binding) {
+		vertex_bindings = { binding };
+		return *this;
+	}
+
+	PipelineAssembler &with_vertex_bindings(const std::vector <vk::VertexInputBindingDescription> &bindings) {
+		vertex_bindings = bindings;
+		return *this;
+	}
+
+	PipelineAssembler &with_vertex_attributes(const std::vector <vk::VertexInputAttributeDescription> &attributes) {
+		vertex_attributes = attributes;
+		return *this;
+	}
+
+	PipelineAssembler &with_shader_bundle(const ShaderStageBundle &sb) {
+		bundle = sb;
+		return *this;
+	}
+
+	PipelineAssembler &alpha_blending(bool blend) {
+		alpha_blend = blend;
+		return *this;
+	}
+
+	PipelineAssembler &polygon_mode(vk::PolygonMode pmode) {
+		fill = pmode;
+		return *this;
+	}
+
+	PipelineAssembler &cull_mode(vk::CullModeFlags cmode) {
+		culling = cmode;
+		return *this;
+	}
+
+	PipelineAssembler &depth_stencil(bool test, bool write) {
+		depth_test = test;
+		depth_write = write;
+		return *this;
+	}
+
+	PipelineAssembler &with_dsl_binding(uint32_t binding,
+					    vk::DescriptorType type,
+					    uint32_t count,
+					    vk::ShaderStageFlagBits stage) {
+		dsl_bindings[0].emplace_back(binding, type, count, stage);
+		return *this;
+	}
+
+	template <size_t N>
+	PipelineAssembler &with_dsl_bindings(const std::array <vk::DescriptorSetLayoutBinding, N> &bindings) {
+		return with_set_bindings(0, bindings);
+	}
+
+	// Bindings of other sets, e.g. 0 per frame, 1 per material, 2 per object
+	template <size_t N>
+	PipelineAssembler &with_set_bindings(uint32_t set, const std::array <vk::DescriptorSetLayoutBinding, N> &bindings) {
+		for (const auto &binding : bindings)
+			dsl_bindings[set].push_back(binding);
+		return *this;
+	}
+
+	// Reuse the layout of a set from another pipeline, so that descriptor
+	// sets bound for one stay valid when switching to the other
+	PipelineAssembler &with_set_layout(uint32_t set, const Pipeline &other) {
+		shared_dsls[set] = other.dsls.at(set);
+		dsl_bindings[set] = other.set_bindings.at(set);
+		return *this;
+	}
+
+	template <typename T>
+	PipelineAssembler &with_push_constant(vk::ShaderStageFlags stage, uint32_t offset = 0) {
+		push_constants.push_back({ stage, offset, sizeof(T) });
+		return *this;
+	}
+
+	// Derive the set layouts and push constant ranges from the shaders
+	// instead; other bindings and ranges given above are ignored, while
+	// shared set layouts are kept
+	PipelineAssembler &with_reflected_layout() {
+		reflected_layout = true;
+		return *this;
+	}
+
+	Pipeline compile() const {
+		Pipeline pipeline;
+
+		const ShaderStageBundle &stages = bundle.value().get();
+		if (reflected_layout) {
+			detail::assemble_pipeline_layout(device, dal, pipeline, stages.reflection, shared_dsls);
+
+			// Only presence is checked, formats may be packed differently
+			for (const auto &input : stages.reflection.vertex_inputs) {
+				auto it = std::find_if(vertex_attributes.begin(), vertex_attributes.end(),
+					[&](const vk::VertexInputAttributeDescription &attribute) {
+						return attribute.location == input.location;
+					});
+
+				if (it == vertex_attributes.end()) {
+					microlog::warning("pipeline",
+						"No vertex attribute given for shader input at location %u\n",
+						input.location);
+				}
+			}
+		} else {
+			detail::assemble_pipeline_layout(device, dal, pipeline, dsl_bindings, shared_dsls, push_constants);
+		}
+
+		pipeline::GraphicsCreateInfo pipeline_info;
+
+		pipeline_info.shader_stages = stages.stages;
+		if (vertex_bindings.size()) {
+			pipeline_info.vertex_binding = vertex_bindings;
+			pipeline_info.vertex_attributes = vertex_attributes;
+		}
+		pipeline_info.extent = window.extent;
+		pipeline_info.pipeline_layout = pipeline.layout;
+		pipeline_info.render_pass = render_pass;
+		pipeline_info.subpass = subpass;
+		pipeline_info.color_formats = color_formats;
+		pipeline_info.depth_format = depth_format;
+		pipeline_info.fill_mode = fill;
+		pipeline_info.cull_mode = culling;
+		pipeline_info.dynamic_viewport = true;
+		pipeline_info.alpha_blend = alpha_blend;
+		pipeline_info.depth_test = depth_test;
+		pipeline_info.depth_write = depth_write;
+
+		pipeline.handle = littlevk::pipeline::compile(device, pipeline_info).unwrap(dal);
+
+		return pipeline;
+	}
+
+	operator Pipeline() const { return compile(); }
+};
+
+template <>
+struct PipelineAssembler <eCompute> {
+	// Essential
+	const vk::Device &device;
+	littlevk::Deallocator &dal;
+
+	// Shader information
+	std::optional <std::reference_wrapper <const ShaderStageBundle>> bundle;
+
+	// Pipeline layout information, by set; shared layouts come from
+	// other pipelines
+	std::map <uint32_t, std::vector <vk::DescriptorSetLayoutBinding>> dsl_bindings;
+	std::map <uint32_t, vk::DescriptorSetLayout> shared_dsls;
+	std::vector <vk::PushConstantRange> push_constants;
+	bool reflected_layout;
+
+	PipelineAssembler(const vk::Device &device_,
+			  littlevk::Deallocator &dal_)
+		: device(device_), dal(dal_), reflected_layout(false)  {}
+
+	PipelineAssembler &with_shader_bundle(const ShaderStageBundle &sb) {
+		bundle = sb;
+		return *this;
+	}
+
+	PipelineAssembler &with_dsl_binding(uint32_t binding,
+					    vk::DescriptorType type,
+					    uint32_t count,
+					    vk::ShaderStageFlagBits stage) {
+		dsl_bindings[0].emplace_back(binding, type, count, stage);
+		return *this;
+	}
+
+	template <size_t N>
+	PipelineAssembler &with_dsl_bindings(const std::array<vk::DescriptorSetLayoutBinding, N> &bindings) {
+		return with_set_bindings(0, bindings);
+	}
+
+	// Bindings of other sets, e.g. 0 per frame, 1 per material, 2 per object
+	template <size_t N>
+	PipelineAssembler &with_set_bindings(uint32_t set, const std::array <vk::DescriptorSetLayoutBinding, N> &bindings) {
+		for (const auto &binding : bindings)
+			dsl_bindings[set].push_back(binding);
+		return *this;
+	}
+
+	// Reuse the layout of a set from another pipeline, so that descriptor
+	// sets bound for one stay valid when switching to the other
+	PipelineAssembler &with_set_layout(uint32_t set, const Pipeline &other) {
+		shared_dsls[set] = other.dsls.at(set);
+		dsl_bindings[set] = other.set_bindings.at(set);
+		return *this;
+	}
+
+	template <typename T>
+	PipelineAssembler &with_push_constant(vk::ShaderStageFlagBits stage) {
+		push_constants.push_back(
+			vk::PushConstantRange {stage, 0, sizeof(T)});
+		return *this;
+	}
+
+	// Derive the set layouts and push constant ranges from the shader
+	// instead; other bindings and ranges given above are ignored, while
+	// shared set layouts are kept
+	PipelineAssembler &with_reflected_layout() {
+		reflected_layout = true;
+		return *this;
+	}
+
+	Pipeline compile() const {
+		Pipeline pipeline;
+
+		const ShaderStageBundle &stages = bundle.value().get();
+		if (reflected_layout) {
+			detail::assemble_pipeline_layout(device, dal, pipeline, stages.reflection, shared_dsls);
+		} else {
+			detail::assemble_pipeline_layout(device, dal, pipeline, dsl_bindings, shared_dsls, push_constants);
+		}
+
+		pipeline::ComputeCreateInfo pipeline_info;
+
+		pipeline_info.shader_stage = stages.stages.front();
+		pipeline_info.pipeline_layout = pipeline.layout;
+
+		pipeline.handle =
+			littlevk::pipeline::compile(device, pipeline_info)
+				.unwrap(dal);
+
+		return pipeline;
+	}
+
+	operator Pipeline() const {
+		return compile();
+	}
+};
+
+// Binds pipelines and descriptor sets while recording, skipping whatever
+// is already bound; sets stay bound across pipelines as long as the layouts
+// up to them are the same (see with_set_layout), so that e.g. a per-frame
+// set 0 is bound once and only the per-object sets change between draws
+struct DescriptorBinder {
+	vk::CommandBuffer cmd;
+	vk::PipelineBindPoint bind_point;
+
+	vk::Pipeline pipeline;
+	vk::PipelineLayout layout;
+	std::vector <vk::DescriptorSetLayout> dsls;
+	std::vector <vk::PushConstantRange> push_constants;
+
+	// Currently bound sets, null where nothing valid is bound
+	std::vector <vk::DescriptorSet> bound;
+
+	DescriptorBinder(const vk::CommandBuffer &cmd_,
+			 vk::PipelineBindPoint bind_point_ = vk::PipelineBindPoint::eGraphics)
+		: cmd(cmd_), bind_point(bind_point_) {}
+
+	DescriptorBinder &use(const Pipeline &next) {
+		if (next.handle == pipeline)
+			return *this;
+
+		cmd.bindPipeline(bind_point, next.handle);
+		pipeline = next.handle;
+
+		if (next.layout != layout) {
+			// Sets past the first differing layout are disturbed; any
+			// difference in push constants disturbs all of them
+			uint32_t kept = 0;
+			if (next.push_constants == push_constants) {
+				while (kept < std::min(dsls.size(), next.dsls.size())
+						&& dsls[kept] == next.dsls[kept])
+					kept++;
+			}
 
-template <typename T, bool instantiated = true>
-struct type_translator {
-	static_assert(!instantiated, "Unsupported format translation for this type");
-	static constexpr vk::Format format = vk::Format::eUndefined;
+			bound.resize(std::min <size_t> (bound.size(), kept));
+
+			layout = next.layout;
+			dsls = next.dsls;
+			push_constants = next.push_constants;
+		}
+
+		return *this;
+	}
+
+	DescriptorBinder &bind(uint32_t set, const vk::DescriptorSet &dset) {
+		return bind(set, vk::ArrayProxy <const vk::DescriptorSet> (dset));
+	}
+
+	// Consecutive sets starting at first; only runs of changed sets are bound
+	DescriptorBinder &bind(uint32_t first, const vk::ArrayProxy <const vk::DescriptorSet> &dsets) {
+		const vk::DescriptorSet *sets = dsets.data();
+		const uint32_t count = dsets.size();
+
+		if (bound.size() < first + count)
+			bound.resize(first + count);
+
+		uint32_t i = 0;
+		while (i < count) {
+			if (bound[first + i] == sets[i]) {
+				i++;
+				continue;
+			}
+
+			uint32_t end = i;
+			while (end < count && bound[first + end] != sets[end]) {
+				bound[first + end] = sets[end];
+				end++;
+			}
+
+			cmd.bindDescriptorSets(bind_point, layout, first + i,
+				vk::ArrayProxy <const vk::DescriptorSet> (end - i, &sets[i]), {});
+
+			i = end;
+		}
+
+		return *this;
+	}
+
+	template <typename T>
+	DescriptorBinder &push(vk::ShaderStageFlags stages, const T &value, uint32_t offset = 0) {
+		cmd.pushConstants <T> (layout, stages, offset, value);
+		return *this;
+	}
 };
 
-template <uint32_t index, uint32_t offset, typename T>
-constexpr vk::VertexInputAttributeDescription attribute_for()
-{
-	return vk::VertexInputAttributeDescription {
-		index, 0,
-		type_translator <T> ::format,
-		offset
+// Recompiles the shaders of tracked pipelines when their files (or any file
+// they include) change; compilation happens on a background thread, so the
+// frame loop never waits on glslang. Call update() once per frame, after
+// waiting on the frame's fence, to swap in the rebuilt pipelines.
+//
+// Only the pipeline handles are swapped; layouts, and so descriptor sets,
+// are kept, and shader edits which change the layout still need a restart.
+//
+//	reloader.track(ppl, bundle, [&](littlevk::Deallocator &dal, const littlevk::ShaderStageBundle &sb) {
+//		return littlevk::PipelineAssembler <littlevk::eGraphics> (device, window, dal)
+//			.with_shader_bundle(sb)
+//			...;
+//	});
+struct ShaderReloader {
+	using Builder = std::function <Pipeline (littlevk::Deallocator &, const ShaderStageBundle &)>;
+
+	struct Entry {
+		Pipeline *target;
+		ShaderStageBundle bundle;
+		Builder builder;
+
+		// Normalized paths of every file read for the bundle
+		std::set <std::string> files;
 	};
+
+	// A rebuilt pipeline, with everything created for it
+	struct Generation {
+		std::unique_ptr <littlevk::Deallocator> dal;
+		Entry *entry;
+		Pipeline pipeline;
+		shader::Reflection reflection;
+		uint32_t frames = 0;
+	};
+
+	vk::Device device;
+	uint32_t frames = 0;
+
+	std::list <Entry> entries;
+
+	// Built by the watcher, swapped in and awaiting destruction
+	std::vector <Generation> ready;
+	std::map <Entry *, Generation> current;
+	std::vector <Generation> retired;
+
+	std::thread watcher;
+	std::mutex lock;
+	std::atomic <bool> running = false;
+
+#ifdef __linux__
+	int notify = -1;
+	std::map <int, std::string> watches;
+#else
+	std::map <std::string, std::filesystem::file_time_type> timestamps;
+#endif
+
+	// Frames in flight bound how long replaced pipelines are kept
+	bool start(const vk::Device &, uint32_t);
+
+	// Destroys the rebuilt pipelines as well; call once the device is idle
+	void stop();
+
+	// Only stops watching, as the device may already be gone; rebuilt
+	// pipelines are left to stop()
+	~ShaderReloader() {
+		unwatch();
+	}
+
+	void unwatch();
+
+	void track(Pipeline &, const ShaderStageBundle &, const Builder &);
+
+	// Swaps in the pipelines rebuilt since the last call
+	uint32_t update();
+
+	void run();
+	std::set <std::string> changes(const std::set <std::string> &);
+
+	static std::string normalize(const std::filesystem::path &path) {
+		std::error_code ec;
+		std::filesystem::path absolute = std::filesystem::absolute(path, ec);
+		return (ec ? path : absolute).lexically_normal().string();
+	}
+};
+
+inline bool ShaderReloader::start(const vk::Device &device_, uint32_t frames_)
+{
+	device = device_;
+	frames = frames_;
+
+#ifdef __linux__
+	notify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (notify < 0) {
+		microlog::error("shader reloader", "Failed to initialize inotify\n");
+		return false;
+	}
+#endif
+
+	running = true;
+	watcher = std::thread(&ShaderReloader::run, this);
+
+	return true;
 }
 
-template <uint32_t index, uint32_t offset, typename T, typename... Args>
-constexpr std::array <vk::VertexInputAttributeDescription, 1 + sizeof...(Args)>
-attributes_for()
+inline void ShaderReloader::unwatch()
 {
-	if constexpr (sizeof...(Args)) {
-		auto previous = attributes_for <index + 1, offset + sizeof(T), Args...> ();
-		std::array <vk::VertexInputAttributeDescription, 1 + sizeof...(Args)> out;
-		out[0] = attribute_for<index, offset, T>();
-		for (uint32_t i = 0; i < sizeof...(Args); i++)
-			out[i + 1] = previous[i];
-		return out;
-	} else {
-		return { attribute_for <index, offset, T> () };
+	running = false;
+	if (watcher.joinable())
+		watcher.join();
+
+#ifdef __linux__
+	if (notify >= 0)
+		close(notify);
+
+	notify = -1;
+	watches.clear();
+#endif
+}
+
+inline void ShaderReloader::stop()
+{
+	unwatch();
+
+	for (Generation &generation : ready)
+		generation.dal->drop();
+	for (auto &[_, generation] : current)
+		generation.dal->drop();
+	for (Generation &generation : retired)
+		generation.dal->drop();
+
+	ready.clear();
+	current.clear();
+	retired.clear();
+}
+
+inline void ShaderReloader::track(Pipeline &pipeline, const ShaderStageBundle &bundle, const Builder &builder)
+{
+	std::set <std::string> files;
+	for (const auto &file : bundle.dependencies)
+		files.insert(normalize(file));
+
+	std::lock_guard <std::mutex> guard(lock);
+	entries.push_back({ &pipeline, bundle, builder, files });
+}
+
+inline uint32_t ShaderReloader::update()
+{
+	std::lock_guard <std::mutex> guard(lock);
+
+	// Replaced pipelines are destroyed once no frame in flight can use them
+	for (auto it = retired.begin(); it != retired.end(); ) {
+		if (--it->frames == 0) {
+			it->dal->drop();
+			it = retired.erase(it);
+		} else {
+			it++;
+		}
+	}
+
+	uint32_t swapped = 0;
+	for (Generation &generation : ready) {
+		// Compared on the shaders, as builders may give layouts explicitly
+		Pipeline &target = *generation.entry->target;
+		if (!generation.reflection.same_layout(generation.entry->bundle.reflection)) {
+			microlog::warning("shader reloader",
+				"Pipeline layout changed with the shaders; restart to apply\n");
+			generation.dal->drop();
+			continue;
+		}
+
+		// The layouts are compatible, so the old one is still used for binding
+		target.handle = generation.pipeline.handle;
+
+		auto it = current.find(generation.entry);
+		if (it != current.end()) {
+			it->second.frames = std::max(frames, 1u);
+			retired.push_back(std::move(it->second));
+			current.erase(it);
+		}
+
+		current.emplace(generation.entry, std::move(generation));
+		swapped++;
 	}
+
+	ready.clear();
+
+	return swapped;
 }
 
-template <typename... Args>
-struct VertexLayout {
-	static constexpr size_t size = sizeof_all <Args...> ();
+inline void ShaderReloader::run()
+{
+	while (running) {
+		std::set <std::string> files;
+		{
+			std::lock_guard <std::mutex> guard(lock);
+			for (const Entry &entry : entries)
+				files.insert(entry.files.begin(), entry.files.end());
+		}
 
-	static constexpr vk::VertexInputBindingDescription binding {
-		0, size, vk::VertexInputRate::eVertex
+		std::set <std::string> changed = changes(files);
+		if (changed.empty())
+			continue;
+
+		std::vector <Entry *> affected;
+		{
+			std::lock_guard <std::mutex> guard(lock);
+			for (Entry &entry : entries) {
+				bool hit = std::any_of(changed.begin(), changed.end(),
+					[&](const std::string &file) { return entry.files.count(file); });
+
+				if (hit)
+					affected.push_back(&entry);
+			}
+		}
+
+		for (Entry *entry : affected) {
+			auto dal = std::make_unique <littlevk::Deallocator> (device);
+
+			// Errors are logged; the current pipeline stays in use
+			auto bundle = entry->bundle.rebuild(*dal);
+			if (!bundle) {
+				dal->drop();
+				continue;
+			}
+
+			Pipeline pipeline = entry->builder(*dal, *bundle);
+			if (!pipeline.handle) {
+				dal->drop();
+				continue;
+			}
+
+			microlog::info("shader reloader", "Rebuilt pipeline after changes to its shaders\n");
+
+			std::lock_guard <std::mutex> guard(lock);
+
+			// Includes may have changed as well
+			entry->files.clear();
+			for (const auto &file : bundle->dependencies)
+				entry->files.insert(normalize(file));
+
+			ready.push_back({ std::move(dal), entry, pipeline, bundle->reflection });
+		}
+	}
+}
+
+#ifdef __linux__
+
+inline std::set <std::string> ShaderReloader::changes(const std::set <std::string> &files)
+{
+	// Directories are watched rather than files, since editors often
+	// replace files instead of writing to them
+	for (const auto &file : files) {
+		std::string directory = std::filesystem::path(file).parent_path().string();
+
+		bool watched = std::any_of(watches.begin(), watches.end(),
+			[&](const auto &watch) { return watch.second == directory; });
+
+		if (!watched) {
+			int wd = inotify_add_watch(notify, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+			if (wd >= 0)
+				watches[wd] = directory;
+		}
+	}
+
+	pollfd descriptor { notify, POLLIN, 0 };
+	if (poll(&descriptor, 1, 100) <= 0)
+		return {};
+
+	// Let the editor finish saving
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+	std::set <std::string> changed;
+
+	alignas(inotify_event) char buffer[4096];
+	ssize_t length;
+	while ((length = read(notify, buffer, sizeof(buffer))) > 0) {
+		for (char *ptr = buffer; ptr < buffer + length; ) {
+			const inotify_event *event = (const inotify_event *) ptr;
+
+			auto it = watches.find(event->wd);
+			if (event->len && it != watches.end())
+				changed.insert(normalize(it->second + "/" + event->name));
+
+			ptr += sizeof(inotify_event) + event->len;
+		}
+	}
+
+	return changed;
+}
+
+#else
+
+// Polls modification times elsewhere
+inline std::set <std::string> ShaderReloader::changes(const std::set <std::string> &files)
+{
+	std::this_thread::sleep_for(std::chrono::milliseconds(250));
+
+	std::set <std::string> changed;
+	for (const auto &file : files) {
+		std::error_code ec;
+		auto time = std::filesystem::last_write_time(file, ec);
+		if (ec)
+			continue;
+
+		auto it = timestamps.find(file);
+		if (it == timestamps.end()) {
+			timestamps[file] = time;
+		} else if (it->second != time) {
+			it->second = time;
+			changed.insert(file);
+		}
+	}
+
+	return changed;
+}
+
+#endif
+
+// GPU driven rendering; objects are culled by a compute pass which writes
+// the indirect draws, so submission cost does not depend on object count
+
+// Per-object data read by the culling pass (std430); the object index is
+// passed as the first instance, i.e. gl_InstanceIndex in vertex shaders,
+// which needs the drawIndirectFirstInstance feature (see IndirectCuller)
+struct IndirectObject {
+	std::array <float, 4> sphere;	// World space center and radius
+	uint32_t index_count;
+	uint32_t first_index;
+	int32_t vertex_offset;
+	uint32_t payload;		// User data, e.g. a material index
+};
+
+static_assert(sizeof(IndirectObject) == 32);
+
+// Parameters of a culling pass (std140); matrices are column major, depth
+// is expected in [0, 1] with smaller values closer. The object count and
+// pyramid extent are filled in by the culler
+struct CullingParameters {
+	std::array <float, 16> view;
+	std::array <std::array <float, 4>, 6> planes;
+	std::array <float, 4> projection;	// P00, P11, near, far
+	std::array <float, 2> pyramid;		// Extent of the first pyramid level
+	uint32_t object_count;
+	uint32_t padding;
+};
+
+static_assert(sizeof(CullingParameters) == 192);
+
+// Normalized, inward facing frustum planes of a view-projection matrix
+inline std::array <std::array <float, 4>, 6> frustum_planes(const std::array <float, 16> &viewproj,
+							      bool zero_to_one = true)
+{
+	auto row = [&](uint32_t i) {
+		return std::array <float, 4> {
+			viewproj[i], viewproj[4 + i], viewproj[8 + i], viewproj[12 + i]
+		};
 	};
 
-	static constexpr std::array <vk::VertexInputAttributeDescription, sizeof...(Args)> attributes {
-		attributes_for <0, 0, Args...> ()
+	auto normalize = [](std::array <float, 4> plane) {
+		float length = std::sqrt(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+		for (float &v : plane)
+			v /= length;
+
+		return plane;
+	};
+
+	auto combine = [&](const std::array <float, 4> &a, const std::array <float, 4> &b, float sign) {
+		std::array <float, 4> plane;
+		for (uint32_t i = 0; i < 4; i++)
+			plane[i] = a[i] + sign * b[i];
+
+		return normalize(plane);
+	};
+
+	std::array <float, 4> r0 = row(0);
+	std::array <float, 4> r1 = row(1);
+	std::array <float, 4> r2 = row(2);
+	std::array <float, 4> r3 = row(3);
+
+	return {
+		combine(r3, r0, 1.0f),
+		combine(r3, r0, -1.0f),
+		combine(r3, r1, 1.0f),
+		combine(r3, r1, -1.0f),
+		zero_to_one ? normalize(r2) : combine(r3, r2, 1.0f),
+		combine(r3, r2, -1.0f)
 	};
+}
+
+namespace detail {
+
+// Frustum and (with LITTLEVK_HIZ) depth pyramid occlusion culling; with
+// LITTLEVK_COMPACT visible draws are packed and counted, otherwise every
+// object keeps its slot and culled ones get zero instances. The object
+// index goes into the first instance only with LITTLEVK_FIRST_INSTANCE
+constexpr const char *culling_shader = R"(#version 450
+
+layout (local_size_x = 64) in;
+
+struct Object {
+	vec4 sphere;
+	uint index_count;
+	uint first_index;
+	int vertex_offset;
+	uint payload;
 };
 
-// Group of shaders for a pipeline
-struct ShaderStageBundle {
-	vk::Device device;
-	littlevk::Deallocator &dal;
+struct Command {
+	uint index_count;
+	uint instance_count;
+	uint first_index;
+	int vertex_offset;
+	uint first_instance;
+};
 
-	std::vector <vk::PipelineShaderStageCreateInfo> stages;
+layout (binding = 0, std430) readonly buffer Objects {
+	Object objects[];
+};
 
-	ShaderStageBundle(const vk::Device &device, littlevk::Deallocator &dal)
-		: device(device), dal(dal) {}
+layout (binding = 1, std430) writeonly buffer Commands {
+	Command commands[];
+};
 
-	// TODO: entry points
-	ShaderStageBundle &source(const std::string &glsl,
-				  vk::ShaderStageFlagBits flags,
-				  const std::string &entry = "main",
-				  const shader::Includes &includes = {},
-				  const shader::Defines &defines = {}) {
-		vk::ShaderModule module = littlevk::shader::compile(device, glsl, flags, includes, defines).unwrap(dal);
-		stages.push_back({ {}, flags, module, entry.c_str() });
-		return *this;
+layout (binding = 2, std430) buffer Count {
+	uint count;
+};
+
+layout (binding = 3) uniform Parameters {
+	mat4 view;
+	vec4 planes[6];
+	vec4 projection;
+	vec2 pyramid;
+	uint object_count;
+};
+
+#ifdef LITTLEVK_HIZ
+
+layout (binding = 4) uniform sampler2D depth_pyramid;
+
+// Screen space bounds of a view space sphere (looking down +Z)
+bool project_sphere(vec3 c, float r, out vec4 aabb)
+{
+	if (c.z < r + projection.z)
+		return false;
+
+	vec3 cr = c * r;
+	float czr2 = c.z * c.z - r * r;
+
+	float vx = sqrt(c.x * c.x + czr2);
+	float minx = (vx * c.x - cr.z) / (vx * c.z + cr.x);
+	float maxx = (vx * c.x + cr.z) / (vx * c.z - cr.x);
+
+	float vy = sqrt(c.y * c.y + czr2);
+	float miny = (vy * c.y - cr.z) / (vy * c.z + cr.y);
+	float maxy = (vy * c.y + cr.z) / (vy * c.z - cr.y);
+
+	aabb = vec4(minx * projection.x, miny * projection.y,
+		    maxx * projection.x, maxy * projection.y);
+
+	return true;
+}
+
+bool occluded(vec3 center, float radius)
+{
+	vec3 c = (view * vec4(center, 1.0)).xyz;
+	c.z = -c.z;
+
+	vec4 aabb;
+	if (!project_sphere(c, radius, aabb))
+		return false;
+
+	vec2 lo = clamp(min(aabb.xy, aabb.zw) * 0.5 + 0.5, 0.0, 1.0);
+	vec2 hi = clamp(max(aabb.xy, aabb.zw) * 0.5 + 0.5, 0.0, 1.0);
+
+	// Level at which the bounds cover at most 2x2 texels
+	vec2 footprint = (hi - lo) * pyramid;
+	float level = ceil(log2(max(max(footprint.x, footprint.y), 1.0)));
+	int lod = int(min(level, float(textureQueryLevels(depth_pyramid) - 1)));
+
+	ivec2 size = textureSize(depth_pyramid, lod);
+	ivec2 a = clamp(ivec2(lo * vec2(size)), ivec2(0), size - 1);
+	ivec2 b = clamp(ivec2(hi * vec2(size)), ivec2(0), size - 1);
+
+	float depth = max(max(texelFetch(depth_pyramid, a, lod).r,
+			      texelFetch(depth_pyramid, ivec2(b.x, a.y), lod).r),
+			  max(texelFetch(depth_pyramid, ivec2(a.x, b.y), lod).r,
+			      texelFetch(depth_pyramid, b, lod).r));
+
+	float near = projection.z;
+	float far = projection.w;
+	float closest = far / (far - near) * (1.0 - near / (c.z - radius));
+
+	return closest > depth;
+}
+
+#endif
+
+void main()
+{
+	uint i = gl_GlobalInvocationID.x;
+	if (i >= object_count)
+		return;
+
+	Object object = objects[i];
+
+	bool visible = true;
+	for (int p = 0; p < 6; p++)
+		visible = visible && dot(planes[p], vec4(object.sphere.xyz, 1.0)) > -object.sphere.w;
+
+#ifdef LITTLEVK_HIZ
+	visible = visible && !occluded(object.sphere.xyz, object.sphere.w);
+#endif
+
+#ifdef LITTLEVK_FIRST_INSTANCE
+	uint first_instance = i;
+#else
+	uint first_instance = 0;
+#endif
+
+#ifdef LITTLEVK_COMPACT
+	if (visible) {
+		uint slot = atomicAdd(count, 1);
+		commands[slot] = Command(object.index_count, 1, object.first_index, object.vertex_offset, first_instance);
 	}
+#else
+	commands[i] = Command(object.index_count, visible ? 1 : 0, object.first_index, object.vertex_offset, first_instance);
+#endif
+}
+)";
 
-	ShaderStageBundle &file(const std::filesystem::path &path,
-				vk::ShaderStageFlagBits flags,
-				const std::string &entry = "main",
-				const shader::Includes &includes = {},
-				const shader::Defines &defines = {}) {
-		std::filesystem::path parent = path.parent_path();
-		std::string glsl = standalone::readfile(path);
+// Max reduction of a depth level into the next one, folding in the
+// trailing row or column of odd sized sources
+constexpr const char *depth_reduce_shader = R"(#version 450
+
+layout (local_size_x = 8, local_size_y = 8) in;
+
+layout (binding = 0) uniform sampler2D source;
+layout (binding = 1, r32f) uniform writeonly image2D destination;
+
+layout (push_constant) uniform Extents {
+	ivec2 size;
+	ivec2 source_size;
+};
+
+void main()
+{
+	ivec2 p = ivec2(gl_GlobalInvocationID.xy);
+	if (any(greaterThanEqual(p, size)))
+		return;
+
+	ivec2 base = 2 * p;
+	ivec2 limit = source_size - 1;
+
+	ivec2 extent = ivec2(1);
+	if (p.x == size.x - 1 && (source_size.x & 1) == 1)
+		extent.x = 2;
+	if (p.y == size.y - 1 && (source_size.y & 1) == 1)
+		extent.y = 2;
+
+	float depth = 0.0;
+	for (int y = 0; y <= extent.y; y++) {
+		for (int x = 0; x <= extent.x; x++)
+			depth = max(depth, texelFetch(source, min(base + ivec2(x, y), limit), 0).r);
+	}
+
+	imageStore(destination, p, vec4(depth));
+}
+)";
+
+inline vk::Sampler nearest_clamp_sampler(const vk::Device &device, Deallocator &dal)
+{
+	vk::SamplerCreateInfo info {
+		{},
+		vk::Filter::eNearest,
+		vk::Filter::eNearest,
+		vk::SamplerMipmapMode::eNearest,
+		vk::SamplerAddressMode::eClampToEdge,
+		vk::SamplerAddressMode::eClampToEdge,
+		vk::SamplerAddressMode::eClampToEdge,
+		0.0f, vk::False, 1.0f, vk::False,
+		vk::CompareOp::eAlways,
+		0.0f, VK_LOD_CLAMP_NONE,
+		vk::BorderColor::eFloatOpaqueWhite,
+		vk::False
+	};
+
+	return sampler(device, info).unwrap(dal);
+}
+
+} // namespace detail
+
+// Hierarchical depth buffer; each level holds the farthest depth of the
+// texels below it. The source depth image must be sampled and in the
+// shader read only layout while building
+struct DepthPyramid {
+	Image image;
+	vk::Extent2D source;
+	std::vector <vk::ImageView> levels;
+	vk::Sampler sampler;
+	Pipeline pipeline;
+	std::vector <vk::DescriptorSet> descriptors;
+
+	vk::Extent2D extent() const {
+		return image.extent;
+	}
+
+	void build(const vk::CommandBuffer &cmd) const {
+		// Contents are rebuilt from scratch, after the previous reads
+		vk::ImageMemoryBarrier2 discard {
+			vk::PipelineStageFlagBits2::eComputeShader,
+			vk::AccessFlagBits2::eShaderSampledRead,
+			vk::PipelineStageFlagBits2::eComputeShader,
+			vk::AccessFlagBits2::eShaderStorageWrite,
+			vk::ImageLayout::eUndefined,
+			vk::ImageLayout::eGeneral,
+			VK_QUEUE_FAMILY_IGNORED,
+			VK_QUEUE_FAMILY_IGNORED,
+			image.image,
+			{ vk::ImageAspectFlagBits::eColor, 0, image.mip_levels, 0, 1 }
+		};
+
+		detail::pipeline_barrier(cmd, discard);
+
+		vk::MemoryBarrier2 level_barrier {
+			vk::PipelineStageFlagBits2::eComputeShader,
+			vk::AccessFlagBits2::eShaderStorageWrite,
+			vk::PipelineStageFlagBits2::eComputeShader,
+			vk::AccessFlagBits2::eShaderSampledRead
+		};
+
+		cmd.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline.handle);
+
+		vk::Extent2D source = this->source;
+		for (uint32_t i = 0; i < image.mip_levels; i++) {
+			vk::Extent2D size {
+				std::max(image.extent.width >> i, 1u),
+				std::max(image.extent.height >> i, 1u)
+			};
+
+			std::array <int32_t, 4> extents {
+				int32_t(size.width), int32_t(size.height),
+				int32_t(source.width), int32_t(source.height)
+			};
+
+			cmd.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipeline.layout, 0, descriptors[i], {});
+			cmd.pushConstants <std::array <int32_t, 4>> (pipeline.layout, vk::ShaderStageFlagBits::eCompute, 0, extents);
+			cmd.dispatch((size.width + 7) / 8, (size.height + 7) / 8, 1);
+
+			// Also makes the last level visible to culling
+			detail::pipeline_barrier(cmd, level_barrier);
 
-		auto copy_includes = includes;
-		copy_includes.insert(parent.string());
-		vk::ShaderModule module = littlevk::shader::compile(device, glsl, flags, copy_includes, defines).unwrap(dal);
-		stages.push_back({ {}, flags, module, entry.c_str() });
-		return *this;
+			source = size;
+		}
 	}
 };
 
-// General purpose pipeline type
-struct Pipeline {
-	vk::Pipeline handle;
-	vk::PipelineLayout layout;
-	std::optional <vk::DescriptorSetLayout> dsl;
-	std::map <uint32_t, vk::DescriptorSetLayoutBinding> bindings;
-};
+inline DepthPyramid depth_pyramid(const vk::Device &device,
+				  const vk::PhysicalDeviceMemoryProperties &properties,
+				  Deallocator &dal,
+				  const Image &depth,
+				  vk::ImageLayout depth_layout = vk::ImageLayout::eShaderReadOnlyOptimal)
+{
+	DepthPyramid pyramid;
+	pyramid.source = depth.extent;
 
-// General purpose pipeline compiler
-enum PipelineType {
-	eGraphics,
-	eCompute,
-};
+	// First level is half the depth resolution
+	vk::Extent2D extent {
+		std::max((depth.extent.width + 1) / 2, 1u),
+		std::max((depth.extent.height + 1) / 2, 1u)
+	};
 
-template <PipelineType T>
-struct PipelineAssembler {};
+	uint32_t levels = mip_level_count(extent);
 
-template <>
-struct PipelineAssembler <eGraphics> {
-	// Essential
-	const vk::Device &device;
-	const littlevk::Window &window;
-	littlevk::Deallocator &dal;
+	pyramid.image = image(device,
+		ImageCreateInfo {
+			extent,
+			vk::Format::eR32Sfloat,
+			vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eSampled,
+			vk::ImageAspectFlagBits::eColor,
+			vk::ImageType::e2D,
+			vk::ImageViewType::e2D,
+			false, levels
+		}, properties).unwrap(dal);
+
+	for (uint32_t i = 0; i < levels; i++) {
+		vk::ImageView view = device.createImageView({
+			{}, pyramid.image.image,
+			vk::ImageViewType::e2D, vk::Format::eR32Sfloat, {},
+			{ vk::ImageAspectFlagBits::eColor, i, 1, 0, 1 }
+		});
 
-	// Render pass
-	vk::RenderPass render_pass;
-	uint32_t subpass;
+		dal.device_deallocators.push([view](vk::Device device) {
+			device.destroyImageView(view);
+		});
 
-	// Vertex information
-	std::optional <vk::VertexInputBindingDescription> vertex_binding;
-	std::vector <vk::VertexInputAttributeDescription> vertex_attributes;
+		pyramid.levels.push_back(view);
+	}
 
-	// Shader information
-	std::optional <std::reference_wrapper <const ShaderStageBundle>> bundle;
+	pyramid.sampler = detail::nearest_clamp_sampler(device, dal);
 
-	// Pipeline layout information
-	std::vector <vk::DescriptorSetLayoutBinding> dsl_bindings;
-	std::vector <vk::PushConstantRange> push_constants;
+	auto bundle = ShaderStageBundle(device, dal)
+		.source(detail::depth_reduce_shader, vk::ShaderStageFlagBits::eCompute);
 
-	// Extras
-	vk::PolygonMode fill;
-	vk::CullModeFlags culling;
+	auto assembler = PipelineAssembler <eCompute> (device, dal)
+		.with_shader_bundle(bundle)
+		.with_dsl_binding(0, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eCompute)
+		.with_dsl_binding(1, vk::DescriptorType::eStorageImage, 1, vk::ShaderStageFlagBits::eCompute)
+		.with_push_constant <std::array <int32_t, 4>> (vk::ShaderStageFlagBits::eCompute);
 
-	bool depth_test;
-	bool depth_write;
-	bool alpha_blend;
+	pyramid.pipeline = assembler.compile();
 
-	PipelineAssembler(const vk::Device &device_,
-			  const littlevk::Window &window_,
-			  littlevk::Deallocator &dal_)
-		: device(device_),
-		window(window_),
-		dal(dal_),
-		subpass(0),
-		fill(vk::PolygonMode::eFill),
-		culling(vk::CullModeFlagBits::eBack),
-		depth_test(true),
-		depth_write(true),
-		alpha_blend(true) {}
+	std::array <vk::DescriptorPoolSize, 2> sizes {
+		vk::DescriptorPoolSize { vk::DescriptorType::eCombinedImageSampler, levels },
+		vk::DescriptorPoolSize { vk::DescriptorType::eStorageImage, levels }
+	};
 
-	PipelineAssembler &with_render_pass(const vk::RenderPass &render_pass_,
-					    uint32_t subpass_) {
-		render_pass = render_pass_;
-		subpass = subpass_;
-		return *this;
-	}
+	vk::DescriptorPool pool = descriptor_pool(device,
+		vk::DescriptorPoolCreateInfo { {}, levels, sizes }).unwrap(dal);
 
-	template <typename ... Args>
-	PipelineAssembler &with_vertex_layout(const VertexLayout <Args...> &) {
-		using layout = VertexLayout <Args...>;
-		vertex_binding = layout::binding;
-		vertex_attributes = std::vector <vk::VertexInputAttributeDescription>
-			(layout::attributes.begin(), layout::attributes.end());
-		return *this;
-	}
+	std::vector <vk::DescriptorSetLayout> dsls(levels, *pyramid.pipeline.dsl);
+	pyramid.descriptors = device.allocateDescriptorSets({ pool, dsls });
 
-	PipelineAssembler &with_vertex_binding(const vk::VertexInputBindingDescription &binding) {
-		vertex_binding = binding;
-		return *this;
-	}
+	for (uint32_t i = 0; i < levels; i++) {
+		vk::ImageView source = (i == 0) ? depth.view : pyramid.levels[i - 1];
+		vk::ImageLayout layout = (i == 0) ? depth_layout : vk::ImageLayout::eGeneral;
 
-	PipelineAssembler &with_vertex_attributes(const std::vector <vk::VertexInputAttributeDescription> &attributes) {
-		vertex_attributes = attributes;
-		return *this;
+		DescriptorUpdateQueue(pyramid.descriptors[i], pyramid.pipeline.set_bindings[0])
+			.queue_update(0, 0, pyramid.sampler, source, layout)
+			.queue_update(1, 0, vk::Sampler {}, pyramid.levels[i], vk::ImageLayout::eGeneral)
+			.apply(device);
 	}
 
-	PipelineAssembler &with_shader_bundle(const ShaderStageBundle &sb) {
-		bundle = sb;
-		return *this;
-	}
+	return pyramid;
+}
 
-	PipelineAssembler &alpha_blending(bool blend) {
-		alpha_blend = blend;
-		return *this;
-	}
+// Culls objects into an indirect argument buffer and draws them; when the
+// device lacks indirect count draws, culled objects become empty draws, and
+// without multiDrawIndirect those are issued one at a time. Without
+// drawIndirectFirstInstance every draw starts at instance zero, so vertex
+// shaders cannot tell the objects apart by gl_InstanceIndex
+struct IndirectCuller {
+	Pipeline pipeline;
+	vk::DescriptorSet descriptor;
 
-	PipelineAssembler &polygon_mode(vk::PolygonMode pmode) {
-		fill = pmode;
-		return *this;
-	}
+	Buffer objects;
+	Buffer commands;
+	Buffer count;
+	Buffer parameters;
+
+	uint32_t capacity = 0;
+	uint32_t object_count = 0;
+	vk::Extent2D pyramid;
+	bool compact = false;
+	bool multi_draw = false;
+	bool first_instance = false;
+
+	// Must not overlap with frames in flight reading the objects
+	void upload(const vk::Device &device, const std::vector <IndirectObject> &data) {
+		object_count = std::min(uint32_t(data.size()), capacity);
+		if (object_count < data.size()) {
+			microlog::warning("indirect_culler",
+				"Only %u of %lu objects fit into the culler\n",
+				capacity, data.size());
+		}
 
-	PipelineAssembler &cull_mode(vk::CullModeFlags cmode) {
-		culling = cmode;
-		return *this;
-	}
+		if (object_count == 0)
+			return;
 
-	PipelineAssembler &depth_stencil(bool test, bool write) {
-		depth_test = test;
-		depth_write = write;
-		return *this;
+		void *mapped = device.mapMemory(objects.memory, 0, object_count * sizeof(IndirectObject));
+		std::memcpy(mapped, data.data(), object_count * sizeof(IndirectObject));
+		device.unmapMemory(objects.memory);
 	}
 
-	PipelineAssembler &with_dsl_binding(uint32_t binding,
-					    vk::DescriptorType type,
-					    uint32_t count,
-					    vk::ShaderStageFlagBits stage) {
-		dsl_bindings.emplace_back(binding, type, count, stage);
-		return *this;
+	// Outside of any render pass
+	void cull(const vk::CommandBuffer &cmd, CullingParameters info) const {
+		info.object_count = object_count;
+		info.pyramid = { float(pyramid.width), float(pyramid.height) };
+
+		// The previous cull and draws may still be reading the parameters
+		// or writing and reading the count
+		detail::pipeline_barrier(cmd, vk::MemoryBarrier2 {
+			vk::PipelineStageFlagBits2::eComputeShader | vk::PipelineStageFlagBits2::eDrawIndirect,
+			vk::AccessFlagBits2::eShaderStorageWrite,
+			vk::PipelineStageFlagBits2::eTransfer,
+			vk::AccessFlagBits2::eTransferWrite
+		});
+
+		cmd.updateBuffer(parameters.buffer, 0, sizeof(CullingParameters), &info);
+		cmd.fillBuffer(count.buffer, 0, sizeof(uint32_t), 0);
+
+		// Also orders against the previous draws reading the commands
+		detail::pipeline_barrier(cmd, vk::MemoryBarrier2 {
+			vk::PipelineStageFlagBits2::eTransfer | vk::PipelineStageFlagBits2::eDrawIndirect,
+			vk::AccessFlagBits2::eTransferWrite,
+			vk::PipelineStageFlagBits2::eComputeShader,
+			vk::AccessFlagBits2::eUniformRead
+				| vk::AccessFlagBits2::eShaderStorageRead
+				| vk::AccessFlagBits2::eShaderStorageWrite
+		});
+
+		cmd.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline.handle);
+		cmd.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipeline.layout, 0, descriptor, {});
+		cmd.dispatch((object_count + 63) / 64, 1, 1);
+
+		detail::pipeline_barrier(cmd, vk::MemoryBarrier2 {
+			vk::PipelineStageFlagBits2::eComputeShader,
+			vk::AccessFlagBits2::eShaderStorageWrite,
+			vk::PipelineStageFlagBits2::eDrawIndirect,
+			vk::AccessFlagBits2::eIndirectCommandRead
+		});
 	}
 
-	template <size_t N>
-	PipelineAssembler &with_dsl_bindings(const std::array <vk::DescriptorSetLayoutBinding, N> &bindings) {
-		for (const auto &binding : bindings)
-			dsl_bindings.push_back(binding);
-		return *this;
+	// Inside a render pass, with the pipeline, vertex and index buffers bound
+	void draw(const vk::CommandBuffer &cmd) const {
+		constexpr uint32_t stride = sizeof(vk::DrawIndexedIndirectCommand);
+		if (compact) {
+			cmd.drawIndexedIndirectCount(commands.buffer, 0, count.buffer, 0, object_count, stride);
+		} else if (multi_draw) {
+			cmd.drawIndexedIndirect(commands.buffer, 0, object_count, stride);
+		} else {
+			for (uint32_t i = 0; i < object_count; i++)
+				cmd.drawIndexedIndirect(commands.buffer, i * stride, 1, stride);
+		}
 	}
+};
 
-	template <typename T>
-	PipelineAssembler &with_push_constant(vk::ShaderStageFlags stage, uint32_t offset = 0) {
-		push_constants.push_back({ stage, offset, sizeof(T) });
-		return *this;
+// Pass a depth pyramid to enable occlusion culling
+inline IndirectCuller indirect_culler(const vk::Device &device,
+				      const vk::PhysicalDeviceMemoryProperties &properties,
+				      Deallocator &dal,
+				      uint32_t capacity,
+				      const std::optional <std::reference_wrapper <const DepthPyramid>> &pyramid = std::nullopt)
+{
+	IndirectCuller culler;
+	culler.capacity = std::max(capacity, 1u);
+
+	DeviceCapabilities enabled = capabilities(device);
+	culler.compact = enabled.draw_indirect_count;
+	culler.multi_draw = enabled.multi_draw_indirect;
+	culler.first_instance = enabled.draw_indirect_first_instance;
+
+	if (!culler.first_instance) {
+		microlog::warning("indirect_culler",
+			"drawIndirectFirstInstance is not enabled; culled draws "
+			"do not carry their object index in gl_InstanceIndex\n");
+	}
+
+	culler.objects = buffer(device, properties,
+		culler.capacity * sizeof(IndirectObject),
+		vk::BufferUsageFlagBits::eStorageBuffer).unwrap(dal);
+
+	culler.commands = buffer(device, properties,
+		culler.capacity * sizeof(vk::DrawIndexedIndirectCommand),
+		vk::BufferUsageFlagBits::eStorageBuffer
+		| vk::BufferUsageFlagBits::eIndirectBuffer).unwrap(dal);
+
+	culler.count = buffer(device, properties,
+		sizeof(uint32_t),
+		vk::BufferUsageFlagBits::eStorageBuffer
+		| vk::BufferUsageFlagBits::eIndirectBuffer
+		| vk::BufferUsageFlagBits::eTransferDst).unwrap(dal);
+
+	culler.parameters = buffer(device, properties,
+		sizeof(CullingParameters),
+		vk::BufferUsageFlagBits::eUniformBuffer
+		| vk::BufferUsageFlagBits::eTransferDst).unwrap(dal);
+
+	shader::Defines defines;
+	if (culler.compact)
+		defines["LITTLEVK_COMPACT"] = "1";
+	if (culler.first_instance)
+		defines["LITTLEVK_FIRST_INSTANCE"] = "1";
+	if (pyramid)
+		defines["LITTLEVK_HIZ"] = "1";
+
+	auto bundle = ShaderStageBundle(device, dal)
+		.source(detail::culling_shader, vk::ShaderStageFlagBits::eCompute, "main", {}, defines);
+
+	auto assembler = PipelineAssembler <eCompute> (device, dal)
+		.with_shader_bundle(bundle)
+		.with_dsl_binding(0, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute)
+		.with_dsl_binding(1, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute)
+		.with_dsl_binding(2, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute)
+		.with_dsl_binding(3, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eCompute);
+
+	if (pyramid)
+		assembler.with_dsl_binding(4, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eCompute);
+
+	culler.pipeline = assembler.compile();
+
+	std::array <vk::DescriptorPoolSize, 3> sizes {
+		vk::DescriptorPoolSize { vk::DescriptorType::eStorageBuffer, 3 },
+		vk::DescriptorPoolSize { vk::DescriptorType::eUniformBuffer, 1 },
+		vk::DescriptorPoolSize { vk::DescriptorType::eCombinedImageSampler, 1 }
+	};
+
+	vk::DescriptorPool pool = descriptor_pool(device,
+		vk::DescriptorPoolCreateInfo { {}, 1, sizes }).unwrap(dal);
+
+	culler.descriptor = device.allocateDescriptorSets({ pool, *culler.pipeline.dsl }).front();
+
+	DescriptorUpdateQueue updates(culler.descriptor, culler.pipeline.set_bindings[0]);
+	updates.queue_update(0, 0, culler.objects.buffer, 0, culler.capacity * sizeof(IndirectObject))
+		.queue_update(1, 0, culler.commands.buffer, 0, culler.capacity * sizeof(vk::DrawIndexedIndirectCommand))
+		.queue_update(2, 0, culler.count.buffer, 0, sizeof(uint32_t))
+		.queue_update(3, 0, culler.parameters.buffer, 0, sizeof(CullingParameters));
+
+	if (pyramid) {
+		const DepthPyramid &hiz = pyramid->get();
+		updates.queue_update(4, 0, hiz.sampler, hiz.image.view, vk::ImageLayout::eGeneral);
+		culler.pyramid = hiz.extent();
 	}
 
-	Pipeline compile() const {
-		Pipeline pipeline;
+	updates.apply(device);
 
-		std::vector <vk::DescriptorSetLayout> dsls;
-		if (dsl_bindings.size()) {
-			vk::DescriptorSetLayout dsl = descriptor_set_layout(device,
-				vk::DescriptorSetLayoutCreateInfo {
-					{}, dsl_bindings
-				}).unwrap(dal);
+	return culler;
+}
 
-			dsls.push_back(dsl);
-			pipeline.dsl = dsl;
-		}
+// Many meshes packed into shared vertex and index buffers; meshes keep
+// their own (local) indices and are placed with a vertex offset, so a single
+// bind covers every draw, direct or indirect
+struct MeshRegion {
+	uint32_t first_index;
+	uint32_t index_count;
+	int32_t vertex_offset;
+	uint32_t vertex_count;
+};
 
-		pipeline.layout = littlevk::pipeline_layout(device,
-			vk::PipelineLayoutCreateInfo {
-				{}, dsls, push_constants
-			}).unwrap(dal);
+struct MeshRegistry {
+	using Handle = uint32_t;
 
-		pipeline::GraphicsCreateInfo pipeline_info;
+	static constexpr Handle invalid = std::numeric_limits <Handle> ::max();
 
-		pipeline_info.shader_stages = bundle.value().get().stages;
-		pipeline_info.vertex_binding = vertex_binding;
-		pipeline_info.vertex_attributes = vertex_attributes;
-		pipeline_info.extent = window.extent;
-		pipeline_info.pipeline_layout = pipeline.layout;
-		pipeline_info.render_pass = render_pass;
-		pipeline_info.subpass = subpass;
-		pipeline_info.fill_mode = fill;
-		pipeline_info.cull_mode = culling;
-		pipeline_info.dynamic_viewport = true;
-		pipeline_info.alpha_blend = alpha_blend;
-		pipeline_info.depth_test = depth_test;
-		pipeline_info.depth_write = depth_write;
+	vk::Device device;
 
-		pipeline.handle = littlevk::pipeline::compile(device, pipeline_info).unwrap(dal);
+	Buffer vertices;
+	Buffer indices;
+	uint32_t stride = 0;
 
-		// Build the binding map
-		for (auto &dslb : dsl_bindings)
-			pipeline.bindings[dslb.binding] = dslb;
+	uint32_t vertex_capacity = 0;
+	uint32_t index_capacity = 0;
+	uint32_t vertex_count = 0;
+	uint32_t index_count = 0;
 
-		return pipeline;
-	}
+	// Indexed by handle; removed meshes leave empty slots to be reused
+	std::vector <std::optional <MeshRegion>> regions;
+	std::vector <Handle> free_handles;
 
-	operator Pipeline() const { return compile(); }
-};
+	// Returns invalid if the arena is out of space
+	Handle add(const void *, uint32_t, const std::vector <uint32_t> &);
 
-template <>
-struct PipelineAssembler <eCompute> {
-	// Essential
-	const vk::Device &device;
-	littlevk::Deallocator &dal;
+	template <typename V>
+	Handle add(const std::vector <V> &vdata, const std::vector <uint32_t> &idata) {
+		if (sizeof(V) != stride) {
+			microlog::error("mesh_registry", "Vertex size (%lu) does not match the registry stride (%u)\n",
+				sizeof(V), stride);
+			return invalid;
+		}
 
-	// Shader information
-	std::optional <std::reference_wrapper <const ShaderStageBundle>> bundle;
+		return add(vdata.data(), vdata.size(), idata);
+	}
 
-	// Pipeline layout information
-	std::vector <vk::DescriptorSetLayoutBinding> dsl_bindings;
-	std::vector <vk::PushConstantRange> push_constants;
+	// Compacts the remaining meshes; offsets change, so this must not
+	// overlap with frames in flight using the registry
+	void remove(Handle);
 
-	PipelineAssembler(const vk::Device &device_,
-			  littlevk::Deallocator &dal_)
-		: device(device_), dal(dal_)  {}
+	const MeshRegion &operator[](Handle handle) const {
+		return *regions[handle];
+	}
 
-	PipelineAssembler &with_shader_bundle(const ShaderStageBundle &sb) {
-		bundle = sb;
-		return *this;
+	void bind(const vk::CommandBuffer &cmd) const {
+		cmd.bindVertexBuffers(0, vertices.buffer, { 0 });
+		cmd.bindIndexBuffer(indices.buffer, 0, vk::IndexType::eUint32);
 	}
 
-	PipelineAssembler &with_dsl_binding(uint32_t binding,
-					    vk::DescriptorType type,
-					    uint32_t count,
-					    vk::ShaderStageFlagBits stage) {
-		dsl_bindings.emplace_back(binding, type, count, stage);
-		return *this;
+	void draw(const vk::CommandBuffer &cmd, Handle handle,
+		  uint32_t instances = 1, uint32_t first_instance = 0) const {
+		const MeshRegion &region = *regions[handle];
+		cmd.drawIndexed(region.index_count, instances,
+			region.first_index, region.vertex_offset,
+			first_instance);
 	}
 
-	template <size_t N>
-	PipelineAssembler &with_dsl_bindings(const std::array<vk::DescriptorSetLayoutBinding, N> &bindings) {
-		for (const auto &binding : bindings)
-			dsl_bindings.push_back(binding);
-		return *this;
+	// Culling record for the mesh, see IndirectCuller
+	IndirectObject object(Handle handle, const std::array <float, 4> &sphere, uint32_t payload = 0) const {
+		const MeshRegion &region = *regions[handle];
+		return IndirectObject {
+			sphere,
+			region.index_count,
+			region.first_index,
+			region.vertex_offset,
+			payload
+		};
 	}
+};
 
-	template <typename T>
-	PipelineAssembler &with_push_constant(vk::ShaderStageFlagBits stage) {
-		push_constants.push_back(
-			vk::PushConstantRange {stage, 0, sizeof(T)});
-		return *this;
+inline MeshRegistry::Handle MeshRegistry::add(const void *vdata,
+					      uint32_t vcount,
+					      const std::vector <uint32_t> &idata)
+{
+	uint32_t icount = idata.size();
+	if (vertex_count + vcount > vertex_capacity || index_count + icount > index_capacity) {
+		microlog::error("mesh_registry",
+			"Out of space for mesh with %u vertices and %u indices\n",
+			vcount, icount);
+		return invalid;
 	}
 
-	Pipeline compile() const {
-		Pipeline pipeline;
+	MeshRegion region {
+		index_count, icount,
+		int32_t(vertex_count), vcount
+	};
 
-		std::vector<vk::DescriptorSetLayout> dsls;
-		if (dsl_bindings.size()) {
-			vk::DescriptorSetLayout dsl = descriptor_set_layout(device,
-				vk::DescriptorSetLayoutCreateInfo {
-					{}, dsl_bindings
-				}).unwrap(dal);
+	if (vcount > 0) {
+		void *mapped = device.mapMemory(vertices.memory, vk::DeviceSize(vertex_count) * stride, vk::DeviceSize(vcount) * stride);
+		std::memcpy(mapped, vdata, size_t(vcount) * stride);
+		device.unmapMemory(vertices.memory);
+	}
 
-			dsls.push_back(dsl);
-			pipeline.dsl = dsl;
-		}
+	if (icount > 0) {
+		void *mapped = device.mapMemory(indices.memory, vk::DeviceSize(index_count) * sizeof(uint32_t), icount * sizeof(uint32_t));
+		std::memcpy(mapped, idata.data(), icount * sizeof(uint32_t));
+		device.unmapMemory(indices.memory);
+	}
 
-		pipeline.layout = littlevk::pipeline_layout(device,
-			vk::PipelineLayoutCreateInfo {
-				{}, dsls, push_constants
-			}).unwrap(dal);
+	vertex_count += vcount;
+	index_count += icount;
 
-		pipeline::ComputeCreateInfo pipeline_info;
+	Handle handle;
+	if (free_handles.empty()) {
+		handle = regions.size();
+		regions.push_back(region);
+	} else {
+		handle = free_handles.back();
+		free_handles.pop_back();
+		regions[handle] = region;
+	}
 
-		pipeline_info.shader_stage = bundle.value().get().stages.front();
-		pipeline_info.pipeline_layout = pipeline.layout;
+	return handle;
+}
 
-		pipeline.handle =
-			littlevk::pipeline::compile(device, pipeline_info)
-				.unwrap(dal);
+inline void MeshRegistry::remove(Handle handle)
+{
+	if (handle >= regions.size() || !regions[handle])
+		return;
 
-		return pipeline;
+	MeshRegion removed = *regions[handle];
+	regions[handle].reset();
+	free_handles.push_back(handle);
+
+	// Shift everything placed after the removed mesh down
+	uint32_t vertex_tail = vertex_count - (removed.vertex_offset + removed.vertex_count);
+	uint32_t index_tail = index_count - (removed.first_index + removed.index_count);
+
+	if (vertex_tail > 0 && removed.vertex_count > 0) {
+		auto mapped = (uint8_t *) device.mapMemory(vertices.memory, 0, vk::DeviceSize(vertex_count) * stride);
+		std::memmove(mapped + size_t(removed.vertex_offset) * stride,
+			     mapped + size_t(removed.vertex_offset + removed.vertex_count) * stride,
+			     size_t(vertex_tail) * stride);
+		device.unmapMemory(vertices.memory);
 	}
 
-	operator Pipeline() const {
-		return compile();
+	if (index_tail > 0 && removed.index_count > 0) {
+		auto mapped = (uint32_t *) device.mapMemory(indices.memory, 0, vk::DeviceSize(index_count) * sizeof(uint32_t));
+		std::memmove(mapped + removed.first_index,
+			     mapped + removed.first_index + removed.index_count,
+			     index_tail * sizeof(uint32_t));
+		device.unmapMemory(indices.memory);
 	}
-};
+
+	for (auto &region : regions) {
+		if (!region)
+			continue;
+
+		if (region->vertex_offset > removed.vertex_offset)
+			region->vertex_offset -= removed.vertex_count;
+		if (region->first_index > removed.first_index)
+			region->first_index -= removed.index_count;
+	}
+
+	vertex_count -= removed.vertex_count;
+	index_count -= removed.index_count;
+}
+
+static void destroy_mesh_registry(const vk::Device &device, const MeshRegistry &registry)
+{
+	destroy_buffer(device, registry.vertices);
+	destroy_buffer(device, registry.indices);
+}
+
+using MeshRegistryReturnProxy = DeviceReturnProxy <MeshRegistry, destroy_mesh_registry>;
+
+// Capacities are in vertices (of the given stride) and indices
+inline MeshRegistryReturnProxy mesh_registry(const vk::Device &device,
+					     const vk::PhysicalDeviceMemoryProperties &properties,
+					     uint32_t stride,
+					     uint32_t vertex_capacity,
+					     uint32_t index_capacity,
+					     const vk::BufferUsageFlags &extra = {})
+{
+	MeshRegistry registry;
+	registry.device = device;
+	registry.stride = stride;
+	registry.vertex_capacity = std::max(vertex_capacity, 1u);
+	registry.index_capacity = std::max(index_capacity, 1u);
+
+	// Storage usage allows vertex pulling and GPU side processing
+	registry.vertices = buffer(device, properties,
+		size_t(registry.vertex_capacity) * stride,
+		vk::BufferUsageFlagBits::eVertexBuffer
+		| vk::BufferUsageFlagBits::eStorageBuffer | extra).value;
+
+	registry.indices = buffer(device, properties,
+		size_t(registry.index_capacity) * sizeof(uint32_t),
+		vk::BufferUsageFlagBits::eIndexBuffer
+		| vk::BufferUsageFlagBits::eStorageBuffer | extra).value;
+
+	return registry;
+}
 
 } // namespace littlevk
 
+// Reflection of vertex structs; see VertexField
+#define LITTLEVK_EXPAND(x) x
+
+#define LITTLEVK_VERTEX_FIELD(T, f)					\
+	littlevk::VertexField {						\
+		littlevk::vertex_field_format <decltype(T::f)> (),	\
+		uint32_t(offsetof(T, f)),				\
+		uint32_t(sizeof(T::f))					\
+	}
+
+#define LITTLEVK_FIELDS_1(T, f) LITTLEVK_VERTEX_FIELD(T, f)
+#define LITTLEVK_FIELDS_2(T, f, ...) LITTLEVK_VERTEX_FIELD(T, f), LITTLEVK_EXPAND(LITTLEVK_FIELDS_1(T, __VA_ARGS__))
+#define LITTLEVK_FIELDS_3(T, f, ...) LITTLEVK_VERTEX_FIELD(T, f), LITTLEVK_EXPAND(LITTLEVK_FIELDS_2(T, __VA_ARGS__))
+#define LITTLEVK_FIELDS_4(T, f, ...) LITTLEVK_VERTEX_FIELD(T, f), LITTLEVK_EXPAND(LITTLEVK_FIELDS_3(T, __VA_ARGS__))
+#define LITTLEVK_FIELDS_5(T, f, ...) LITTLEVK_VERTEX_FIELD(T, f), LITTLEVK_EXPAND(LITTLEVK_FIELDS_4(T, __VA_ARGS__))
+#define LITTLEVK_FIELDS_6(T, f, ...) LITTLEVK_VERTEX_FIELD(T, f), LITTLEVK_EXPAND(LITTLEVK_FIELDS_5(T, __VA_ARGS__))
+#define LITTLEVK_FIELDS_7(T, f, ...) LITTLEVK_VERTEX_FIELD(T, f), LITTLEVK_EXPAND(LITTLEVK_FIELDS_6(T, __VA_ARGS__))
+#define LITTLEVK_FIELDS_8(T, f, ...) LITTLEVK_VERTEX_FIELD(T, f), LITTLEVK_EXPAND(LITTLEVK_FIELDS_7(T, __VA_ARGS__))
+#define LITTLEVK_FIELDS_9(T, f, ...) LITTLEVK_VERTEX_FIELD(T, f), LITTLEVK_EXPAND(LITTLEVK_FIELDS_8(T, __VA_ARGS__))
+#define LITTLEVK_FIELDS_10(T, f, ...) LITTLEVK_VERTEX_FIELD(T, f), LITTLEVK_EXPAND(LITTLEVK_FIELDS_9(T, __VA_ARGS__))
+#define LITTLEVK_FIELDS_11(T, f, ...) LITTLEVK_VERTEX_FIELD(T, f), LITTLEVK_EXPAND(LITTLEVK_FIELDS_10(T, __VA_ARGS__))
+#define LITTLEVK_FIELDS_12(T, f, ...) LITTLEVK_VERTEX_FIELD(T, f), LITTLEVK_EXPAND(LITTLEVK_FIELDS_11(T, __VA_ARGS__))
+
+#define LITTLEVK_FIELDS_SELECT(_1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, _12, NAME, ...) NAME
+
+#define LITTLEVK_FIELDS(T, ...)							\
+	LITTLEVK_EXPAND(LITTLEVK_FIELDS_SELECT(__VA_ARGS__,			\
+		LITTLEVK_FIELDS_12, LITTLEVK_FIELDS_11, LITTLEVK_FIELDS_10,	\
+		LITTLEVK_FIELDS_9, LITTLEVK_FIELDS_8, LITTLEVK_FIELDS_7,	\
+		LITTLEVK_FIELDS_6, LITTLEVK_FIELDS_5, LITTLEVK_FIELDS_4,	\
+		LITTLEVK_FIELDS_3, LITTLEVK_FIELDS_2, LITTLEVK_FIELDS_1)	\
+		(T, __VA_ARGS__))
+
+// Declares the attributes of a vertex struct, in location order (at most 12)
+#define LITTLEVK_VERTEX(T, ...)							\
+	template <>								\
+	struct littlevk::vertex_reflection <T, true> {				\
+		static constexpr std::array fields {				\
+			LITTLEVK_FIELDS(T, __VA_ARGS__)				\
+		};								\
+	};
+
 // Specializing formats
+template <>
+struct littlevk::type_translator <littlevk::r32f, true> {
+	static constexpr vk::Format format = vk::Format::eR32Sfloat;
+};
+
 template <>
 struct littlevk::type_translator <littlevk::rg32f, true> {
 	static constexpr vk::Format format = vk::Format::eR32G32Sfloat;
@@ -3565,6 +9899,61 @@ struct littlevk::type_translator <littlevk::rgba32f, true> {
 	static constexpr vk::Format format = vk::Format::eR32G32B32A32Sfloat;
 };
 
+template <>
+struct littlevk::type_translator <littlevk::rg16f, true> {
+	static constexpr vk::Format format = vk::Format::eR16G16Sfloat;
+};
+
+template <>
+struct littlevk::type_translator <littlevk::rgba16f, true> {
+	static constexpr vk::Format format = vk::Format::eR16G16B16A16Sfloat;
+};
+
+template <>
+struct littlevk::type_translator <littlevk::rg16snorm, true> {
+	static constexpr vk::Format format = vk::Format::eR16G16Snorm;
+};
+
+template <>
+struct littlevk::type_translator <littlevk::rgba16snorm, true> {
+	static constexpr vk::Format format = vk::Format::eR16G16B16A16Snorm;
+};
+
+template <>
+struct littlevk::type_translator <littlevk::rg16unorm, true> {
+	static constexpr vk::Format format = vk::Format::eR16G16Unorm;
+};
+
+template <>
+struct littlevk::type_translator <littlevk::rgba16unorm, true> {
+	static constexpr vk::Format format = vk::Format::eR16G16B16A16Unorm;
+};
+
+template <>
+struct littlevk::type_translator <littlevk::rgba8snorm, true> {
+	static constexpr vk::Format format = vk::Format::eR8G8B8A8Snorm;
+};
+
+template <>
+struct littlevk::type_translator <littlevk::rgba8unorm, true> {
+	static constexpr vk::Format format = vk::Format::eR8G8B8A8Unorm;
+};
+
+template <>
+struct littlevk::type_translator <littlevk::a2b10g10r10, true> {
+	static constexpr vk::Format format = vk::Format::eA2B10G10R10UnormPack32;
+};
+
+template <>
+struct littlevk::type_translator <littlevk::oct16, true> {
+	static constexpr vk::Format format = vk::Format::eR16G16Snorm;
+};
+
+template <>
+struct littlevk::type_translator <littlevk::oct8, true> {
+	static constexpr vk::Format format = vk::Format::eR8G8Snorm;
+};
+
 // Specializing for GLM types if defined
 #ifdef LITTLEVK_GLM_TRANSLATOR
 
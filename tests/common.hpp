@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+
+#include "littlevk.hpp"
+
+// Failed checks are reported and counted; tests return the count
+inline int failures = 0;
+
+#define CHECK(condition)							\
+	do {									\
+		if (!(condition)) {						\
+			fprintf(stderr, "%s:%d: check failed: %s\n",		\
+				__FILE__, __LINE__, #condition);		\
+			failures++;						\
+		}								\
+	} while (0)
+
+// Same, but leaves the test function; for checks later ones depend on
+#define REQUIRE(condition)							\
+	do {									\
+		if (!(condition)) {						\
+			fprintf(stderr, "%s:%d: requirement failed: %s\n",	\
+				__FILE__, __LINE__, #condition);		\
+			failures++;						\
+			return;							\
+		}								\
+	} while (0)
+
+// Handles are only compared, never passed to a driver
+inline littlevk::Image fake_image(uintptr_t id, uint32_t mip_levels = 1, uint32_t array_layers = 1)
+{
+	littlevk::Image image;
+	image.image = vk::Image(reinterpret_cast <VkImage> (id));
+	image.aspect = vk::ImageAspectFlagBits::eColor;
+	image.mip_levels = mip_levels;
+	image.array_layers = array_layers;
+	return image;
+}
+
+inline littlevk::Buffer fake_buffer(uintptr_t id)
+{
+	littlevk::Buffer buffer;
+	buffer.buffer = vk::Buffer(reinterpret_cast <VkBuffer> (id));
+	return buffer;
+}
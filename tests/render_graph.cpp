@@ -0,0 +1,71 @@
+#include "common.hpp"
+
+using namespace littlevk;
+
+using Stage = vk::PipelineStageFlagBits2;
+using Access = vk::AccessFlagBits2;
+
+// An attachment rendered once, then sampled by a fragment pass and by a
+// compute pass; the compute pass must still wait for the attachment
+void fragment_then_compute()
+{
+	RenderGraph graph;
+
+	auto color = graph.import("color", fake_image(1));
+	auto composite = graph.import("composite", fake_image(2));
+	auto histogram = graph.import("histogram", fake_buffer(3));
+
+	graph.pass("draw")
+		.write(color, usage::color_attachment);
+
+	graph.pass("composite")
+		.read(color, usage::fragment_sampled)
+		.write(composite, usage::color_attachment);
+
+	graph.pass("histogram")
+		.read(color, usage::compute_sampled)
+		.write(histogram, { vk::ImageLayout::eUndefined, Stage::eComputeShader, Access::eShaderStorageWrite });
+
+	graph.output(composite);
+	graph.output(histogram);
+
+	// Imported resources only, so nothing is allocated
+	graph.compile(nullptr, {});
+	REQUIRE(graph.order.size() == 3);
+
+	graph.prepare();
+
+	const auto &fragment = graph.passes[1].image_barriers;
+	auto sampled = std::find_if(fragment.begin(), fragment.end(),
+		[&](const vk::ImageMemoryBarrier2 &b) { return b.image == *graph.image(color); });
+
+	REQUIRE(sampled != fragment.end());
+	CHECK(sampled->newLayout == vk::ImageLayout::eShaderReadOnlyOptimal);
+	CHECK(sampled->srcAccessMask == Access::eColorAttachmentWrite);
+
+	const auto &compute = graph.passes[2].image_barriers;
+	REQUIRE(compute.size() == 1);
+	CHECK(compute[0].image == *graph.image(color));
+	CHECK(compute[0].oldLayout == vk::ImageLayout::eShaderReadOnlyOptimal);
+	CHECK(compute[0].newLayout == vk::ImageLayout::eShaderReadOnlyOptimal);
+	CHECK(compute[0].srcStageMask & Stage::eFragmentShader);
+	CHECK(compute[0].dstStageMask & Stage::eComputeShader);
+	CHECK(compute[0].dstAccessMask & Access::eShaderSampledRead);
+
+	// Next frame, drawing into the attachment waits for both readers
+	graph.prepare();
+
+	const auto &draw = graph.passes[0].image_barriers;
+	REQUIRE(draw.size() == 1);
+	CHECK(draw[0].srcStageMask == (Stage::eFragmentShader | Stage::eComputeShader));
+}
+
+int main()
+{
+	fragment_then_compute();
+
+	if (failures)
+		fprintf(stderr, "%d checks failed\n", failures);
+
+	return failures ? 1 : 0;
+}
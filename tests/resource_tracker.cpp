@@ -0,0 +1,178 @@
+#include "common.hpp"
+
+using namespace littlevk;
+
+using Stage = vk::PipelineStageFlagBits2;
+using Access = vk::AccessFlagBits2;
+
+struct Barriers {
+	std::vector <vk::ImageMemoryBarrier2> images;
+	std::vector <vk::BufferMemoryBarrier2> buffers;
+};
+
+// Barriers of one batch, as they would be recorded by flush()
+Barriers take(ResourceTracker &tracker)
+{
+	Barriers barriers;
+	tracker.take(barriers.images, barriers.buffers);
+	return barriers;
+}
+
+// Rendered, sampled in a fragment shader and then sampled in a compute
+// shader; the second reader still has to wait for the attachment write
+void two_readers()
+{
+	ResourceTracker tracker;
+	Image image = fake_image(1);
+
+	tracker.image(image, usage::color_attachment);
+	take(tracker);
+
+	tracker.image(image, usage::fragment_sampled);
+	Barriers fragment = take(tracker);
+
+	REQUIRE(fragment.images.size() == 1);
+	CHECK(fragment.images[0].oldLayout == vk::ImageLayout::eColorAttachmentOptimal);
+	CHECK(fragment.images[0].newLayout == vk::ImageLayout::eShaderReadOnlyOptimal);
+	CHECK(fragment.images[0].srcAccessMask == Access::eColorAttachmentWrite);
+
+	tracker.image(image, usage::compute_sampled);
+	Barriers compute = take(tracker);
+
+	// Chained after the layout transition, which completes before the
+	// fragment shader stage of the first reader
+	REQUIRE(compute.images.size() == 1);
+	CHECK(compute.images[0].oldLayout == vk::ImageLayout::eShaderReadOnlyOptimal);
+	CHECK(compute.images[0].newLayout == vk::ImageLayout::eShaderReadOnlyOptimal);
+	CHECK(compute.images[0].srcStageMask & Stage::eFragmentShader);
+	CHECK(compute.images[0].dstStageMask & Stage::eComputeShader);
+	CHECK(compute.images[0].dstAccessMask & Access::eShaderSampledRead);
+
+	// Both readers are covered from here on
+	tracker.image(image, usage::compute_sampled);
+	tracker.image(image, usage::fragment_sampled);
+	CHECK(take(tracker).images.empty());
+
+	// Writing again waits for both of them
+	tracker.image(image, usage::color_attachment);
+	Barriers write = take(tracker);
+
+	REQUIRE(write.images.size() == 1);
+	CHECK(write.images[0].srcStageMask == (Stage::eFragmentShader | Stage::eComputeShader));
+}
+
+// Both readers in the same batch share the transition
+void two_readers_one_batch()
+{
+	ResourceTracker tracker;
+	Image image = fake_image(1);
+
+	tracker.image(image, usage::color_attachment);
+	take(tracker);
+
+	tracker.image(image, usage::fragment_sampled);
+	tracker.image(image, usage::compute_sampled);
+	Barriers barriers = take(tracker);
+
+	REQUIRE(barriers.images.size() == 1);
+	CHECK(barriers.images[0].dstStageMask == (Stage::eFragmentShader | Stage::eComputeShader));
+
+	tracker.image(image, usage::compute_sampled);
+	CHECK(take(tracker).images.empty());
+}
+
+// Storage writes and reads in the general layout need no transition, but
+// reading after a write still needs a barrier
+void storage_read_after_write()
+{
+	ResourceTracker tracker;
+	Image image = fake_image(1);
+
+	ResourceUsage storage_read {
+		vk::ImageLayout::eGeneral,
+		Stage::eComputeShader,
+		Access::eShaderStorageRead
+	};
+
+	tracker.image(image, usage::compute_storage);
+	take(tracker);
+
+	tracker.image(image, storage_read);
+	Barriers barriers = take(tracker);
+
+	REQUIRE(barriers.images.size() == 1);
+	CHECK(barriers.images[0].srcAccessMask == Access::eShaderStorageWrite);
+	CHECK(barriers.images[0].dstAccessMask & Access::eShaderStorageRead);
+
+	tracker.image(image, storage_read);
+	CHECK(take(tracker).images.empty());
+}
+
+// Barriers for subresources with matching states are merged
+void subresources()
+{
+	ResourceTracker tracker;
+	Image image = fake_image(1, 4, 2);
+
+	tracker.image(image, usage::transfer_dst);
+	Barriers upload = take(tracker);
+
+	REQUIRE(upload.images.size() == 1);
+	CHECK(upload.images[0].subresourceRange.levelCount == 4);
+	CHECK(upload.images[0].subresourceRange.layerCount == 2);
+
+	tracker.image(image, usage::fragment_sampled);
+	take(tracker);
+
+	// Only the levels not read in compute yet need a barrier
+	tracker.image(image, usage::compute_sampled, vk::ImageSubresourceRange {
+		vk::ImageAspectFlagBits::eColor, 1, 2, 0, 2
+	});
+
+	take(tracker);
+
+	tracker.image(image, usage::compute_sampled);
+	Barriers rest = take(tracker);
+
+	REQUIRE(rest.images.size() == 2);
+	CHECK(rest.images[0].subresourceRange.baseMipLevel == 0);
+	CHECK(rest.images[1].subresourceRange.baseMipLevel == 3);
+}
+
+// Indirect arguments written by a compute pass and later read as storage
+void buffer_readers()
+{
+	ResourceTracker tracker;
+	Buffer buffer = fake_buffer(2);
+
+	tracker.buffer(buffer, Stage::eComputeShader, Access::eShaderStorageWrite);
+	take(tracker);
+
+	tracker.buffer(buffer, Stage::eDrawIndirect, Access::eIndirectCommandRead);
+	CHECK(take(tracker).buffers.size() == 1);
+
+	tracker.buffer(buffer, Stage::eVertexShader, Access::eShaderStorageRead);
+	Barriers vertex = take(tracker);
+
+	REQUIRE(vertex.buffers.size() == 1);
+	CHECK(vertex.buffers[0].srcStageMask == Stage::eComputeShader);
+	CHECK(vertex.buffers[0].srcAccessMask == Access::eShaderStorageWrite);
+	CHECK(vertex.buffers[0].dstStageMask & Stage::eVertexShader);
+
+	tracker.buffer(buffer, Stage::eDrawIndirect, Access::eIndirectCommandRead);
+	CHECK(take(tracker).buffers.empty());
+}
+
+int main()
+{
+	two_readers();
+	two_readers_one_batch();
+	storage_read_after_write();
+	subresources();
+	buffer_readers();
+
+	if (failures)
+		fprintf(stderr, "%d checks failed\n", failures);
+
+	return failures ? 1 : 0;
+}